@@ -0,0 +1,87 @@
+#include "allocation_counter.hpp"
+
+#ifdef count_allocations
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+auto counted_allocate(std::size_t size) -> void* {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    // `malloc` may return null for a size of 0.
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+auto counted_allocate(std::size_t size, std::align_val_t alignment) -> void* {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    auto const align = static_cast<std::size_t>(alignment);
+    // `aligned_alloc` requires the size to be a multiple of the alignment.
+    return std::aligned_alloc(align, ((size + align - 1) / align) * align);
+}
+}  // namespace
+
+auto operator new(std::size_t size) -> void* {
+    if (void* p_memory = counted_allocate(size)) {
+        return p_memory;
+    }
+    throw std::bad_alloc();
+}
+
+auto operator new[](std::size_t size) -> void* {
+    return operator new(size);
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment) -> void* {
+    if (void* p_memory = counted_allocate(size, alignment)) {
+        return p_memory;
+    }
+    throw std::bad_alloc();
+}
+
+auto operator new[](std::size_t size, std::align_val_t alignment) -> void* {
+    return operator new(size, alignment);
+}
+
+auto operator new(std::size_t size, std::nothrow_t const&) noexcept -> void* {
+    return counted_allocate(size);
+}
+
+auto operator new[](std::size_t size, std::nothrow_t const&) noexcept
+    -> void* {
+    return counted_allocate(size);
+}
+
+void operator delete(void* p_memory) noexcept {
+    std::free(p_memory);
+}
+
+void operator delete[](void* p_memory) noexcept {
+    std::free(p_memory);
+}
+
+void operator delete(void* p_memory, std::size_t) noexcept {
+    std::free(p_memory);
+}
+
+void operator delete[](void* p_memory, std::size_t) noexcept {
+    std::free(p_memory);
+}
+
+void operator delete(void* p_memory, std::align_val_t) noexcept {
+    std::free(p_memory);
+}
+
+void operator delete[](void* p_memory, std::align_val_t) noexcept {
+    std::free(p_memory);
+}
+
+void operator delete(void* p_memory, std::size_t, std::align_val_t) noexcept {
+    std::free(p_memory);
+}
+
+void operator delete[](void* p_memory, std::size_t,
+                       std::align_val_t) noexcept {
+    std::free(p_memory);
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// How many times the global `operator new` has been called. This is only
+// counted when `count_allocations` is defined by `../CMakeLists.txt`, so that
+// frames can be checked for heap allocations.
+inline std::atomic<std::size_t> g_allocation_count = 0;
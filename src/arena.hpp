@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+// A linear allocator for data which only lives for one frame. Allocating bumps
+// a pointer, deallocating does nothing, and `.reset()` frees everything at
+// once. If the arena runs out of space, allocations fall back onto the heap
+// and are counted, so that the arena's capacity can be raised. This is not
+// thread-safe.
+class frame_arena final : public std::pmr::memory_resource {
+  public:
+    static constexpr std::size_t default_capacity = 1'048'576;
+
+    explicit frame_arena(std::size_t capacity = default_capacity)
+        : m_buffer(std::make_unique<std::byte[]>(capacity)),
+          m_capacity(capacity) {
+    }
+
+    // Everything allocated since the last reset must no longer be used.
+    void reset() {
+        m_used_size = 0;
+    }
+
+    [[nodiscard]]
+    auto get_used_size() const -> std::size_t {
+        return m_used_size;
+    }
+
+    // How many allocations did not fit in the arena since it was created.
+    [[nodiscard]]
+    auto get_overflow_count() const -> std::size_t {
+        return m_overflow_count;
+    }
+
+  private:
+    auto do_allocate(std::size_t bytes, std::size_t alignment)
+        -> void* override {
+        auto const address =
+            reinterpret_cast<std::uintptr_t>(m_buffer.get()) + m_used_size;
+        std::size_t const padding = (alignment - (address % alignment)) %
+                                    alignment;
+
+        if (m_used_size + padding + bytes > m_capacity) {
+            ++m_overflow_count;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void* p_allocation = m_buffer.get() + m_used_size + padding;
+        m_used_size += padding + bytes;
+        return p_allocation;
+    }
+
+    void do_deallocate(void* p_allocation, std::size_t bytes,
+                       std::size_t alignment) override {
+        // Only allocations which overflowed are freed individually.
+        auto* const p_byte = static_cast<std::byte*>(p_allocation);
+        if (p_byte < m_buffer.get() || p_byte >= m_buffer.get() + m_capacity) {
+            std::pmr::new_delete_resource()->deallocate(p_allocation, bytes,
+                                                        alignment);
+        }
+    }
+
+    [[nodiscard]]
+    auto do_is_equal(std::pmr::memory_resource const& other) const noexcept
+        -> bool override {
+        return this == &other;
+    }
+
+    std::unique_ptr<std::byte[]> m_buffer;
+    std::size_t m_capacity;
+    std::size_t m_used_size = 0;
+    std::size_t m_overflow_count = 0;
+};
+
+// Per-frame resources are allocated for this many frames in flight, of which
+// the first `g_frames_in_flight` are used.
+inline constexpr std::uint32_t max_frames_in_flight = 3;
+
+// Each frame in flight has its own arena, so that one frame's transient data
+// is not overwritten while another frame is being built.
+inline std::array<frame_arena, max_frames_in_flight> g_frame_arenas;
+
+// This counts every frame which has been built.
+inline constinit std::size_t g_frame_number = 0;
+
+[[nodiscard]]
+inline auto get_frame_arena() -> frame_arena& {
+    return g_frame_arenas[g_frame_number % max_frames_in_flight];
+}
@@ -0,0 +1,280 @@
+#include "benchmark.hpp"
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numbers>
+#include <span>
+#include <thread>
+
+#include "arena.hpp"
+#include "camera.hpp"
+#include "cpu_profiler.hpp"
+#include "geometry.hpp"
+#include "headless.hpp"
+#include "light.hpp"
+#include "scene.hpp"
+#include "texture_loader.hpp"
+#include "texture_residency.hpp"
+#include "vulkan_flow.hpp"
+
+namespace {
+// Each configuration renders this many frames before it is measured, so that
+// the profiler's queries from the previous configuration are read back.
+constexpr std::size_t warm_up_frame_count = 8;
+constexpr std::size_t measured_frame_count = gpu_profiler::rolling_frame_count;
+
+constexpr benchmark_config baseline_config = {
+    .instance_count = 1'000,
+    .light_count = 2,
+    .render_scale = 1.f,
+};
+
+// Cubes are laid out on a grid this far apart.
+constexpr float cube_spacing = 2.f;
+
+using milliseconds = std::chrono::duration<double, std::milli>;
+
+// How far the camera orbits from the center of the current scene.
+float g_orbit_radius = 0.f;
+
+// Orbit the scene once over the measured frames, looking down at its center.
+void set_benchmark_camera(std::size_t frame) {
+    float const angle = 2.f * std::numbers::pi_v<float> *
+                        static_cast<float>(frame) /
+                        static_cast<float>(measured_frame_count);
+    float const height = g_orbit_radius * 0.5f;
+    g_camera.position = {g_orbit_radius * std::sin(angle), height,
+                         g_orbit_radius * std::cos(angle)};
+    // The camera looks down -Z before it is rotated.
+    g_camera.yaw = -angle;
+    g_camera.pitch = -std::atan2(height, g_orbit_radius);
+}
+
+struct frame_sample {
+    std::size_t upload_bytes;
+    double record_milliseconds;
+    double frame_milliseconds;
+};
+
+// Build and render a frame in the next slot, like the game loop.
+auto render_benchmark_frame(std::size_t frame) -> frame_sample {
+    cpu_zone("benchmark frame");
+    auto const frame_start = std::chrono::steady_clock::now();
+    ++g_frame_number;
+    get_frame_arena().reset();
+    auto const slot =
+        static_cast<unsigned>(g_frame_number % g_frames_in_flight);
+    wait_for_frame(slot);
+
+    set_benchmark_camera(frame);
+    glm::mat4x4 const view = g_camera.make_view_matrix();
+    g_bindless_data.set_view_matrix(view);
+    g_bindless_data.set_camera_position(g_camera.position);
+    g_lights.cull(g_bindless_data.get_proj_matrix() * view);
+    g_bindless_data.push_scene(g_scene, get_renderer_inputs());
+
+    g_mesh_textures.update(slot);
+
+    frame_sample sample{};
+    sample.upload_bytes = upload_bindless_data(slot);
+
+    auto const record_start = std::chrono::steady_clock::now();
+    record_frame(slot, slot);
+    sample.record_milliseconds =
+        milliseconds(std::chrono::steady_clock::now() - record_start).count();
+    render_offscreen(slot);
+    sample.frame_milliseconds =
+        milliseconds(std::chrono::steady_clock::now() - frame_start).count();
+    return sample;
+}
+
+void write_benchmark_json(std::filesystem::path const& path,
+                          std::span<benchmark_result const> results) {
+    std::ofstream stream(path);
+    stream << std::fixed << std::setprecision(3) << "{\"device\":\""
+           << g_physical_device.properties.deviceName << "\",\"results\":[";
+
+    bool is_first = true;
+    for (benchmark_result const& result : results) {
+        stream << (is_first ? "\n" : ",\n")
+               << "{\"instances\":" << result.config.instance_count
+               << ",\"lights\":" << result.config.light_count
+               << ",\"render_scale\":" << result.config.render_scale
+               << ",\"render_width\":" << result.render_extent.width
+               << ",\"render_height\":" << result.render_extent.height
+               << ",\"build_milliseconds\":" << result.build_milliseconds
+               << ",\"build_upload_bytes\":" << result.build_upload_bytes
+               << ",\"upload_bytes\":" << result.upload_bytes
+               << ",\"record_milliseconds\":" << result.record_milliseconds
+               << ",\"frame_milliseconds\":" << result.frame_milliseconds
+               << ",\"gpu_scopes\":[";
+        is_first = false;
+
+        bool is_first_scope = true;
+        for (gpu_scope_average const& scope : result.gpu_scopes) {
+            stream << (is_first_scope ? "" : ",") << "{\"name\":\""
+                   << scope.name << '"';
+            if (scope.index != no_scope_index) {
+                stream << ",\"index\":" << scope.index;
+            }
+            stream << ",\"milliseconds\":" << scope.stats.milliseconds
+                   << ",\"vertex_invocations\":"
+                   << scope.stats.vertex_invocations
+                   << ",\"fragment_invocations\":"
+                   << scope.stats.fragment_invocations << '}';
+            is_first_scope = false;
+        }
+        stream << "]}";
+    }
+    stream << "\n]}\n";
+}
+}  // namespace
+
+auto get_benchmark_configs() -> std::vector<benchmark_config> {
+    std::vector<benchmark_config> configs;
+    for (std::uint32_t count = 10; count <= 1'000'000; count *= 10) {
+        benchmark_config config = baseline_config;
+        config.instance_count = count;
+        configs.push_back(config);
+    }
+    // Lights past the visible budget get no shadow pass, but each still
+    // creates a map, so the sweep stops at the budget.
+    for (std::uint32_t count = 1; count <= max_visible_light_count;
+         count *= 2) {
+        benchmark_config config = baseline_config;
+        config.light_count = count;
+        configs.push_back(config);
+    }
+    for (float const scale : {0.25f, 0.5f, 0.75f, 1.f}) {
+        benchmark_config config = baseline_config;
+        config.render_scale = scale;
+        configs.push_back(config);
+    }
+    return configs;
+}
+
+void build_benchmark_scene(benchmark_config const& config) {
+    cpu_zone("build benchmark scene");
+    g_scene = scene{};
+
+    // About half of the instances tile a plane, and the rest are cubes above
+    // it.
+    auto const tile_columns = static_cast<std::uint32_t>(
+        std::ceil(std::sqrt(static_cast<double>(config.instance_count / 2))));
+    std::uint32_t const tile_rows =
+        (tile_columns == 0) ? 0 : (config.instance_count / 2) / tile_columns;
+    std::uint32_t const cube_count =
+        config.instance_count - (tile_rows * tile_columns);
+    auto const cube_columns = static_cast<std::uint32_t>(
+        std::ceil(std::sqrt(static_cast<double>(cube_count))));
+    float const extent = static_cast<float>(cube_columns) * cube_spacing;
+    float const half_columns = static_cast<float>(cube_columns) / 2.f;
+
+    for (std::uint32_t i = 0; i < cube_count; ++i) {
+        glm::vec3 const position = {
+            (static_cast<float>(i % cube_columns) - half_columns) *
+                cube_spacing,
+            0.f,
+            (static_cast<float>(i / cube_columns) - half_columns) *
+                cube_spacing,
+        };
+        (void)g_scene.create(
+            0, {.position = position,
+                .rotation = glm::angleAxis(static_cast<float>(i),
+                                           glm::vec3{0.f, 1.f, 0.f})});
+    }
+
+    if (tile_rows > 0) {
+        mesh_instance const tile_even = {.color_blend = {1, 2, 1, 1}};
+        mesh_instance const tile_odd = {.color_blend = {-0.9, -0.9, -0.9, 1}};
+        for (mesh_instance const& plane : make_checkerboard_plane(
+                 {0, -0.8f, 0}, extent / static_cast<float>(tile_columns),
+                 extent / static_cast<float>(tile_rows), tile_rows,
+                 tile_columns, tile_even, tile_odd)) {
+            (void)g_scene.create(1, plane);
+        }
+    }
+
+    // Lights circle the scene, pointing at its center.
+    g_lights.clear();
+    float const light_radius = (extent / 2.f) + 3.f;
+    for (std::uint32_t i = 0; i < config.light_count; ++i) {
+        float const angle = 2.f * std::numbers::pi_v<float> *
+                            static_cast<float>(i) /
+                            static_cast<float>(config.light_count);
+        glm::vec3 const position = {light_radius * std::cos(angle),
+                                    light_radius * 0.5f,
+                                    light_radius * std::sin(angle)};
+        (void)g_lights.create({.transform = glm::lookAt(position, {0, 0, 0},
+                                                        {0.f, 1.f, 0.f}),
+                               .projection = projection_matrix,
+                               .position = position});
+    }
+
+    g_orbit_radius = (extent * 0.75f) + 3.f;
+}
+
+void run_benchmark(std::filesystem::path const& path) {
+    // Textures finish loading first, so that they do not disturb the first
+    // configuration.
+    g_device.waitIdle();
+    while (g_texture_loader.is_loading()) {
+        if (g_texture_loader.poll()) {
+            update_descriptors();
+        }
+        std::this_thread::yield();
+    }
+
+    std::vector<benchmark_result> results;
+    for (benchmark_config const& config : get_benchmark_configs()) {
+        std::cout << "Benchmarking " << config.instance_count
+                  << " instances with " << config.light_count
+                  << " lights at " << config.render_scale << " scale.\n";
+        g_device.waitIdle();
+
+        g_render_scale = config.render_scale;
+        benchmark_result result = {.config = config,
+                                   .render_extent = get_render_extent()};
+        set_camera_projection(result.render_extent);
+
+        auto const build_start = std::chrono::steady_clock::now();
+        build_benchmark_scene(config);
+        g_bindless_data.push_scene(g_scene, get_renderer_inputs());
+        result.build_milliseconds =
+            milliseconds(std::chrono::steady_clock::now() - build_start)
+                .count();
+        // The first frame uploads the built scene.
+        result.build_upload_bytes = render_benchmark_frame(0).upload_bytes;
+        for (std::size_t i = 1; i < warm_up_frame_count; ++i) {
+            (void)render_benchmark_frame(i);
+        }
+        g_gpu_profiler.clear_averages();
+
+        for (std::size_t i = 0; i < measured_frame_count; ++i) {
+            frame_sample const sample = render_benchmark_frame(i);
+            result.upload_bytes += static_cast<double>(sample.upload_bytes);
+            result.record_milliseconds += sample.record_milliseconds;
+            result.frame_milliseconds += sample.frame_milliseconds;
+        }
+        auto const frame_count = static_cast<double>(measured_frame_count);
+        result.upload_bytes /= frame_count;
+        result.record_milliseconds /= frame_count;
+        result.frame_milliseconds /= frame_count;
+
+        // GPU results trail by the frames in flight, which are all of this
+        // configuration after warming up.
+        result.gpu_scopes = g_gpu_profiler.get_averages();
+        results.push_back(std::move(result));
+    }
+    g_device.waitIdle();
+
+    write_benchmark_json(path, results);
+    std::cout << "Wrote " << results.size() << " benchmark results to "
+              << path << ".\n";
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "gpu_profiler.hpp"
+
+// One point of the benchmark's sweeps.
+struct benchmark_config {
+    std::uint32_t instance_count;
+    std::uint32_t light_count;
+    float render_scale;
+};
+
+// What one configuration measured. Per-frame values are means over its
+// measured frames.
+struct benchmark_result {
+    benchmark_config config;
+    vk::Extent2D render_extent;
+    // Creating the scene's instances and laying out the bindless data.
+    double build_milliseconds;
+    // What the first frame uploaded, which includes the whole built scene.
+    std::size_t build_upload_bytes;
+    double upload_bytes;
+    double record_milliseconds;
+    double frame_milliseconds;
+    std::vector<gpu_scope_average> gpu_scopes;
+};
+
+// Sweep instance counts, then light counts, then render scales, each from a
+// baseline configuration.
+[[nodiscard]]
+auto get_benchmark_configs() -> std::vector<benchmark_config>;
+
+// Replace `g_scene` and `g_lights` with a generated scene of cubes over a
+// checkerboard plane. The device must be idle.
+void build_benchmark_scene(benchmark_config const& config);
+
+// Render every configuration headlessly along the same camera path, and write
+// what each measured to `path` as JSON. The meshes must already be pushed.
+void run_benchmark(std::filesystem::path const& path);
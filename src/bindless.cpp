@@ -1,8 +1,77 @@
 #include "bindless.hpp"
 
-#include <vulkan/vulkan.hpp>
+#include <glm/gtc/matrix_access.hpp>
 
-#include "light.hpp"
+#include <array>
+
+#include "arena.hpp"
+#include "cpu_profiler.hpp"
+#include "jobs.hpp"
+#include "scene.hpp"
+
+#ifndef gpu_light_culling
+namespace {
+using frustum_planes = std::array<glm::vec4, 5>;
+
+// The side and far planes of the frustum of `view_proj`, which are not
+// normalized. The side planes meet at the eye, so nothing behind it is inside
+// them without a near plane. This matches `light_culling_main` in
+// `shaders.slang`.
+auto get_frustum_planes(glm::mat4x4 const& view_proj) -> frustum_planes {
+    glm::vec4 const x = glm::row(view_proj, 0);
+    glm::vec4 const y = glm::row(view_proj, 1);
+    glm::vec4 const z = glm::row(view_proj, 2);
+    glm::vec4 const w = glm::row(view_proj, 3);
+    return {w + x, w - x, w + y, w - y, w - z};
+}
+
+auto is_sphere_inside(frustum_planes const& planes, glm::vec3 center,
+                      float radius) -> bool {
+    return std::ranges::all_of(planes, [&](glm::vec4 const& plane) {
+        glm::vec3 const normal(plane);
+        return glm::dot(normal, center) + plane.w >=
+               -radius * glm::length(normal);
+    });
+}
+}  // namespace
+#endif
+
+void mesh::build_lods() {
+    std::size_t previous_count = m_indices.size();
+
+    while (m_lods.size() < lod_max_count &&
+           previous_count >= lod_min_index_count) {
+        // Every level is simplified from the full mesh, so that its error is
+        // measured against the original surface.
+        auto const target = static_cast<std::size_t>(
+            static_cast<float>(previous_count) * lod_reduction);
+        simplified_indices lod = simplify(m_vertices, m_indices, target);
+
+        if (static_cast<float>(lod.indices.size()) >
+            static_cast<float>(previous_count) * lod_min_reduction) {
+            break;
+        }
+
+        auto const first_index =
+            static_cast<std::uint32_t>(m_indices.size() + m_lod_indices.size());
+        meshlets_t const lod_meshlets = make_meshlets(m_vertices, lod.indices);
+
+        m_lods.push_back({
+            .first_index = first_index,
+            .index_count = static_cast<std::uint32_t>(lod.indices.size()),
+            .first_meshlet =
+                static_cast<std::uint32_t>(m_meshlets.meshlets.size()),
+            .meshlet_count =
+                static_cast<std::uint32_t>(lod_meshlets.meshlets.size()),
+            // Errors should not decrease along the chain.
+            .error = std::max(lod.error, m_lods.back().error),
+        });
+        append_meshlets(m_meshlets, lod_meshlets, first_index);
+        m_lod_indices.insert(m_lod_indices.end(), lod.indices.begin(),
+                             lod.indices.end());
+        previous_count = lod.indices.size();
+    }
+}
 
 void buffer_storage::reset() {
     // `m_data`'s size member must be reset, but this does not reallocate.
@@ -11,6 +80,16 @@ void buffer_storage::reset() {
     m_instance_properties.clear();
     m_counts.clear();
     m_instance_count = 0;
+    m_has_wide_indices = false;
+    m_meshlets.clear();
+    m_meshlet_vertices.clear();
+    m_meshlet_triangles.clear();
+    m_max_meshlet_count = 0;
+    m_culled_commands_capacity = 0;
+    m_lights_capacity = 0;
+    m_lods.clear();
+    clear_dirty();
+    m_is_all_dirty = true;
 
     // Zero out the prologue data, which is safe and well-defined because
     // `member_type` and `std::byte` are trivial integers.
@@ -19,34 +98,80 @@ void buffer_storage::reset() {
 }
 
 void buffer_storage::push_mesh(mesh const& mesh) {
+    float const dequantization_scale =
+#ifdef compact_vertices
+        mesh.get_dequantization_scale();
+#else
+        1.f;
+#endif
+
     // Remember the offsets for this mesh.
     m_counts.emplace_back(
         // Vertex offset:
         get_vertex_count(),
         // Index offset:
-        m_indices.size());
+        m_indices.size(),
+        // Index count:
+        mesh.m_indices.size(), dequantization_scale,
+        // LODs:
+        m_lods.size(), mesh.m_lods.size());
 
-    // This assumes the vector pointer is properly aligned, which is ensured
-    // by `buffer_storage`'s constructor.
-    std::byte* p_destination = m_data.data() + m_data.size();
+    // Rebase this mesh's LODs and meshlets onto the whole buffer.
+    for (mesh_lod lod : mesh.m_lods) {
+        lod.first_index += static_cast<std::uint32_t>(m_indices.size());
+        lod.first_meshlet += static_cast<std::uint32_t>(m_meshlets.size());
+        m_lods.push_back(lod);
+    }
+    for (meshlet cluster : mesh.m_meshlets.meshlets) {
+        cluster.first_index += static_cast<std::uint32_t>(m_indices.size());
+        cluster.first_vertex +=
+            static_cast<std::uint32_t>(m_meshlet_vertices.size());
+        m_meshlets.push_back(cluster);
+    }
+    for (std::uint32_t index : mesh.m_meshlets.vertices) {
+        m_meshlet_vertices.push_back(get_vertex_count() + index);
+    }
+    m_meshlet_triangles.insert(m_meshlet_triangles.end(),
+                               mesh.m_meshlets.triangles.begin(),
+                               mesh.m_meshlets.triangles.end());
+    // The full-detail LOD has the most meshlets.
+    m_max_meshlet_count =
+        std::max(m_max_meshlet_count, mesh.m_lods.front().meshlet_count);
+
+    if (mesh.m_vertices.size() >= short_index_vertex_limit) {
+        m_has_wide_indices = true;
+    }
 
     // This assumes that no indices have been pushed yet. That means
     // `push_mesh` can only be called in a sequence following the
     // `buffer_storage` constructor or `.reset()`.
     assert(get_index_count() == 0);
 
-    // Reserve storage in `m_data` for `mesh`.
-    m_data.resize(m_data.size() + (mesh.m_vertices.size() * sizeof(vertex)));
+    // Reserve storage in `m_data` for `mesh`. This assumes the vector pointer
+    // is properly aligned, which is ensured by `buffer_storage`'s constructor.
+    std::byte* p_destination =
+        append(mesh.m_vertices.size() * sizeof(gpu_vertex));
 
+#ifdef compact_vertices
+    // Quantize the mesh into `m_data`.
+    for (auto&& vert : mesh.m_vertices) {
+        packed_vertex const packed = pack_vertex(vert, dequantization_scale);
+        std::memcpy(p_destination, &packed, sizeof(packed));
+        p_destination += sizeof(packed);
+    }
+#else
     // Bit-copy the mesh into `m_data`.
     std::memcpy(p_destination, mesh.m_vertices.data(),
                 mesh.m_vertices.size() * sizeof(vertex));
+#endif
     add_vertex_count(static_cast<member_type>(mesh.m_vertices.size()));
 
-    // Copy the mesh's indices into `m_indices` to be concatenated onto
-    // `m_data` in the future with `.push_indices()`.
+    // Copy the mesh's indices and its LOD chain into `m_indices` to be
+    // concatenated onto `m_data` in the future with `.push_indices()`.
     m_indices.insert(m_indices.end(), mesh.m_indices.begin(),
                      mesh.m_indices.end());
+    m_indices.insert(m_indices.end(), mesh.m_lod_indices.begin(),
+                     mesh.m_lod_indices.end());
 }
 
 void buffer_storage::push_indices() {
@@ -56,23 +181,95 @@ void buffer_storage::push_indices() {
     set_index_count(static_cast<member_type>(m_indices.size()));
     set_index_offset(static_cast<member_type>(m_data.size()));
 
-    // Bit-copy the indices into `m_data`.
-    std::byte* p_destination = m_data.data() + m_data.size();
+    // Indices are relative to each mesh's vertex offset, so they can be
+    // narrowed to 16 bits unless some mesh is too large for that.
+    if (m_has_wide_indices) {
+        set_index_stride(sizeof(index_type));
+
+        // Reserve storage in `m_data` for indices.
+        std::byte* p_destination =
+            append(m_indices.size() * sizeof(index_type));
+
+        // Bit-copy the indices into `m_data`.
+        std::memcpy(p_destination, m_indices.data(),
+                    m_indices.size() * sizeof(index_type));
+    } else {
+        set_index_stride(sizeof(std::uint16_t));
 
-    // Reserve storage in `m_data` for indices.
-    m_data.resize(m_data.size() + (m_indices.size() * sizeof(index_type)));
+        // Reserve storage in `m_data` for indices.
+        std::byte* p_destination =
+            append(m_indices.size() * sizeof(std::uint16_t));
 
-    std::memcpy(p_destination, m_indices.data(),
-                m_indices.size() * sizeof(index_type));
+        // Narrow the indices into `m_data`.
+        for (index_type index : m_indices) {
+            auto const short_index = static_cast<std::uint16_t>(index);
+            std::memcpy(p_destination, &short_index, sizeof(short_index));
+            p_destination += sizeof(short_index);
+        }
+    }
+
+    // Mesh records and indirect commands must be 4-byte aligned, which 16-bit
+    // indices might not be.
+    m_data.resize(align_up(m_data.size(), alignof(mesh_record)));
+
+    // Place mesh records immediately after indices.
+    set_meshes_count(static_cast<member_type>(m_counts.size()));
+    set_meshes_offset(static_cast<member_type>(m_data.size()));
+    std::memcpy(append(m_counts.size() * sizeof(mesh_record)), m_counts.data(),
+                m_counts.size() * sizeof(mesh_record));
+
+    // Place LODs after mesh records.
+    set_lods_offset(static_cast<member_type>(m_data.size()));
+    std::memcpy(append(m_lods.size() * sizeof(mesh_lod)), m_lods.data(),
+                m_lods.size() * sizeof(mesh_lod));
+
+    // Place meshlets and their vertex and triangle lists after LODs.
+    set_meshlets_offset(static_cast<member_type>(m_data.size()));
+    std::memcpy(append(m_meshlets.size() * sizeof(meshlet)), m_meshlets.data(),
+                m_meshlets.size() * sizeof(meshlet));
 
-    // Place instance immediately after indices.
+    set_meshlet_vertices_offset(static_cast<member_type>(m_data.size()));
+    std::memcpy(append(m_meshlet_vertices.size() * sizeof(std::uint32_t)),
+                m_meshlet_vertices.data(),
+                m_meshlet_vertices.size() * sizeof(std::uint32_t));
+
+    set_meshlet_triangles_offset(static_cast<member_type>(m_data.size()));
+    std::memcpy(append(m_meshlet_triangles.size() * sizeof(std::uint32_t)),
+                m_meshlet_triangles.data(),
+                m_meshlet_triangles.size() * sizeof(std::uint32_t));
+
+    // Place instance immediately after meshlets.
     set_instance_commands_offset(static_cast<member_type>(m_data.size()));
 }
 
+auto buffer_storage::select_lod(mesh_record const& mesh,
+                                mesh_instance const& instance) const
+    -> unsigned {
+    float const distance =
+        glm::distance(instance.position, get_camera_position());
+    float const scale = std::max(
+        {instance.scaling.x, instance.scaling.y, instance.scaling.z});
+
+    // Instances which the camera is inside of are always drawn in full.
+    if (distance <= 0.f) {
+        return 0;
+    }
+    float const pixels_per_unit = get_lod_pixels_per_unit() * scale / distance;
+
+    unsigned selected = 0;
+    for (unsigned lod = 1; lod < mesh.lod_count; ++lod) {
+        if (m_lods[mesh.first_lod + lod].error * pixels_per_unit >
+            lod_error_threshold) {
+            break;
+        }
+        selected = lod;
+    }
+    return selected;
+}
+
 void buffer_storage::push_instances_of(
     std::size_t mesh_index, std::span<mesh_instance const> const instances) {
-    increment_instance_command_count();
-    std::byte* p_destination = m_data.data() + m_data.size();
+    mesh_record const& mesh = m_counts[mesh_index];
 
     unsigned instance_index_count = instances.front().index_count;
     int instance_index_offset = instances.front().index_offset;
@@ -86,65 +283,420 @@ void buffer_storage::push_instances_of(
         // assert(i.id == instance_first_id);
     }
 
-    vk::DrawIndexedIndirectCommand command{};
-    command
-        // Instances:
-        .setFirstInstance(m_instance_count)
-        .setInstanceCount(static_cast<unsigned>(instances.size()))
-        // Vertices:
-        .setVertexOffset(m_counts[mesh_index].vertex_offset)
-        // Indices:
-        .setFirstIndex(static_cast<unsigned>(m_counts[mesh_index].index_offset +
-                                             instance_index_offset))
-        .setIndexCount(instance_index_count);
-    m_instance_count += instances.size();
-
-    // Reserve storage in `m_data` for these instances.
-    m_data.resize(m_data.size() + sizeof(command));
-    std::memcpy(p_destination, &command, sizeof(command));
+    // Only instances of an entire mesh can be drawn with simplified LODs.
+    bool const is_whole_mesh =
+        instance_index_offset == 0 && instance_index_count == mesh.index_count;
+
+    std::size_t const chunk_count =
+        job_system::get_chunk_count(instances.size(), instance_grain);
+    // Each chunk counts its instances of every LOD, then how many instances
+    // need a generated ID in the last column.
+    std::size_t const columns = mesh.lod_count + 1uz;
+    // These are only needed until the properties are written.
+    std::pmr::vector<unsigned> lod_selection(instances.size(),
+                                             &get_frame_arena());
+    std::pmr::vector<unsigned> chunk_offsets(chunk_count * columns, 0,
+                                             &get_frame_arena());
+
+    g_jobs.parallel_for(
+        instances.size(), instance_grain,
+        [&](std::size_t begin, std::size_t end) {
+            unsigned* p_counts =
+                chunk_offsets.data() + ((begin / instance_grain) * columns);
+            for (std::size_t j = begin; j < end; ++j) {
+                unsigned const lod =
+                    is_whole_mesh ? select_lod(mesh, instances[j]) : 0;
+                lod_selection[j] = lod;
+                ++p_counts[lod];
+                if (instances[j].id == 0) {
+                    ++p_counts[mesh.lod_count];
+                }
+            }
+        });
+
+    // Turn the counts into each chunk's first instance of every LOD, so that
+    // chunks can write their properties without synchronizing.
+    unsigned next_id = g_next_instance_id + 1;
+    for (std::size_t lod = 0; lod < columns; ++lod) {
+        unsigned const first_instance = (lod == mesh.lod_count)
+                                            ? next_id
+                                            : m_instance_count;
+        unsigned total = 0;
+        for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+            unsigned& offset = chunk_offsets[(chunk * columns) + lod];
+            unsigned const count = offset;
+            offset = first_instance + total;
+            total += count;
+        }
+
+        if (lod == mesh.lod_count) {
+            g_next_instance_id += total;
+            break;
+        }
+        if (total == 0) {
+            continue;
+        }
+
+        // Push one command for each LOD that any of these instances use.
+        mesh_lod const& level = m_lods[mesh.first_lod + lod];
+
+        increment_instance_command_count();
+
+        draw_indexed_command const command = {
+            // Indices:
+            .index_count =
+                is_whole_mesh ? level.index_count : instance_index_count,
+            // Instances:
+            .instance_count = total,
+            .first_index = is_whole_mesh
+                               ? level.first_index
+                               : static_cast<unsigned>(mesh.index_offset +
+                                                       instance_index_offset),
+            // Vertices:
+            .vertex_offset = mesh.vertex_offset,
+            .first_instance = m_instance_count,
+        };
+        m_instance_count += total;
+
+        // Reserve storage in `m_data` for these instances.
+        std::memcpy(append(sizeof(command)), &command, sizeof(command));
+    }
 
     // Copy the instance's properties into `m_instance_properties` to be
     // concatenated onto `m_data` in the future with `.push_properties()`.
-    for (auto&& i : instances) {
-        // Generate a new instance ID if one is not specified.
-        if (i.id == 0) {
-            ++g_next_instance_id;
+    m_instance_properties.resize(m_instance_count);
+    g_jobs.parallel_for(
+        instances.size(), instance_grain,
+        [&](std::size_t begin, std::size_t end) {
+            unsigned* p_offsets =
+                chunk_offsets.data() + ((begin / instance_grain) * columns);
+            for (std::size_t j = begin; j < end; ++j) {
+                mesh_instance const& i = instances[j];
+
+                // Generate a new instance ID if one is not specified.
+                unsigned const id =
+                    (i.id == 0) ? p_offsets[mesh.lod_count]++ : i.id;
+                m_instance_properties[p_offsets[lod_selection[j]]++] =
+                    make_property(mesh_index, i, id);
+            }
+        });
+
+    // The culling shader selects LODs by itself, so it must have room for
+    // the meshlets of every instance's full-detail LOD.
+    m_culled_commands_capacity += static_cast<unsigned>(instances.size()) *
+                                  m_lods[mesh.first_lod].meshlet_count;
+}
+
+auto buffer_storage::make_property(std::size_t mesh_index,
+                                   mesh_instance const& instance,
+                                   unsigned id) const -> property {
+    // Fold the mesh's dequantization into the instance's scaling, so that
+    // vertex shaders do not have to look it up.
+    return {
+        .position = instance.position,
+        .rotation = pack_rotation(instance.rotation),
+        .scaling = instance.scaling * m_counts[mesh_index].dequantization_scale,
+        .color_blend = pack_color_blend(instance.color_blend),
+        .id = id,
+        .mesh_index = static_cast<std::uint32_t>(mesh_index),
+        .texture_index = instance.texture_index,
+    };
+}
+
+void buffer_storage::write_property(std::size_t index) {
+    property const& instance = m_instance_properties[index];
+
+#ifdef soa_instances
+    auto const write = [&](std::size_t member_offset,
+                           std::size_t member_size) {
+        std::size_t const offset =
+            get_property_member_offset(member_offset) + (index * member_size);
+        std::memcpy(m_data.data() + offset,
+                    reinterpret_cast<std::byte const*>(&instance) +
+                        member_offset,
+                    member_size);
+        mark_dirty(offset, member_size);
+    };
+    write(offsetof(property, position), sizeof(property::position));
+    write(offsetof(property, rotation), sizeof(property::rotation));
+    write(offsetof(property, scaling), sizeof(property::scaling));
+    write(offsetof(property, color_blend), sizeof(property::color_blend));
+    write(offsetof(property, id), sizeof(property::id));
+    write(offsetof(property, mesh_index), sizeof(property::mesh_index));
+    write(offsetof(property, texture_index), sizeof(property::texture_index));
+#else
+    std::size_t const offset =
+        get_properties_offset() + (index * sizeof(property));
+    std::memcpy(m_data.data() + offset, &instance, sizeof(property));
+    mark_dirty(offset, sizeof(property));
+#endif
+}
+
+void buffer_storage::clear_dirty() {
+    // Ranges are marked while a frame is built, and uploaded by the next frame
+    // at the latest, while this arena is only reset `max_frames_in_flight`
+    // frames later.
+    m_dirty_ranges.emplace(&get_frame_arena());
+    m_is_all_dirty = false;
+}
+
+void buffer_storage::push_scene(scene& world,
+                                renderer_inputs const& inputs) {
+    cpu_zone("push_scene");
+
+    // The camera is in the header, so that changes every frame.
+    mark_dirty(0, vertices_offset);
+
+    // Adding mesh textures or light maps also moves everything after the
+    // lights.
+    if (!world.is_structure_dirty() &&
+        get_textures_count() == inputs.texture_first_mips.size() &&
+        m_lights_capacity == inputs.lights_capacity) {
+        push_visible_lights(inputs.visible_lights);
+        // Only patch the instances which changed.
+        for (std::uint32_t slot : world.get_dirty_slots()) {
+            m_instance_properties[slot] =
+                make_property(world.get_slot_mesh(slot),
+                              world.get_instances()[slot],
+                              world.get_instances()[slot].id);
+            write_property(slot);
+        }
+#ifndef gpu_light_culling
+        push_light_commands(world, inputs.visible_lights);
+#endif
+        world.clear_dirty();
+        return;
+    }
+
+    // Instances were created or destroyed, so everything following the
+    // geometry is laid out again.
+    std::size_t const commands_offset = get_instance_commands_offset();
+    m_data.resize(commands_offset);
+    set_instance_commands_count(0);
+    m_instance_properties.clear();
+    m_instance_count = 0;
+    m_culled_commands_capacity = 0;
+
+    for (std::size_t mesh_index = 0; mesh_index < world.get_meshes_count();
+         ++mesh_index) {
+        std::uint32_t const begin = world.get_mesh_begin(mesh_index);
+        std::uint32_t const end = world.get_mesh_end(mesh_index);
+        if (begin == end) {
+            continue;
         }
-        unsigned id = (i.id == 0) ? g_next_instance_id : i.id;
-        m_instance_properties.emplace_back(i.position, i.rotation, i.scaling,
-                                           i.color_blend, id);
+        mesh_record const& mesh = m_counts[mesh_index];
+        mesh_lod const& level = m_lods[mesh.first_lod];
+
+        // Each mesh's slots are contiguous, so they are drawn by one command.
+        increment_instance_command_count();
+
+        draw_indexed_command const command = {
+            // Indices:
+            .index_count = level.index_count,
+            // Instances:
+            .instance_count = end - begin,
+            .first_index = level.first_index,
+            // Vertices:
+            .vertex_offset = mesh.vertex_offset,
+            .first_instance = begin,
+        };
+
+        std::memcpy(append(sizeof(command)), &command, sizeof(command));
+
+        m_instance_count = end;
+        m_culled_commands_capacity += (end - begin) * level.meshlet_count;
     }
+
+    m_instance_properties.resize(m_instance_count);
+    g_jobs.parallel_for(
+        m_instance_count, instance_grain,
+        [&](std::size_t begin, std::size_t end) {
+            std::size_t mesh_index =
+                world.get_slot_mesh(static_cast<std::uint32_t>(begin));
+            for (std::size_t slot = begin; slot < end; ++slot) {
+                while (slot >= world.get_mesh_end(mesh_index)) {
+                    ++mesh_index;
+                }
+                mesh_instance const& instance = world.get_instances()[slot];
+                m_instance_properties[slot] =
+                    make_property(mesh_index, instance, instance.id);
+            }
+        });
+
+    push_properties(inputs);
+#ifndef gpu_light_culling
+    push_light_commands(world, inputs.visible_lights);
+#endif
+    // Light commands are only uploaded where `push_light_commands()` marked
+    // them, and the light culling shader writes them otherwise.
+    mark_dirty(commands_offset,
+               get_light_commands_counts_offset() - commands_offset);
+    world.clear_dirty();
+}
+
+auto buffer_storage::get_commands_offset_of_light(std::size_t light) const
+    -> std::size_t {
+    return get_light_commands_offset() +
+           (light * get_culled_commands_capacity() *
+            sizeof(draw_indexed_command));
 }
 
-void buffer_storage::push_properties() {
-    std::byte* p_destination = m_data.data() + m_data.size();
+void buffer_storage::push_visible_lights(
+    std::span<light_record const> visible) {
+    assert(visible.size() <= m_lights_capacity);
+    set_lights_count(static_cast<member_type>(visible.size()));
+    std::memcpy(m_data.data() + get_lights_offset(), visible.data(),
+                visible.size_bytes());
+    mark_dirty(get_lights_offset(), visible.size_bytes());
+}
+
+#ifndef gpu_light_culling
+void buffer_storage::push_light_commands(
+    scene const& world, std::span<light_record const> visible) {
+    cpu_zone("push_light_commands");
+    std::span<mesh_instance const> const instances = world.get_instances();
+
+    // Each light's draws are written by one job. Shadows are drawn from each
+    // mesh's full-detail LOD, which the culled commands have room for.
+    g_jobs.parallel_for(
+        visible.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t light = begin; light < end; ++light) {
+                frustum_planes const planes = get_frustum_planes(
+                    visible[light].projection * visible[light].transform);
+                std::byte* p_command =
+                    m_data.data() + get_commands_offset_of_light(light);
+                member_type count = 0;
 
-    // TODO: Align this without looping.
-    // This must be aligned, because it stores matrices.
-    while (!is_aligned(p_destination, alignof(property))) {
-        m_data.resize(m_data.size() + 4);
-        p_destination += 4;
+                for (std::size_t mesh_index = 0;
+                     mesh_index < world.get_meshes_count(); ++mesh_index) {
+                    mesh_record const& mesh = m_counts[mesh_index];
+                    mesh_lod const& level = m_lods[mesh.first_lod];
+                    for (std::uint32_t slot = world.get_mesh_begin(mesh_index);
+                         slot < world.get_mesh_end(mesh_index); ++slot) {
+                        mesh_instance const& instance = instances[slot];
+                        float const radius_scale =
+                            std::max({instance.scaling.x, instance.scaling.y,
+                                      instance.scaling.z});
+                        for (std::uint32_t i = 0; i < level.meshlet_count;
+                             ++i) {
+                            meshlet const& cluster =
+                                m_meshlets[level.first_meshlet + i];
+                            glm::vec3 center =
+                                cluster.center * instance.scaling;
+                            if (instance.rotation.w != 0.f) {
+                                center = instance.rotation * center;
+                            }
+                            center += instance.position;
+                            if (!is_sphere_inside(
+                                    planes, center,
+                                    cluster.radius * radius_scale)) {
+                                continue;
+                            }
+
+                            draw_indexed_command const command = {
+                                .index_count = cluster.index_count,
+                                .instance_count = 1,
+                                .first_index = cluster.first_index,
+                                .vertex_offset = mesh.vertex_offset,
+                                .first_instance = slot,
+                            };
+                            std::memcpy(p_command, &command, sizeof(command));
+                            p_command += sizeof(command);
+                            ++count;
+                        }
+                    }
+                }
+                set_at(count, get_commands_count_offset_of_light(light));
+            }
+        });
+
+    mark_dirty(get_light_commands_counts_offset(),
+               visible.size() * sizeof(member_type));
+    for (std::size_t light = 0; light < visible.size(); ++light) {
+        member_type const count =
+            get_at<member_type>(get_commands_count_offset_of_light(light));
+        if (count > 0) {
+            mark_dirty(get_commands_offset_of_light(light),
+                       count * sizeof(draw_indexed_command));
+        }
     }
+}
+#endif
+
+void buffer_storage::push_properties(renderer_inputs const& inputs) {
+    cpu_zone("push_properties");
+
+    // This must be aligned, because it stores vectors.
+    m_data.resize(align_up(m_data.size(), alignof(property)));
 
     set_properties_offset(static_cast<member_type>(m_data.size()));
+    set_instances_count(m_instance_count);
 
     // Reserve storage in `m_data` for command properties.
-    assert(m_data.size() + (m_instance_properties.size() * sizeof(property)) <
-           m_data.capacity());
-    m_data.resize(m_data.size() +
-                  (m_instance_properties.size() * sizeof(property)));
+    [[maybe_unused]] std::byte* p_destination =
+        append(m_instance_properties.size() * sizeof(property));
 
+#ifdef soa_instances
+    // Scatter each member of the properties into its own array.
+    auto const scatter = [&](std::size_t member_offset,
+                             std::size_t member_size) {
+        std::byte* p_member =
+            m_data.data() + get_property_member_offset(member_offset);
+        for (property const& instance : m_instance_properties) {
+            std::memcpy(p_member,
+                        reinterpret_cast<std::byte const*>(&instance) +
+                            member_offset,
+                        member_size);
+            p_member += member_size;
+        }
+    };
+    scatter(offsetof(property, position), sizeof(property::position));
+    scatter(offsetof(property, rotation), sizeof(property::rotation));
+    scatter(offsetof(property, scaling), sizeof(property::scaling));
+    scatter(offsetof(property, color_blend), sizeof(property::color_blend));
+    scatter(offsetof(property, id), sizeof(property::id));
+    scatter(offsetof(property, mesh_index), sizeof(property::mesh_index));
+    scatter(offsetof(property, texture_index),
+            sizeof(property::texture_index));
+#else
     // Bit-copy the properties into `m_data`.
     std::memcpy(p_destination, m_instance_properties.data(),
                 m_instance_properties.size() * sizeof(property));
+#endif
 
-    // Push light sources.
-    set_lights_count(g_lights.size());
+    // Reserve storage in `m_data` for as many lights as can be visible, so
+    // that any of them can become visible without laying out everything after
+    // them again.
+    m_lights_capacity = inputs.lights_capacity;
     set_lights_offset(static_cast<member_type>(m_data.size()));
-    p_destination = m_data.data() + m_data.size();
-    // Reserve storage in `m_data` for command properties.
-    m_data.resize(m_data.size() + (g_lights.size() * sizeof(light_t::light)));
-    // Bit-copy the lights into `m_data`.
-    std::memcpy(p_destination, g_lights.lights.data(),
-                g_lights.size() * sizeof(light_t::light));
+    (void)append(m_lights_capacity * sizeof(light_record));
+    push_visible_lights(inputs.visible_lights);
+
+    // Push the first resident mip level of each mesh texture, followed by a
+    // feedback entry for each, which is cleared on the GPU every frame.
+    std::span<std::uint32_t const> const first_mips =
+        inputs.texture_first_mips;
+    auto const textures_count = static_cast<member_type>(first_mips.size());
+    set_textures_count(textures_count);
+    set_textures_offset(static_cast<member_type>(m_data.size()));
+    auto* const p_first_mips = reinterpret_cast<member_type*>(
+        append(textures_count * sizeof(member_type)));
+    std::ranges::copy(first_mips, p_first_mips);
+    set_texture_feedback_offset(static_cast<member_type>(m_data.size()));
+    m_data.resize(m_data.size() + (textures_count * sizeof(member_type)));
+
+    // Reserve storage for the culling shader to write meshlet draws into.
+    set_culled_commands_offset(static_cast<member_type>(m_data.size()));
+    set_culled_commands_capacity(m_culled_commands_capacity);
+    m_data.resize(m_data.size() + (m_culled_commands_capacity *
+                                   sizeof(draw_indexed_command)));
+
+    // Reserve storage for each visible light's culled shadow caster draws, and
+    // their counts.
+    set_light_commands_counts_offset(static_cast<member_type>(m_data.size()));
+    m_data.resize(m_data.size() + (m_lights_capacity * sizeof(member_type)));
+    set_light_commands_offset(static_cast<member_type>(m_data.size()));
+    m_data.resize(m_data.size() + (m_lights_capacity *
+                                   m_culled_commands_capacity *
+                                   sizeof(draw_indexed_command)));
 }
@@ -1,15 +1,29 @@
 #pragma once
 
+#include <glm/gtc/packing.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/mat4x4.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <numbers>
+#include <optional>
 #include <span>
 #include <vector>
 
 #include "defer.hpp"
 #include "glm/fwd.hpp"
+#include "instance_layout.hpp"
+#include "meshlet.hpp"
+#include "simplify.hpp"
+
+class scene;
 
 struct vertex {
     constexpr vertex() = default;
@@ -22,8 +36,84 @@ struct vertex {
     alignas(16) glm::vec3 normal;
 };
 
+// Compact vertex layout for the bindless buffer. Positions are stored in 16-bit
+// fixed point relative to their mesh's `dequantization_scale`, and unit normals
+// are octahedral-encoded into two 16-bit components.
+struct packed_vertex {
+    glm::i16vec4 position;
+    glm::i16vec2 normal;
+};
+
+static_assert(sizeof(packed_vertex) == 12);
+
+// `compact_vertices` is defined in `../CMakeLists.txt`
+#ifdef compact_vertices
+using gpu_vertex = packed_vertex;
+#else
+using gpu_vertex = vertex;
+#endif
+
+// Map a unit vector onto the octahedron, then fold its lower half onto the
+// upper half, so that it fits in a `[-1, 1]` square.
+inline auto encode_octahedral(glm::vec3 normal) -> glm::vec2 {
+    float const l1_norm =
+        std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (l1_norm == 0.f) {
+        return {0, 0};
+    }
+    normal /= l1_norm;
+
+    glm::vec2 encoded = {normal.x, normal.y};
+    if (normal.z < 0.f) {
+        glm::vec2 const sign = {encoded.x >= 0.f ? 1.f : -1.f,
+                                encoded.y >= 0.f ? 1.f : -1.f};
+        encoded = (1.f - glm::abs(glm::vec2{encoded.y, encoded.x})) * sign;
+    }
+    return encoded;
+}
+
+// `dequantization_scale` must be at least the largest absolute coordinate of
+// the mesh containing `vert`.
+inline auto pack_vertex(vertex const& vert, float dequantization_scale)
+    -> packed_vertex {
+    glm::vec4 const position = {
+        glm::vec3(vert.position) / dequantization_scale, 1.f};
+    return {
+        .position = glm::packSnorm<std::int16_t>(position),
+        .normal = glm::packSnorm<std::int16_t>(encode_octahedral(vert.normal)),
+    };
+}
+
+// 16-bit indices are used when every mesh has fewer vertices than this.
+inline constexpr std::size_t short_index_vertex_limit = 65'536;
+
 using index_type = unsigned int;
 
+// This matches `mesh_lod` in `shaders.slang`:
+struct mesh_lod {
+    // These are relative to the mesh's first index and meshlet in `mesh`, and
+    // relative to the whole buffer in `buffer_storage`.
+    std::uint32_t first_index;
+    std::uint32_t index_count;
+    std::uint32_t first_meshlet;
+    std::uint32_t meshlet_count;
+
+    // How far this level's surface may be from the full mesh, in model space.
+    float error;
+};
+
+// Each LOD targets this fraction of the previous level's indices, and the
+// chain ends when simplification stops paying off or the mesh gets too small
+// to be worth simplifying.
+inline constexpr float lod_reduction = 0.5f;
+inline constexpr float lod_min_reduction = 0.9f;
+inline constexpr std::size_t lod_min_index_count = 192;
+inline constexpr std::size_t lod_max_count = 8;
+
+// The coarsest LOD whose error projects to at most this many pixels is drawn.
+// This matches `lod_error_threshold` in `shaders.slang`.
+inline constexpr float lod_error_threshold = 1.f;
+
 struct mesh {
     constexpr mesh(std::vector<vertex>&& verts,
                    std::vector<index_type>&& inds) {
@@ -43,10 +133,43 @@ struct mesh {
             m_vertices[m_indices[i + 1]].normal = normal;
             m_vertices[m_indices[i + 2]].normal = normal;
         }
+
+        m_meshlets = make_meshlets(m_vertices, m_indices);
+        m_lods.push_back({
+            .first_index = 0,
+            .index_count = static_cast<std::uint32_t>(m_indices.size()),
+            .first_meshlet = 0,
+            .meshlet_count =
+                static_cast<std::uint32_t>(m_meshlets.meshlets.size()),
+            .error = 0.f,
+        });
+        build_lods();
+    }
+
+    // Append a chain of simplified index lists to `m_lod_indices`.
+    void build_lods();
+
+    // The smallest scale that fits every vertex position into `[-1, 1]`.
+    [[nodiscard]]
+    auto get_dequantization_scale() const -> float {
+        float scale = 0.f;
+        for (auto&& vert : m_vertices) {
+            glm::vec3 const magnitude = glm::abs(glm::vec3(vert.position));
+            scale = std::max({scale, magnitude.x, magnitude.y, magnitude.z});
+        }
+        return (scale == 0.f) ? 1.f : scale;
     }
 
     std::vector<vertex> m_vertices;
     std::vector<index_type> m_indices;
+
+    // Indices of every LOD after the first, which are stored after
+    // `m_indices`.
+    std::vector<index_type> m_lod_indices;
+    std::vector<mesh_lod> m_lods;
+
+    // Meshlets of every LOD.
+    meshlets_t m_meshlets;
 };
 
 struct mesh_instance {
@@ -57,36 +180,128 @@ struct mesh_instance {
     unsigned id = 0;
     signed int index_offset;
     index_type index_count;
+    // An index into `g_mesh_textures`.
+    std::uint32_t texture_index = no_texture_index;
+};
+
+// This matches `light` in `shaders.slang`:
+struct light_record {
+    alignas(16) glm::mat4x4 transform;
+    alignas(16) glm::mat4x4 projection;
+    alignas(16) glm::vec3 position;
+    // The slot of this light's map, which `light_t::cull()` sets.
+    std::uint32_t map_index;
 };
 
+// This matches `draw_indexed_command` in `shaders.slang`, and
+// `vk::DrawIndexedIndirectCommand`, which culled draws are read as.
+struct draw_indexed_command {
+    std::uint32_t index_count;
+    std::uint32_t instance_count;
+    std::uint32_t first_index;
+    std::int32_t vertex_offset;
+    std::uint32_t first_instance;
+};
+
+// What the renderer lays out in the bindless data besides the scene. This is
+// passed in rather than read from `g_lights` and `g_mesh_textures`, so that
+// the bindless data builds without Vulkan.
+struct renderer_inputs {
+    // The lights which culling found visible, with `map_index` set.
+    std::span<light_record const> visible_lights;
+    // How many lights can be visible at once, which the lights region has
+    // room for.
+    std::uint32_t lights_capacity = 0;
+    // The finest resident mip level of each mesh texture.
+    std::span<std::uint32_t const> texture_first_mips;
+};
+
+// Compress a rotation into 32 bits by its "smallest three" components. The
+// largest component's index is stored in the top 2 bits, and the other three
+// are stored in 10 bits each, since they must be within `[-1/√2, 1/√2]`.
+inline auto pack_rotation(glm::fquat rotation) -> std::uint32_t {
+    glm::vec4 q = {rotation.x, rotation.y, rotation.z, rotation.w};
+
+    // A zero quaternion means no rotation.
+    float const length = glm::length(q);
+    q = (length == 0.f) ? glm::vec4{0, 0, 0, 1} : q / length;
+
+    glm::length_t largest = 0;
+    for (glm::length_t i = 1; i < 4; ++i) {
+        if (std::abs(q[i]) > std::abs(q[largest])) {
+            largest = i;
+        }
+    }
+
+    // `q` and `-q` are the same rotation, so the largest component can be
+    // made positive and recovered from the others.
+    if (q[largest] < 0.f) {
+        q = -q;
+    }
+
+    std::uint32_t packed = static_cast<std::uint32_t>(largest) << 30;
+    std::uint32_t shift = 20;
+    for (glm::length_t i = 0; i < 4; ++i) {
+        if (i == largest) {
+            continue;
+        }
+        float const normalized =
+            std::clamp((q[i] * std::numbers::sqrt2_v<float> + 1.f) / 2.f, 0.f,
+                       1.f);
+        packed |= static_cast<std::uint32_t>(std::round(normalized * 1023.f))
+                  << shift;
+        shift -= 10;
+    }
+    return packed;
+}
+
+inline auto pack_color_blend(glm::vec4 color_blend) -> std::uint32_t {
+    return glm::packSnorm4x8(color_blend / color_blend_range);
+}
+
 template <typename T>
 inline auto is_aligned(T* p_data, std::uintptr_t alignment) -> bool {
     return (reinterpret_cast<std::uintptr_t>(p_data) & alignment - 1u) == 0u;
 }
 
+// `alignment` must be a power of two.
+constexpr auto align_up(std::size_t size, std::size_t alignment)
+    -> std::size_t {
+    return (size + alignment - 1u) & ~(alignment - 1u);
+}
+
 class buffer_storage {
   public:
     // This matches `buffer_storage` in `shaders.slang`:
-    static constexpr unsigned int cameras_offset = 64;
+    static constexpr unsigned int cameras_offset = 128;
     static constexpr unsigned int vertices_offset = 256;
     static_assert(vertices_offset >= cameras_offset + sizeof(glm::mat4x4) * 2);
 
     static constexpr unsigned int member_stride = 4;
     using member_type = unsigned int;
 
-    buffer_storage() : m_data(1'048'576z) {
+    // `m_data` grows beyond this when it needs to.
+    static constexpr std::size_t initial_capacity = 1'048'576;
+
+    buffer_storage() {
+        m_data.reserve(initial_capacity);
         reset();
 
         //  The vector is already zero-initialized here.
         //  Ensure that vector pointer is properly aligned for pushing vertices.
         std::byte* p_destination = m_data.data() + m_data.size();
-        assert(is_aligned(p_destination, alignof(vertex)));
+        assert(is_aligned(p_destination, alignof(gpu_vertex)));
     }
 
     auto data() -> std::byte* {
         return m_data.data();
     }
 
+    [[nodiscard]]
+    auto size() const -> std::size_t {
+        return m_data.size();
+    }
+
     [[nodiscard]]
     auto capacity() const -> std::size_t {
         return m_data.capacity();
@@ -94,6 +309,56 @@ class buffer_storage {
 
     void reset();
 
+    // A range of bytes which changed since the last upload.
+    struct dirty_range {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    void mark_dirty(std::size_t offset, std::size_t size) {
+        std::pmr::vector<dirty_range>& ranges = *m_dirty_ranges;
+        // Neighboring patches are merged into one range.
+        if (!ranges.empty() &&
+            ranges.back().offset + ranges.back().size == offset) {
+            ranges.back().size += size;
+            return;
+        }
+        ranges.push_back({offset, size});
+    }
+
+    [[nodiscard]]
+    auto get_dirty_ranges() const -> std::span<dirty_range const> {
+        return *m_dirty_ranges;
+    }
+
+    // Whether all of the data changed, such as after `.reset()`.
+    [[nodiscard]]
+    auto is_all_dirty() const -> bool {
+        return m_is_all_dirty;
+    }
+
+    void mark_all_dirty() {
+        m_is_all_dirty = true;
+    }
+
+    // Forget the ranges once they were uploaded. The next ranges are
+    // allocated from the current frame's arena.
+    void clear_dirty();
+
+    // Give the data a replayed frame's size, and restore the only member which
+    // recording reads outside of the data.
+    void restore_layout(std::size_t size, unsigned max_meshlet_count) {
+        m_data.resize(size);
+        m_max_meshlet_count = max_meshlet_count;
+    }
+
+    // Overwrite the data from `offset` with a replayed frame's bytes, which
+    // are uploaded like any other change.
+    void patch(std::size_t offset, std::span<std::byte const> bytes) {
+        std::memcpy(m_data.data() + offset, bytes.data(), bytes.size());
+        mark_dirty(offset, bytes.size());
+    }
+
     template <typename T>
     void set_at(T&& value, std::size_t byte_offset) {
         new (m_data.data() + byte_offset) std::decay_t<T>(fwd(value));
@@ -115,18 +380,23 @@ class buffer_storage {
     }
 
     [[nodiscard]]
-    auto get_vertex_data() const -> vertex const* {
-        return reinterpret_cast<vertex const*>(m_data.data() +
-                                               get_vertex_count());
+    auto get_vertex_data() const -> gpu_vertex const* {
+        return reinterpret_cast<gpu_vertex const*>(m_data.data() +
+                                                   vertices_offset);
     }
 
     [[nodiscard, gnu::noinline, gnu::used]]
-    auto get_vertex(uint index) const -> vertex {
-        return get_at<vertex>(vertices_offset + (index * sizeof(vertex)));
+    auto get_vertex(uint index) const -> gpu_vertex {
+        return get_at<gpu_vertex>(vertices_offset +
+                                  (index * sizeof(gpu_vertex)));
     }
 
     [[nodiscard]]
     auto get_index(uint index) const -> uint {
+        if (get_index_stride() == sizeof(std::uint16_t)) {
+            return get_at<std::uint16_t>(get_index_offset() +
+                                         (index * sizeof(std::uint16_t)));
+        }
         return get_at<uint>(get_index_offset() + (index * sizeof(uint)));
     }
 
@@ -227,6 +497,183 @@ class buffer_storage {
         return get_at<member_type>(member_stride * 10z);
     }
 
+    // This is the size in bytes of each index, either 2 or 4.
+    void set_index_stride(member_type stride) {
+        set_at(stride, member_stride * 11z);
+    }
+
+    [[nodiscard]]
+    auto get_index_stride() const -> member_type const& {
+        return get_at<member_type>(member_stride * 11z);
+    }
+
+    void set_meshes_count(member_type count) {
+        set_at(count, member_stride * 12z);
+    }
+
+    [[nodiscard]]
+    auto get_meshes_count() const -> member_type const& {
+        return get_at<member_type>(member_stride * 12z);
+    }
+
+    void set_meshes_offset(member_type offset) {
+        set_at(offset, member_stride * 13z);
+    }
+
+    [[nodiscard]]
+    auto get_meshes_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 13z);
+    }
+
+    void set_meshlets_offset(member_type offset) {
+        set_at(offset, member_stride * 14z);
+    }
+
+    [[nodiscard]]
+    auto get_meshlets_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 14z);
+    }
+
+    void set_meshlet_vertices_offset(member_type offset) {
+        set_at(offset, member_stride * 15z);
+    }
+
+    [[nodiscard]]
+    auto get_meshlet_vertices_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 15z);
+    }
+
+    void set_meshlet_triangles_offset(member_type offset) {
+        set_at(offset, member_stride * 16z);
+    }
+
+    [[nodiscard]]
+    auto get_meshlet_triangles_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 16z);
+    }
+
+    void set_culled_commands_offset(member_type offset) {
+        set_at(offset, member_stride * 17z);
+    }
+
+    [[nodiscard]]
+    auto get_culled_commands_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 17z);
+    }
+
+    // The culling shader atomically increments this.
+    static constexpr std::size_t culled_commands_count_offset =
+        member_stride * 18z;
+
+    [[nodiscard]]
+    auto get_culled_commands_count() const -> member_type const& {
+        return get_at<member_type>(culled_commands_count_offset);
+    }
+
+    void set_culled_commands_capacity(member_type capacity) {
+        set_at(capacity, member_stride * 19z);
+    }
+
+    [[nodiscard]]
+    auto get_culled_commands_capacity() const -> member_type const& {
+        return get_at<member_type>(member_stride * 19z);
+    }
+
+    void set_instances_count(member_type count) {
+        set_at(count, member_stride * 20z);
+    }
+
+    [[nodiscard]]
+    auto get_instances_count() const -> member_type const& {
+        return get_at<member_type>(member_stride * 20z);
+    }
+
+    void set_lods_offset(member_type offset) {
+        set_at(offset, member_stride * 21z);
+    }
+
+    [[nodiscard]]
+    auto get_lods_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 21z);
+    }
+
+    // How many pixels tall one world-space unit is, one unit in front of the
+    // camera. This is used to project LOD errors onto the screen.
+    void set_lod_pixels_per_unit(float pixels) {
+        set_at(pixels, member_stride * 22z);
+    }
+
+    [[nodiscard]]
+    auto get_lod_pixels_per_unit() const -> float const& {
+        return get_at<float>(member_stride * 22z);
+    }
+
+    void set_textures_offset(member_type offset) {
+        set_at(offset, member_stride * 23z);
+    }
+
+    [[nodiscard]]
+    auto get_textures_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 23z);
+    }
+
+    // Fragment shaders atomically lower each texture's entry here to the
+    // finest mip level they sampled from it.
+    void set_texture_feedback_offset(member_type offset) {
+        set_at(offset, member_stride * 24z);
+    }
+
+    [[nodiscard]]
+    auto get_texture_feedback_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 24z);
+    }
+
+    // Every light slot has a region of culled shadow caster draws, with room
+    // for as many as the camera's culled commands, which begin here.
+    void set_light_commands_offset(member_type offset) {
+        set_at(offset, member_stride * 25z);
+    }
+
+    [[nodiscard]]
+    auto get_light_commands_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 25z);
+    }
+
+    // Each light's count of culled shadow caster draws.
+    void set_light_commands_counts_offset(member_type offset) {
+        set_at(offset, member_stride * 26z);
+    }
+
+    [[nodiscard]]
+    auto get_light_commands_counts_offset() const -> member_type const& {
+        return get_at<member_type>(member_stride * 26z);
+    }
+
+    // Where the culled draws of the `light`th visible light begin.
+    [[nodiscard]]
+    auto get_commands_offset_of_light(std::size_t light) const -> std::size_t;
+
+    [[nodiscard]]
+    auto get_commands_count_offset_of_light(std::size_t light) const
+        -> std::size_t {
+        return get_light_commands_counts_offset() +
+               (light * sizeof(member_type));
+    }
+
+    // Record that mesh texture `index` is resident from mip level `first_mip`.
+    void set_texture_first_mip(std::size_t index, member_type first_mip) {
+        std::size_t const offset =
+            get_textures_offset() + (index * sizeof(member_type));
+        set_at(first_mip, offset);
+        mark_dirty(offset, sizeof(member_type));
+    }
+
+    // The most meshlets in any mesh that has been pushed.
+    [[nodiscard]]
+    auto get_max_meshlet_count() const -> unsigned {
+        return m_max_meshlet_count;
+    }
+
     [[nodiscard]]
     auto get_mirrors_offset() const -> member_type {
         // The first 4 textures are hard-coded into the renderer, add the number
@@ -269,17 +716,90 @@ class buffer_storage {
     void push_instances_of(std::size_t mesh_index,
                            std::span<mesh_instance const> instance);
 
-    void push_properties();
-
+    // Push instance properties, lights, mesh textures, and the culled commands
+    // regions of the camera and lights.
+    void push_properties(renderer_inputs const& inputs);
+
+    // Write `visible` into the lights region, which has room for as many
+    // lights as can be visible.
+    void push_visible_lights(std::span<light_record const> visible);
+
+#ifndef gpu_light_culling
+    // Cull the meshlets of `world` against each of `visible`'s frusta, and
+    // write the survivors as that light's draws. This is done by a compute
+    // shader instead with `GPU_LIGHT_CULLING`.
+    void push_light_commands(scene const& world,
+                             std::span<light_record const> visible);
+#endif
+
+    // Push the instances of `world` after `.push_indices()`. Unlike
+    // `.push_instances_of()`, this is called every frame without `.reset()`,
+    // and only the instances which changed are written again. Its draws use
+    // each mesh's full-detail LOD, since the camera's LODs are selected by
+    // culling on the GPU.
+    void push_scene(scene& world, renderer_inputs const& inputs);
+
+    // This matches `instance_layout.hpp`.
     struct property {
-        alignas(16) glm::vec3 position;
-        alignas(16) glm::fquat rotation;
-        alignas(16) glm::vec3 scaling;
-        alignas(16) glm::vec4 color_blend;
+        glm::vec3 position;
+        // See `pack_rotation()`.
+        std::uint32_t rotation;
+        glm::vec3 scaling;
+        // See `pack_color_blend()`.
+        std::uint32_t color_blend;
         std::uint32_t id;
+        std::uint32_t mesh_index;
+        std::uint32_t texture_index;
     };
 
+    // Offset of a member of every instance's `property`, which is strided by
+    // `sizeof(property)` for an array of structures, or by that member's size
+    // for a structure of arrays.
+    [[nodiscard]]
+    auto get_property_member_offset(std::size_t member_offset) const
+        -> std::size_t {
+#ifdef soa_instances
+        return get_properties_offset() +
+               (member_offset * get_instances_count());
+#else
+        return get_properties_offset() + member_offset;
+#endif
+    }
+
+    // This matches `mesh_record` in `shaders.slang`:
+    struct mesh_record {
+        int vertex_offset;
+        int index_offset;
+        index_type index_count;
+        float dequantization_scale;
+        unsigned first_lod;
+        unsigned lod_count;
+    };
+
+    // Choose the coarsest LOD of `mesh` whose error is not visible from the
+    // current camera.
+    [[nodiscard]]
+    auto select_lod(mesh_record const& mesh,
+                    mesh_instance const& instance) const -> unsigned;
+
   private:
+    // Grow `m_data` by `size` bytes, and return where those begin. This may
+    // reallocate, so pointers into `m_data` must not be held across it.
+    [[nodiscard]]
+    auto append(std::size_t size) -> std::byte* {
+        std::size_t const offset = m_data.size();
+        m_data.resize(offset + size);
+        return m_data.data() + offset;
+    }
+
+    [[nodiscard]]
+    auto make_property(std::size_t mesh_index, mesh_instance const& instance,
+                       unsigned id) const -> property;
+
+    // Copy one instance's properties into `m_data`, after they were laid out
+    // by `.push_properties()`.
+    void write_property(std::size_t index);
+
     void add_vertex_count(member_type count) {
         set_vertex_count(get_vertex_count() + count);
     }
@@ -295,13 +815,50 @@ class buffer_storage {
 
     unsigned m_instance_count;
 
-    struct mesh_count {
-        int vertex_offset;
-        int index_offset;
-    };
+    // Whether any mesh has too many vertices to be indexed with 16 bits.
+    bool m_has_wide_indices;
+
+    std::vector<mesh_record> m_counts;
+
+    // Meshlets of every mesh, with ranges relative to the whole buffer.
+    std::vector<meshlet> m_meshlets;
+    std::vector<std::uint32_t> m_meshlet_vertices;
+    std::vector<std::uint32_t> m_meshlet_triangles;
+    unsigned m_max_meshlet_count;
 
-    std::vector<mesh_count> m_counts;
+    // LODs of every mesh, with ranges relative to the whole buffer.
+    std::vector<mesh_lod> m_lods;
+
+    // Instances are split into chunks of this many for `g_jobs`.
+    static constexpr std::size_t instance_grain = 1'024;
+
+    // Every instance might need one draw per meshlet after culling.
+    unsigned m_culled_commands_capacity;
+
+    // How many lights the lights region has room for.
+    unsigned m_lights_capacity;
+
+    // This is only empty before the first `.clear_dirty()`, because its
+    // arena changes every frame.
+    std::optional<std::pmr::vector<dirty_range>> m_dirty_ranges;
+    bool m_is_all_dirty;
 };
 
+static_assert(offsetof(buffer_storage::property, position) ==
+              property_position_offset);
+static_assert(offsetof(buffer_storage::property, rotation) ==
+              property_rotation_offset);
+static_assert(offsetof(buffer_storage::property, scaling) ==
+              property_scaling_offset);
+static_assert(offsetof(buffer_storage::property, color_blend) ==
+              property_color_blend_offset);
+static_assert(offsetof(buffer_storage::property, id) == property_id_offset);
+static_assert(offsetof(buffer_storage::property, mesh_index) ==
+              property_mesh_index_offset);
+static_assert(offsetof(buffer_storage::property, texture_index) ==
+              property_texture_index_offset);
+// There must be no padding for the structure of arrays layout.
+static_assert(sizeof(buffer_storage::property) == property_size);
+
 // Bindless storage buffer.
 inline buffer_storage g_bindless_data;
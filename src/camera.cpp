@@ -5,6 +5,8 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/mat4x4.hpp>
 
+#include "bindless.hpp"
+
 auto camera_t::make_rotation_matrix() const -> glm::mat4x4 {
     glm::quat pitch_rotation = glm::angleAxis(pitch, glm::vec3{1.f, 0.f, 0.f});
     glm::quat yaw_rotation = glm::angleAxis(yaw, glm::vec3{0.f, -1.f, 0.f});
@@ -22,3 +24,12 @@ void camera_t::update() {
     // glm::mat4x4 camera_rotation = get_rotation_matrix();
     // position += glm::vec3(camera_rotation * glm::vec4(velocity * 0.5f, 0.f));
 }
+
+void set_camera_projection(vk::Extent2D render_extent) {
+    auto const width = static_cast<float>(render_extent.width);
+    auto const height = static_cast<float>(render_extent.height);
+    glm::mat4x4 proj = make_projection_matrix(width / height);
+    g_bindless_data.set_lod_pixels_per_unit(proj[1][1] * height / 2.f);
+    proj[1][1] *= -1.f;  // Invert Y.
+    g_bindless_data.set_proj_matrix(proj);
+}
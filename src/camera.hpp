@@ -8,11 +8,17 @@
 
 #include "globals.hpp"
 
+[[nodiscard]]
+inline auto make_projection_matrix(float aspect_ratio) -> glm::mat4x4 {
+    return glm::perspective(glm::radians(70.f), aspect_ratio, 0.001f,
+                            10'000.f);
+}
+
+// Light sources project with this. The camera instead projects with the
+// render extent's aspect ratio.
 // TODO: Make this `constexpr`.
-inline glm::mat4x4 const projection_matrix = glm::perspective(
-    glm::radians(70.f),
-    static_cast<float>(game_width) / static_cast<float>(game_height), 0.001f,
-    10'000.f);
+inline glm::mat4x4 const projection_matrix = make_projection_matrix(
+    static_cast<float>(game_width) / static_cast<float>(game_height));
 
 struct camera_t {
     // TODO: Updating position should be done elsewhere.
@@ -31,3 +37,7 @@ struct camera_t {
 };
 
 inline constinit camera_t g_camera{};
+
+// Project the camera in `g_bindless_data` onto `render_extent`, whose aspect
+// ratio changes with the swapchain's, and project LOD errors onto its height.
+void set_camera_projection(vk::Extent2D render_extent);
@@ -0,0 +1,140 @@
+#include "cpu_profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "gpu_profiler.hpp"
+
+#ifdef cpu_profiling
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace {
+// Each thread keeps this many of its most recent zones.
+constexpr std::size_t ring_capacity = 16'384;
+
+struct zone_event {
+    char const* p_name;
+    std::uint64_t begin_nanoseconds;
+    std::uint64_t end_nanoseconds;
+};
+
+struct thread_ring {
+    std::array<zone_event, ring_capacity> events;
+    // This counts every zone that the owning thread recorded.
+    std::atomic<std::size_t> written_count = 0;
+};
+
+// Rings are kept after their threads exit, so that their zones are still
+// written. Only registering a thread locks this.
+std::mutex g_rings_mutex;
+std::vector<std::unique_ptr<thread_ring>> g_rings;
+
+auto get_thread_ring() -> thread_ring& {
+    thread_local thread_ring* p_ring = nullptr;
+    if (p_ring == nullptr) {
+        std::lock_guard const lock(g_rings_mutex);
+        p_ring = g_rings.emplace_back(std::make_unique<thread_ring>()).get();
+    }
+    return *p_ring;
+}
+}  // namespace
+
+detail::cpu_zone_scope::~cpu_zone_scope() {
+    thread_ring& ring = get_thread_ring();
+    std::size_t const count =
+        ring.written_count.load(std::memory_order_relaxed);
+    ring.events[count % ring_capacity] = {
+        .p_name = m_p_name,
+        .begin_nanoseconds = m_begin,
+        .end_nanoseconds = get_profiler_time(),
+    };
+    ring.written_count.store(count + 1, std::memory_order_release);
+}
+
+#endif
+
+void write_chrome_trace(std::filesystem::path const& path) {
+    std::vector<gpu_trace_event> const gpu_trace = g_gpu_profiler.get_trace();
+
+    // Times are written relative to the earliest event, to keep them short.
+    std::uint64_t origin = std::numeric_limits<std::uint64_t>::max();
+    for (gpu_trace_event const& event : gpu_trace) {
+        origin = std::min(origin, event.begin_nanoseconds);
+    }
+#ifdef cpu_profiling
+    std::lock_guard const lock(g_rings_mutex);
+    auto const get_ring_events = [](thread_ring const& ring) {
+        std::size_t const count =
+            ring.written_count.load(std::memory_order_acquire);
+        return std::span(ring.events).first(std::min(count, ring_capacity));
+    };
+    for (auto const& p_ring : g_rings) {
+        for (zone_event const& event : get_ring_events(*p_ring)) {
+            origin = std::min(origin, event.begin_nanoseconds);
+        }
+    }
+#endif
+    auto const to_microseconds = [&](std::uint64_t nanoseconds) {
+        return static_cast<double>(nanoseconds - origin) / 1e3;
+    };
+
+    std::ofstream stream(path);
+    stream << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool is_first = true;
+    auto const begin_event = [&](std::string_view name, std::size_t thread) {
+        stream << (is_first ? "\n" : ",\n") << "{\"name\":\"" << name
+               << "\",\"pid\":0,\"tid\":" << thread;
+        is_first = false;
+    };
+
+    // GPU scopes are shown as thread 0.
+    begin_event("thread_name", 0);
+    stream << ",\"ph\":\"M\",\"args\":{\"name\":\"GPU\"}}";
+    for (gpu_trace_event const& event : gpu_trace) {
+        stream << (is_first ? "\n" : ",\n") << "{\"name\":\"" << event.name;
+        if (event.index != no_scope_index) {
+            stream << ' ' << event.index;
+        }
+        stream << "\",\"pid\":0,\"tid\":0,\"cat\":\"gpu\",\"ph\":\"X\""
+               << ",\"ts\":" << to_microseconds(event.begin_nanoseconds)
+               << ",\"dur\":"
+               << static_cast<double>(event.duration_nanoseconds) / 1e3
+               << ",\"args\":{\"vertex invocations\":"
+               << event.stats.vertex_invocations
+               << ",\"clipping invocations\":"
+               << event.stats.clipping_invocations
+               << ",\"clipping primitives\":"
+               << event.stats.clipping_primitives
+               << ",\"fragment invocations\":"
+               << event.stats.fragment_invocations << "}}";
+    }
+
+#ifdef cpu_profiling
+    // Threads are numbered in the order that they first recorded a zone.
+    for (std::size_t i = 0; i < g_rings.size(); ++i) {
+        std::size_t const thread = i + 1;
+        begin_event("thread_name", thread);
+        stream << ",\"ph\":\"M\",\"args\":{\"name\":\"CPU " << i << "\"}}";
+
+        for (zone_event const& event : get_ring_events(*g_rings[i])) {
+            begin_event(event.p_name, thread);
+            stream << ",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":"
+                   << to_microseconds(event.begin_nanoseconds) << ",\"dur\":"
+                   << static_cast<double>(event.end_nanoseconds -
+                                          event.begin_nanoseconds) /
+                          1e3
+                   << '}';
+        }
+    }
+#endif
+    stream << "\n]}\n";
+}
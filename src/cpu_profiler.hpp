@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// Nanoseconds on `std::chrono::steady_clock`, which GPU scopes are also
+// converted onto.
+[[nodiscard]]
+inline auto get_profiler_time() -> std::uint64_t {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+// Write the zones which every thread recorded, and `g_gpu_profiler`'s scopes,
+// as one timeline of Chrome's trace event JSON, which `chrome://tracing` and
+// Perfetto display. No thread may be recording zones meanwhile. Without
+// `cpu_profiling`, only GPU scopes are written.
+void write_chrome_trace(std::filesystem::path const& path);
+
+#ifdef cpu_profiling
+
+namespace detail {
+
+// Records the time from its construction to its destruction into the calling
+// thread's ring buffer, which only that thread writes, so this never locks
+// after a thread's first zone.
+class cpu_zone_scope {
+  public:
+    explicit cpu_zone_scope(char const* p_name)
+        : m_p_name(p_name), m_begin(get_profiler_time()) {
+    }
+
+    cpu_zone_scope(cpu_zone_scope const&) = delete;
+    auto operator=(cpu_zone_scope const&) -> cpu_zone_scope& = delete;
+
+    ~cpu_zone_scope();
+
+  private:
+    char const* m_p_name;
+    std::uint64_t m_begin;
+};
+
+}  // namespace detail
+
+// Profile the rest of the enclosing block as `name`, which must be a string
+// literal.
+#define cpu_zone(name) auto _ = ::detail::cpu_zone_scope(name)  // NOLINT
+
+#else
+
+#define cpu_zone(name)  // NOLINT
+
+#endif
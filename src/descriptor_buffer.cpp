@@ -0,0 +1,120 @@
+#include "descriptor_buffer.hpp"
+
+#include <cassert>
+
+#include "globals.hpp"
+
+namespace {
+constexpr vk::BufferUsageFlags descriptor_buffer_usage =
+    vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT |
+    vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT |
+    vk::BufferUsageFlagBits::eShaderDeviceAddress;
+}  // namespace
+
+descriptor_buffer::descriptor_buffer(
+    vk::DescriptorSetLayout layout,
+    std::span<vk::DescriptorSetLayoutBinding const> bindings) {
+    assert(bindings.size() == binding_count);
+    vk::PhysicalDeviceProperties2 properties;
+    properties.setPNext(&m_properties);
+    vk::PhysicalDevice(g_physical_device.physical_device)
+        .getProperties2(&properties);
+
+    for (std::uint32_t i = 0; i < binding_count; ++i) {
+        m_binding_offsets[i] =
+            g_device.getDescriptorSetLayoutBindingOffsetEXT(layout, i);
+        m_binding_counts[i] = bindings[i].descriptorCount;
+    }
+
+    m_buffer = device_buffer(descriptor_buffer_usage,
+                             g_device.getDescriptorSetLayoutSizeEXT(layout),
+                             vk::MemoryPropertyFlagBits::eHostVisible |
+                                 vk::MemoryPropertyFlagBits::eHostCoherent);
+    m_p_mapped = static_cast<std::byte*>(m_buffer.map());
+}
+
+void descriptor_buffer::write_storage_buffer(std::uint32_t binding,
+                                             vk::DeviceAddress address,
+                                             vk::DeviceSize range) {
+    vk::DescriptorAddressInfoEXT address_info;
+    address_info.setAddress(address).setRange(range);
+
+    vk::DescriptorGetInfoEXT info;
+    info.setType(vk::DescriptorType::eStorageBuffer)
+        .setData(vk::DescriptorDataEXT{}.setPStorageBuffer(&address_info));
+    write(info, m_properties.storageBufferDescriptorSize, binding, 0);
+}
+
+void descriptor_buffer::write_image(std::uint32_t binding,
+                                    std::uint32_t array_index,
+                                    vk::Sampler sampler, vk::ImageView view,
+                                    vk::ImageLayout layout) {
+    vk::DescriptorImageInfo const image_info(sampler, view, layout);
+
+    if (m_properties.combinedImageSamplerDescriptorSingleArray) {
+        vk::DescriptorGetInfoEXT info;
+        info.setType(vk::DescriptorType::eCombinedImageSampler)
+            .setData(
+                vk::DescriptorDataEXT{}.setPCombinedImageSampler(&image_info));
+        write(info, m_properties.combinedImageSamplerDescriptorSize, binding,
+              array_index);
+        return;
+    }
+
+    // Otherwise, the binding is an array of image descriptors followed by an
+    // array of sampler descriptors.
+    vk::DescriptorGetInfoEXT image_get_info;
+    image_get_info.setType(vk::DescriptorType::eSampledImage)
+        .setData(vk::DescriptorDataEXT{}.setPSampledImage(&image_info));
+    write(image_get_info, m_properties.sampledImageDescriptorSize, binding,
+          array_index);
+
+    vk::DescriptorGetInfoEXT sampler_get_info;
+    sampler_get_info.setType(vk::DescriptorType::eSampler)
+        .setData(vk::DescriptorDataEXT{}.setPSampler(&sampler));
+    vk::DeviceSize const samplers_offset =
+        m_binding_counts[binding] * m_properties.sampledImageDescriptorSize;
+    write(sampler_get_info, m_properties.samplerDescriptorSize, binding,
+          array_index, samplers_offset);
+}
+
+void descriptor_buffer::write_storage_image(std::uint32_t binding,
+                                            vk::ImageView view) {
+    vk::DescriptorImageInfo const image_info({}, view,
+                                             vk::ImageLayout::eGeneral);
+
+    vk::DescriptorGetInfoEXT info;
+    info.setType(vk::DescriptorType::eStorageImage)
+        .setData(vk::DescriptorDataEXT{}.setPStorageImage(&image_info));
+    write(info, m_properties.storageImageDescriptorSize, binding, 0);
+}
+
+void descriptor_buffer::bind(vk::CommandBuffer cmd,
+                             vk::PipelineLayout layout) const {
+    vk::DescriptorBufferBindingInfoEXT binding_info;
+    binding_info.setAddress(m_buffer.get_device_address())
+        .setUsage(descriptor_buffer_usage);
+    cmd.bindDescriptorBuffersEXT(binding_info);
+
+    // The set starts at the beginning of the first bound buffer.
+    std::uint32_t const buffer_index = 0;
+    vk::DeviceSize const offset = 0;
+    cmd.setDescriptorBufferOffsetsEXT(vk::PipelineBindPoint::eGraphics, layout,
+                                      0, buffer_index, offset);
+    cmd.setDescriptorBufferOffsetsEXT(vk::PipelineBindPoint::eCompute, layout,
+                                      0, buffer_index, offset);
+}
+
+void descriptor_buffer::write(vk::DescriptorGetInfoEXT const& info,
+                              std::size_t size, std::uint32_t binding,
+                              std::uint32_t array_index,
+                              vk::DeviceSize array_offset) {
+    assert(binding < binding_count);
+    assert(array_index < m_binding_counts[binding]);
+    vk::DeviceSize const offset =
+        m_binding_offsets[binding] + array_offset + (array_index * size);
+    assert(offset + size <= m_buffer.size());
+
+    // The memory is coherent, so the GPU sees this without a flush.
+    g_device.getDescriptorEXT(info, size, m_p_mapped + offset);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "device_buffer.hpp"
+
+// The bindless descriptor set, stored in host-visible memory with
+// `VK_EXT_descriptor_buffer` instead of being allocated from a pool. Each
+// descriptor is written directly into the mapped buffer, so changing one does
+// not rewrite the set, and the buffer is bound once for each command buffer.
+// Each frame in flight has its own buffer, so that a buffer is only written
+// once the frames which read it have finished.
+class descriptor_buffer {
+  public:
+    // This matches the bindings of `g_descriptor_layout`.
+    static constexpr std::uint32_t binding_count = 7;
+
+    descriptor_buffer() = default;
+
+    // `layout` must have been created from `bindings` with
+    // `eDescriptorBufferEXT`.
+    descriptor_buffer(
+        vk::DescriptorSetLayout layout,
+        std::span<vk::DescriptorSetLayoutBinding const> bindings);
+
+    void write_storage_buffer(std::uint32_t binding, vk::DeviceAddress address,
+                              vk::DeviceSize range);
+
+    void write_image(std::uint32_t binding, std::uint32_t array_index,
+                     vk::Sampler sampler, vk::ImageView view,
+                     vk::ImageLayout layout);
+
+    // Storage images are always in `eGeneral` layout.
+    void write_storage_image(std::uint32_t binding, vk::ImageView view);
+
+    // Bind this as set 0 for graphics and compute.
+    void bind(vk::CommandBuffer cmd, vk::PipelineLayout layout) const;
+
+  private:
+    // `array_offset` is where the array being written begins in the binding.
+    void write(vk::DescriptorGetInfoEXT const& info, std::size_t size,
+               std::uint32_t binding, std::uint32_t array_index,
+               vk::DeviceSize array_offset = 0);
+
+    device_buffer m_buffer;
+    std::byte* m_p_mapped = nullptr;
+    std::array<vk::DeviceSize, binding_count> m_binding_offsets{};
+    std::array<std::uint32_t, binding_count> m_binding_counts{};
+    vk::PhysicalDeviceDescriptorBufferPropertiesEXT m_properties;
+};
@@ -0,0 +1,61 @@
+#include "device_buffer.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+#include "globals.hpp"
+
+auto find_memory_type(std::uint32_t type_bits,
+                      vk::MemoryPropertyFlags properties) -> std::uint32_t {
+    VkPhysicalDeviceMemoryProperties const& memory =
+        g_physical_device.memory_properties;
+    for (std::uint32_t i = 0; i < memory.memoryTypeCount; ++i) {
+        auto const flags =
+            vk::MemoryPropertyFlags(memory.memoryTypes[i].propertyFlags);
+        if ((type_bits & (1u << i)) != 0 &&
+            (flags & properties) == properties) {
+            return i;
+        }
+    }
+    // Every caller needs its memory, so there is nothing to fall back onto.
+    std::cout << "No memory type has " << vk::to_string(properties) << ".\n";
+    std::quick_exit(1);
+}
+
+device_buffer::device_buffer(vk::BufferUsageFlags usage, std::size_t size,
+                             vk::MemoryPropertyFlags memory_properties)
+    : m_size(size) {
+    vk::BufferCreateInfo buffer_info;
+    buffer_info.setSize(size).setUsage(usage).setSharingMode(
+        vk::SharingMode::eExclusive);
+    m_buffer = g_device.createBufferUnique(buffer_info);
+
+    vk::MemoryRequirements const requirements =
+        g_device.getBufferMemoryRequirements(*m_buffer);
+
+    bool const is_addressable =
+        (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) !=
+        vk::BufferUsageFlags{};
+
+    // Addressable buffers' memory must be allocated as such.
+    vk::MemoryAllocateFlagsInfo flags_info;
+    flags_info.setFlags(vk::MemoryAllocateFlagBits::eDeviceAddress);
+
+    vk::MemoryAllocateInfo allocate_info;
+    allocate_info.setAllocationSize(requirements.size)
+        .setMemoryTypeIndex(
+            find_memory_type(requirements.memoryTypeBits, memory_properties))
+        .setPNext(is_addressable ? &flags_info : nullptr);
+    m_memory = g_device.allocateMemoryUnique(allocate_info);
+
+    g_device.bindBufferMemory(*m_buffer, *m_memory, 0);
+
+    if (is_addressable) {
+        m_device_address = g_device.getBufferAddress({*m_buffer});
+    }
+}
+
+auto device_buffer::map() const -> void* {
+    return g_device.mapMemory(*m_memory, 0, vk::WholeSize);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// The index of a memory type which is allowed by `type_bits` and has every
+// flag in `properties`. The game exits if there is none.
+[[nodiscard]]
+auto find_memory_type(std::uint32_t type_bits,
+                      vk::MemoryPropertyFlags properties) -> std::uint32_t;
+
+// A buffer with its own memory allocation, which can be addressed from
+// shaders when it is created with `eShaderDeviceAddress` usage.
+class device_buffer {
+  public:
+    device_buffer() = default;
+
+    device_buffer(vk::BufferUsageFlags usage, std::size_t size,
+                  vk::MemoryPropertyFlags memory_properties =
+                      vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    [[nodiscard]]
+    auto buffer() const -> vk::Buffer {
+        return *m_buffer;
+    }
+
+    [[nodiscard]]
+    auto size() const -> std::size_t {
+        return m_size;
+    }
+
+    // This is only valid for buffers with `eShaderDeviceAddress` usage.
+    [[nodiscard]]
+    auto get_device_address() const -> vk::DeviceAddress {
+        return m_device_address;
+    }
+
+    // Map the whole buffer, which must be host-visible. It stays mapped until
+    // the buffer is destroyed.
+    [[nodiscard]]
+    auto map() const -> void*;
+
+  private:
+    vk::UniqueBuffer m_buffer;
+    vk::UniqueDeviceMemory m_memory;
+    std::size_t m_size = 0;
+    vk::DeviceAddress m_device_address = 0;
+};
@@ -0,0 +1,280 @@
+#include "frame_capture.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <span>
+#include <string_view>
+
+#include "arena.hpp"
+#include "bindless.hpp"
+#include "camera.hpp"
+#include "cpu_profiler.hpp"
+#include "globals.hpp"
+#include "headless.hpp"
+#include "light.hpp"
+#include "texture_cache.hpp"
+#include "vulkan_flow.hpp"
+
+namespace {
+constexpr std::uint64_t capture_magic = 0x31'45'52'55'54'50'41'43;
+
+// These are the passes of `record_frame()`, in order.
+constexpr std::array<std::string_view, 6> pass_names = {
+    "culling",   "light culling", "skybox",
+    "rendering", "lights",        "compositing"};
+constexpr std::uint32_t culling_pass = 1u << 0;
+constexpr std::uint32_t light_culling_pass = 1u << 1;
+constexpr std::uint32_t all_passes = (1u << pass_names.size()) - 1;
+
+// Culling is done by task shaders instead, when there are mesh shaders, and
+// shadow casters are culled on the CPU without `gpu_light_culling`.
+auto get_recorded_passes() -> std::uint32_t {
+    std::uint32_t passes = all_passes;
+    if (g_has_mesh_shaders) {
+        passes &= ~culling_pass;
+    }
+#ifndef gpu_light_culling
+    passes &= ~light_culling_pass;
+#endif
+    return passes;
+}
+
+void print_passes(std::uint32_t passes) {
+    for (std::size_t i = 0; i < pass_names.size(); ++i) {
+        if ((passes & (1u << i)) != 0) {
+            std::cout << ' ' << pass_names[i];
+        }
+    }
+}
+
+template <typename T>
+void write_bytes(std::ofstream& file, T const* p_data, std::size_t count = 1) {
+    file.write(reinterpret_cast<char const*>(p_data),
+               static_cast<std::streamsize>(sizeof(T) * count));
+}
+
+// Reads the frames of a mapped capture, which have no alignment.
+class capture_reader {
+  public:
+    explicit capture_reader(std::span<std::byte const> bytes)
+        : m_bytes(bytes) {
+    }
+
+    [[nodiscard]]
+    auto is_valid() const -> bool {
+        if (m_bytes.size() < sizeof(capture_file_header)) {
+            return false;
+        }
+        capture_file_header const header = read<capture_file_header>(0);
+        return header.magic == capture_magic &&
+               header.frame_index_offset +
+                       (header.frame_count * sizeof(std::uint64_t)) ==
+                   m_bytes.size();
+    }
+
+    [[nodiscard]]
+    auto get_frame_count() const -> std::size_t {
+        return read<capture_file_header>(0).frame_count;
+    }
+
+    [[nodiscard]]
+    auto get_frame_offset(std::size_t frame) const -> std::size_t {
+        return read<std::uint64_t>(
+            read<capture_file_header>(0).frame_index_offset +
+            (frame * sizeof(std::uint64_t)));
+    }
+
+    [[nodiscard]]
+    auto get_frame(std::size_t frame) const -> captured_frame_header {
+        return read<captured_frame_header>(get_frame_offset(frame));
+    }
+
+    // Apply frame `frame` onto `g_bindless_data`, `g_lights`, `g_camera`, and
+    // `g_render_scale`.
+    void apply_frame(std::size_t frame) {
+        std::size_t offset = get_frame_offset(frame);
+        auto const header = read<captured_frame_header>(offset);
+        offset += sizeof(header);
+
+        g_camera.position = {header.camera_position[0],
+                             header.camera_position[1],
+                             header.camera_position[2]};
+        g_camera.pitch = header.camera_pitch;
+        g_camera.yaw = header.camera_yaw;
+        g_render_scale = header.render_scale;
+
+        // Only the visible lights are captured, and they create the maps of
+        // any slots which they use.
+        m_visible_lights.resize(header.light_count);
+        for (std::uint32_t i = 0; i < header.light_count; ++i) {
+            m_visible_lights[i] = read<light_t::light>(offset);
+            offset += sizeof(light_t::light);
+        }
+        g_lights.set_visible(m_visible_lights);
+
+        g_bindless_data.restore_layout(header.data_size,
+                                       header.max_meshlet_count);
+        for (std::uint32_t i = 0; i < header.patch_count; ++i) {
+            auto const patch = read<capture_patch>(offset);
+            offset += sizeof(patch);
+            g_bindless_data.patch(patch.offset,
+                                  m_bytes.subspan(offset, patch.size));
+            offset += patch.size;
+        }
+        if (header.is_keyframe != 0) {
+            g_bindless_data.mark_all_dirty();
+        }
+    }
+
+  private:
+    template <typename T>
+    [[nodiscard]]
+    auto read(std::size_t offset) const -> T {
+        T value;
+        std::memcpy(&value, m_bytes.data() + offset, sizeof(T));
+        return value;
+    }
+
+    std::span<std::byte const> m_bytes;
+    std::vector<light_t::light> m_visible_lights;
+};
+}  // namespace
+
+void frame_capture::open(std::filesystem::path const& path) {
+    m_file.open(path, std::ios::binary);
+    if (!m_file) {
+        std::cout << "Cannot capture frames into " << path << ".\n";
+        m_file.close();
+        return;
+    }
+    m_frame_offsets.clear();
+
+    // The frame count and index are filled in by `.close()`.
+    capture_file_header const header = {.magic = capture_magic};
+    write_bytes(m_file, &header);
+}
+
+void frame_capture::write_frame() {
+    cpu_zone("capture frame");
+    bool const is_keyframe =
+        g_bindless_data.is_all_dirty() ||
+        (m_frame_offsets.size() % keyframe_interval) == 0;
+
+    // Keyframes patch every byte.
+    buffer_storage::dirty_range const whole_range = {
+        .offset = 0, .size = g_bindless_data.size()};
+    std::span<buffer_storage::dirty_range const> const ranges =
+        is_keyframe ? std::span(&whole_range, 1)
+                    : g_bindless_data.get_dirty_ranges();
+
+    captured_frame_header const header = {
+        .is_keyframe = is_keyframe ? 1u : 0u,
+        .passes = get_recorded_passes(),
+        .camera_position = {g_camera.position.x, g_camera.position.y,
+                            g_camera.position.z},
+        .camera_pitch = g_camera.pitch,
+        .camera_yaw = g_camera.yaw,
+        .swapchain_width = g_swapchain.extent.width,
+        .swapchain_height = g_swapchain.extent.height,
+        .render_scale = g_render_scale,
+        .max_meshlet_count = g_bindless_data.get_max_meshlet_count(),
+        .light_count =
+            static_cast<std::uint32_t>(g_lights.get_visible().size()),
+        .patch_count = static_cast<std::uint32_t>(ranges.size()),
+        .data_size = g_bindless_data.size(),
+    };
+
+    m_frame_offsets.push_back(static_cast<std::uint64_t>(m_file.tellp()));
+    write_bytes(m_file, &header);
+    std::span<light_t::light const> const lights = g_lights.get_visible();
+    write_bytes(m_file, lights.data(), lights.size());
+    for (auto [offset, size] : ranges) {
+        capture_patch const patch = {.offset = offset, .size = size};
+        write_bytes(m_file, &patch);
+        write_bytes(m_file, g_bindless_data.data() + offset, size);
+    }
+}
+
+void frame_capture::close() {
+    if (!is_open()) {
+        return;
+    }
+    capture_file_header const header = {
+        .magic = capture_magic,
+        .frame_count = m_frame_offsets.size(),
+        .frame_index_offset = static_cast<std::uint64_t>(m_file.tellp()),
+    };
+    write_bytes(m_file, m_frame_offsets.data(), m_frame_offsets.size());
+    m_file.seekp(0);
+    write_bytes(m_file, &header);
+    m_file.close();
+    std::cout << "Captured " << header.frame_count << " frames.\n";
+}
+
+auto run_replay(std::filesystem::path const& path, std::size_t first_frame)
+    -> std::vector<double> {
+    mapped_file const file(path);
+    capture_reader reader(file.get_bytes());
+    if (!reader.is_valid()) {
+        std::cout << path << " is not a complete frame capture.\n";
+        return {};
+    }
+    std::size_t const frame_count = reader.get_frame_count();
+    if (first_frame >= frame_count) {
+        std::cout << path << " only has " << frame_count << " frames.\n";
+        return {};
+    }
+
+    captured_frame_header const first = reader.get_frame(first_frame);
+    if (first.passes != get_recorded_passes()) {
+        std::cout << "Frames were captured with the passes";
+        print_passes(first.passes);
+        std::cout << ", but are replayed with";
+        print_passes(get_recorded_passes());
+        std::cout << ".\n";
+    }
+    if (first.swapchain_width != g_swapchain.extent.width ||
+        first.swapchain_height != g_swapchain.extent.height) {
+        std::cout << "Frames were captured at " << first.swapchain_width << 'x'
+                  << first.swapchain_height << ", but are replayed at "
+                  << g_swapchain.extent.width << 'x'
+                  << g_swapchain.extent.height << ".\n";
+    }
+
+    // Frames only patch what changed since the frame before, so replaying
+    // starts from the keyframe before `first_frame`.
+    std::size_t keyframe = first_frame;
+    while (reader.get_frame(keyframe).is_keyframe == 0) {
+        --keyframe;
+    }
+
+    std::vector<double> frame_milliseconds;
+    frame_milliseconds.reserve(frame_count - first_frame);
+    g_device.waitIdle();
+    for (std::size_t frame = keyframe; frame < frame_count; ++frame) {
+        cpu_zone("replay frame");
+        auto const frame_start = std::chrono::steady_clock::now();
+        reader.apply_frame(frame);
+        // Skipped frames' patches are uploaded with the first replayed one.
+        if (frame < first_frame) {
+            continue;
+        }
+
+        ++g_frame_number;
+        get_frame_arena().reset();
+        auto const slot =
+            static_cast<unsigned>(g_frame_number % g_frames_in_flight);
+        wait_for_frame(slot);
+        (void)upload_bindless_data(slot);
+        record_frame(slot, slot);
+        render_offscreen(slot);
+        frame_milliseconds.push_back(
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - frame_start)
+                .count());
+    }
+    g_device.waitIdle();
+    return frame_milliseconds;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// Frames are captured into a file of this layout:
+//
+// - A `capture_file_header`.
+// - Each frame, as a `captured_frame_header`, then its visible
+//   `light_t::light`s, then its patches of `g_bindless_data`, which are each
+//   a `capture_patch` followed by its bytes.
+// - The offset of every frame, at `frame_index_offset`, so that frames can be
+//   found without reading the ones before them.
+//
+// Keyframes patch the whole byte image, and other frames only patch the ranges
+// which changed since the frame before, so a frame is replayed by applying
+// every frame since the keyframe before it.
+struct capture_file_header {
+    std::uint64_t magic;
+    std::uint64_t frame_count;
+    std::uint64_t frame_index_offset;
+};
+
+struct captured_frame_header {
+    std::uint32_t is_keyframe;
+    // Which passes `record_frame()` recorded, since they depend on the device.
+    std::uint32_t passes;
+    float camera_position[3];
+    float camera_pitch;
+    float camera_yaw;
+    std::uint32_t swapchain_width;
+    std::uint32_t swapchain_height;
+    float render_scale;
+    // This is the only state which recording reads from `g_bindless_data`
+    // outside of its bytes.
+    std::uint32_t max_meshlet_count;
+    std::uint32_t light_count;
+    std::uint32_t patch_count;
+    std::uint64_t data_size;
+};
+
+struct capture_patch {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// Appends a frame of `g_bindless_data` and its render state per call.
+class frame_capture {
+  public:
+    // Nothing is captured if `path` cannot be created.
+    void open(std::filesystem::path const& path);
+
+    [[nodiscard]]
+    auto is_open() const -> bool {
+        return m_file.is_open();
+    }
+
+    // Capture the current frame. This must be called before
+    // `upload_bindless_data()`, which clears the ranges that changed.
+    void write_frame();
+
+    // Write the frame index, which completes the file.
+    void close();
+
+    // Frames are patched from the last keyframe, which is written at least
+    // this often, so that seeking never applies many frames.
+    static constexpr std::size_t keyframe_interval = 256;
+
+  private:
+    std::ofstream m_file;
+    std::vector<std::uint64_t> m_frame_offsets;
+};
+
+inline frame_capture g_frame_capture;
+
+// Feed the frames of the capture at `path`, from `first_frame`, through
+// uploading and recording like the game loop, without any game logic. This
+// returns how long each frame took.
+[[nodiscard]]
+auto run_replay(std::filesystem::path const& path, std::size_t first_frame)
+    -> std::vector<double>;
@@ -0,0 +1,96 @@
+#include "frame_pacing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <utility>
+
+#include "cpu_profiler.hpp"
+#include "globals.hpp"
+#include "gpu_profiler.hpp"
+
+namespace {
+using milliseconds = std::chrono::duration<double, std::milli>;
+
+// How far each sample moves the smoothed present interval and work time
+// towards it.
+constexpr double smoothing = 0.1;
+
+// Intervals this much longer than the smoothed one missed a refresh, so they
+// are left out of it.
+constexpr double missed_interval_ratio = 1.5;
+
+// Frames start this fraction of the present interval earlier than their work
+// needs, and at least `min_margin_milliseconds` earlier, to absorb jitter.
+constexpr double margin_ratio = 0.1;
+constexpr double min_margin_milliseconds = 1.0;
+
+// A present which is never displayed must not stall the game.
+constexpr std::uint64_t present_timeout_nanoseconds = 100'000'000;
+}  // namespace
+
+auto frame_pacer::wait(std::uint64_t present_id)
+    -> std::optional<clock::time_point> {
+    if (!m_is_enabled || present_id <= m_first_present_id) {
+        return {};
+    }
+    cpu_zone("pace frame");
+
+    try {
+        vk::Result const result = g_device.waitForPresentKHR(
+            g_swapchain.swapchain, present_id - 1,
+            present_timeout_nanoseconds);
+        // The present was not displayed in time, so it neither measures the
+        // refresh interval nor when it was displayed.
+        if (result == vk::Result::eTimeout) {
+            m_last_present.reset();
+            return {};
+        }
+    } catch (vk::OutOfDateKHRError const&) {
+        // The swapchain is recreated when this frame is acquired.
+        return {};
+    }
+    clock::time_point const now = clock::now();
+    std::optional<clock::time_point> const last =
+        std::exchange(m_last_present, now);
+    if (!last) {
+        return now;
+    }
+
+    double const interval = milliseconds(now - *last).count();
+    if (!m_present_interval_milliseconds) {
+        m_present_interval_milliseconds = interval;
+        return now;
+    }
+    double const margin =
+        std::max(*m_present_interval_milliseconds * margin_ratio,
+                 min_margin_milliseconds);
+    if (interval > *m_present_interval_milliseconds * missed_interval_ratio) {
+        // The last frame started too late, so later frames start earlier.
+        m_work_milliseconds += margin;
+        return now;
+    }
+    m_present_interval_milliseconds =
+        std::lerp(*m_present_interval_milliseconds, interval, smoothing);
+
+    // The frame must be presented by the next refresh after the last one.
+    double const slack =
+        *m_present_interval_milliseconds - m_work_milliseconds - margin;
+    if (slack > 0.0) {
+        std::this_thread::sleep_for(milliseconds(slack));
+    }
+    return now;
+}
+
+void frame_pacer::end_frame(clock::duration cpu_time) {
+    if (!m_is_enabled) {
+        return;
+    }
+    double const work = milliseconds(cpu_time).count() +
+                        g_gpu_profiler.get_last_frame_milliseconds();
+    // Frames which take longer are planned for at once, and ones which take
+    // less only gradually.
+    m_work_milliseconds = (work > m_work_milliseconds)
+                              ? work
+                              : std::lerp(m_work_milliseconds, work, smoothing);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// Delays the start of each frame until the one before it was presented, and
+// then for as long as the frame would still finish before the next refresh,
+// so that input is sampled as late as possible and at most one frame waits to
+// be presented. This needs `g_has_present_wait`.
+class frame_pacer {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    void set_enabled(bool is_enabled) {
+        m_is_enabled = is_enabled;
+    }
+
+    [[nodiscard]]
+    auto is_enabled() const -> bool {
+        return m_is_enabled;
+    }
+
+    // Wait before the frame whose present is `present_id` samples input. This
+    // returns when the frame before it was presented, if that was waited for.
+    auto wait(std::uint64_t present_id) -> std::optional<clock::time_point>;
+
+    // Forget the presents of a replaced swapchain, so that frames do not
+    // wait for them. `first_present_id` is the first present of the new one.
+    void reset(std::uint64_t first_present_id) {
+        m_first_present_id = first_present_id;
+        m_last_present.reset();
+    }
+
+    // Record that a frame took `cpu_time` from sampling input until its
+    // submission. The GPU's time is taken from `g_gpu_profiler`.
+    void end_frame(clock::duration cpu_time);
+
+  private:
+    bool m_is_enabled = false;
+    std::uint64_t m_first_present_id = 1;
+    std::optional<clock::time_point> m_last_present;
+    // The time between presents, which is the display's refresh interval when
+    // frames keep up with it.
+    std::optional<double> m_present_interval_milliseconds;
+    // How long frames take from sampling input until the GPU finishes them.
+    double m_work_milliseconds = 0;
+};
+
+inline frame_pacer g_frame_pacer;
@@ -1,5 +1,7 @@
+#include <memory_resource>
+
 #include "bindless.hpp"
-#include "globals.hpp"
+#include "scene.hpp"
 
 inline mesh g_cube_mesh = {
     {// Front face.
@@ -46,8 +48,10 @@ inline mesh g_plane_mesh = {
 inline auto make_checkerboard_plane(
     glm::vec3 center, float scale_x, float scale_z, unsigned rows,
     unsigned columns, mesh_instance const& properties_even,
-    mesh_instance const& properties_odd) -> std::vector<mesh_instance> {
-    std::vector<mesh_instance> instances;
+    mesh_instance const& properties_odd,
+    std::pmr::memory_resource* p_memory = std::pmr::get_default_resource())
+    -> std::pmr::vector<mesh_instance> {
+    std::pmr::vector<mesh_instance> instances(p_memory);
     instances.reserve(rows * columns);
 
     ++g_next_instance_id;
@@ -8,10 +8,15 @@
 #include <vulkan/vulkan_handles.hpp>
 
 #include <VkBootstrap.h>
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
-#include <ktxvulkan.h>
 #include <optional>
 
+#include "arena.hpp"
+#include "descriptor_buffer.hpp"
+#include "device_buffer.hpp"
+
 namespace vk {
 inline constinit DispatchLoaderDynamic defaultDispatchLoaderDynamic;
 }
@@ -19,11 +24,18 @@ inline constinit DispatchLoaderDynamic defaultDispatchLoaderDynamic;
 // `vulk` is a dispatcher to make Vulkan API calls on.
 inline constinit auto& vulk = vk::defaultDispatchLoaderDynamic;
 
-inline constexpr std::uint32_t max_frames_in_flight = 2;
+// This is set by `--frames-in-flight`.
+inline constinit std::uint32_t g_frames_in_flight = 2;
+// Swapchains prefer this, and fall back onto FIFO if the surface does not
+// support it. This is set by `--present-mode`.
+inline constinit vk::PresentModeKHR g_present_mode = vk::PresentModeKHR::eFifo;
 inline vk::Queue g_graphics_queue;
 inline std::uint32_t g_graphics_queues_index;
 inline vk::Queue g_present_queue;
 inline std::uint32_t g_present_queue_index;
+// This is the graphics queue if the device has no separate transfer queue.
+inline vk::Queue g_transfer_queue;
+inline std::uint32_t g_transfer_queues_index;
 
 inline vkb::Swapchain g_swapchain;
 inline std::vector<VkImage> g_swapchain_images{};
@@ -34,30 +46,55 @@ inline vku::ColorAttachmentImage g_xyz_image;
 inline vku::ColorAttachmentImage g_id_image;
 inline vku::DepthStencilImage g_depth_image;
 
-inline ktxVulkanTexture g_ktx_skybox;
-inline vku::TextureImageCube g_skybox;
-inline vk::ImageView g_skybox_view;
-
 inline vk::Sampler g_nearest_neighbor_sampler;
+// Mesh textures are filtered between their mip levels.
+inline vk::Sampler g_texture_sampler;
+// The composited image is upscaled with bilinear taps, which are clamped to its
+// edges.
+inline vk::Sampler g_linear_sampler;
 
 inline vk::CommandPool g_command_pool;
 inline std::vector<vk::CommandBuffer> g_command_buffers;
+// Patches of the bindless buffer are uploaded with this.
+inline vk::CommandBuffer g_upload_command_buffer;
 
 // TODO: Use `timeline_semaphore`.
 inline std::array<vk::Semaphore, max_frames_in_flight> g_available_semaphores;
 inline std::array<vk::Semaphore, max_frames_in_flight> g_finished_semaphore;
 inline std::array<vk::Fence, max_frames_in_flight> g_in_flight_fences;
-inline std::array<vk::Fence, max_frames_in_flight> g_image_in_flight;
-
-inline vk::DescriptorSet g_descriptor_set;
+// The fence of the frame which last rendered into each swapchain image.
+inline std::vector<vk::Fence> g_image_in_flight;
+
+// Only one of these holds the bindless descriptors, depending on
+// `g_has_descriptor_buffer`. Each frame in flight binds its own, which is only
+// written while none of its frames are pending.
+inline std::array<vk::DescriptorSet, max_frames_in_flight> g_descriptor_sets;
+inline std::array<descriptor_buffer, max_frames_in_flight>
+    g_descriptor_buffers;
 inline vk::DescriptorSetLayout g_descriptor_layout;
 inline vk::DescriptorSetLayout g_descriptor_layout_lights;
 inline vk::PipelineLayout g_pipeline_layout;
 
-// Push constants contain a 4-byte index for light rasterization passes to use
-// for indexing into their respective light source.
+// This matches `push_constants` in `shaders.slang`:
+struct push_constants {
+    // An index for light rasterization passes to use for indexing into their
+    // respective light source.
+    std::uint32_t current_light_invocation;
+    // The scene is rasterized into this much of the top left of its
+    // attachments, which is `get_render_extent()`.
+    std::uint32_t render_width;
+    std::uint32_t render_height;
+    // The first instance of a task shader dispatch, which is split to fit the
+    // device's work group limits.
+    std::uint32_t first_task_instance;
+    // The address of `g_device_local_buffer`, which shaders load from when
+    // `vertex_pulling` is defined.
+    vk::DeviceAddress bindless_address;
+};
+
+// Every stage can read the bindless buffer's address.
 inline constexpr vk::PushConstantRange g_push_constants = {
-    vk::ShaderStageFlagBits::eVertex, 0, 4};
+    vk::ShaderStageFlagBits::eAll, 0, sizeof(push_constants)};
 
 inline vkb::PhysicalDevice g_physical_device;
 // This is `optional` to defer initialization:
@@ -65,14 +102,76 @@ inline std::optional<vkb::SwapchainBuilder> g_swapchain_builder;
 
 inline vk::Device g_device;
 
+// Meshlets are culled and drawn by task and mesh shaders when the device
+// supports them, and by a compute pass generating indirect draws otherwise.
+inline constinit bool g_has_mesh_shaders = false;
+// How many task shader work groups one dispatch may launch in total.
+inline constinit std::uint32_t g_max_task_work_group_total_count = 0;
+
+// Descriptors are written into `g_descriptor_buffers` when the device supports
+// `VK_EXT_descriptor_buffer`, and into `g_descriptor_sets` otherwise.
+inline constinit bool g_has_descriptor_buffer = false;
+
+// GPU profiler scopes count pipeline statistics when the device supports
+// `pipelineStatisticsQuery`.
+inline constinit bool g_has_pipeline_statistics = false;
+
+// GPU profiler scopes are put on the CPU's clock exactly with
+// `VK_EXT_calibrated_timestamps`, and estimated otherwise.
+inline constinit bool g_has_calibrated_timestamps = false;
+
+// Frames can wait for earlier frames to be presented with
+// `VK_KHR_present_wait`, which `g_frame_pacer` needs.
+inline constinit bool g_has_present_wait = false;
+
+// Without a window, frames are rendered into offscreen images instead of a
+// swapchain. This is set by `--headless`.
+inline constinit bool g_is_headless = false;
+
 inline constexpr std::uint32_t game_width = 480;
 inline constexpr std::uint32_t game_height = 320;
 inline constinit std::uint32_t g_screen_width = game_width;
 inline constinit std::uint32_t g_screen_height = game_height;
 
+// The G-buffer and light maps are allocated at this size once, and each frame
+// rasterizes into a sub-rectangle of them, so that the render scale can change
+// without reallocating anything.
+inline constexpr std::uint32_t max_render_width = game_width * 2;
+inline constexpr std::uint32_t max_render_height = game_height * 2;
+
+// The scene is rasterized at this fraction of the swapchain's size, and
+// compositing scales it up over the whole image. This is adjusted from GPU
+// frame times by `g_render_scale_controller`, unless it is set explicitly.
+inline constinit float g_render_scale = 1.f;
+
+// The largest scale whose render extent fits the attachments at the
+// swapchain's size.
+[[nodiscard]]
+inline auto get_max_render_scale() -> float {
+    auto const width = static_cast<float>(g_swapchain.extent.width);
+    auto const height = static_cast<float>(g_swapchain.extent.height);
+    return std::min(static_cast<float>(max_render_width) / width,
+                    static_cast<float>(max_render_height) / height);
+}
+
+[[nodiscard]]
+inline auto get_render_extent() -> vk::Extent2D {
+    auto const width = static_cast<float>(g_swapchain.extent.width);
+    auto const height = static_cast<float>(g_swapchain.extent.height);
+    // Swapchains too large for the attachments at this scale are rendered at
+    // a smaller one, which keeps their aspect ratio.
+    float const scale = std::min(g_render_scale, get_max_render_scale());
+    return {std::max(static_cast<std::uint32_t>(width * scale), 1u),
+            std::max(static_cast<std::uint32_t>(height * scale), 1u)};
+}
+
 // TODO: Dynamically select a supported depth format.
 inline constexpr auto depth_format = vk::Format::eD24UnormS8Uint;
 
-inline vku::GenericBuffer g_device_local_buffer;
+inline device_buffer g_device_local_buffer;
+
+// Extra bytes to allocate whenever `g_device_local_buffer` grows, so that
+// growing scenes do not reallocate it every frame. This is set by
+// `BINDLESS_HEADROOM` in `../CMakeLists.txt`.
+inline constexpr std::size_t device_buffer_headroom = bindless_headroom;
 inline vku::GenericBuffer g_instance_properties;
-inline constinit unsigned g_next_instance_id;
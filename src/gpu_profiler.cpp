@@ -0,0 +1,323 @@
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+namespace {
+constexpr std::uint32_t no_parent = 0xFFFFFFFFu;
+constexpr std::uint32_t dropped_scope = 0xFFFFFFFFu;
+
+void add_statistics(gpu_scope_stats& sum, gpu_scope_stats const& stats) {
+    sum.vertex_invocations += stats.vertex_invocations;
+    sum.clipping_invocations += stats.clipping_invocations;
+    sum.clipping_primitives += stats.clipping_primitives;
+    sum.fragment_invocations += stats.fragment_invocations;
+}
+
+}  // namespace
+
+void gpu_profiler::create() {
+    vk::PhysicalDevice const physical_device(g_physical_device.physical_device);
+    std::uint32_t const valid_bits =
+        physical_device.getQueueFamilyProperties()[g_graphics_queues_index]
+            .timestampValidBits;
+    if (valid_bits == 0) {
+        return;
+    }
+    m_timestamp_mask = (valid_bits == 64) ? ~0ull : ((1ull << valid_bits) - 1);
+    m_nanoseconds_per_tick =
+        g_physical_device.properties.limits.timestampPeriod;
+
+    // Each scope writes a timestamp at its beginning and its end.
+    vk::QueryPoolCreateInfo timestamps_info;
+    timestamps_info.setQueryType(vk::QueryType::eTimestamp)
+        .setQueryCount(max_frames_in_flight * max_scopes * 2);
+    m_timestamps = g_device.createQueryPool(timestamps_info);
+
+    // Results are laid out in the order of these bits.
+    if (g_has_pipeline_statistics) {
+        vk::QueryPoolCreateInfo statistics_info;
+        statistics_info.setQueryType(vk::QueryType::ePipelineStatistics)
+            .setQueryCount(max_frames_in_flight * max_segments)
+            .setPipelineStatistics(
+                vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+                vk::QueryPipelineStatisticFlagBits::eClippingInvocations |
+                vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+                vk::QueryPipelineStatisticFlagBits::
+                    eFragmentShaderInvocations);
+        m_statistics = g_device.createQueryPool(statistics_info);
+    }
+
+    for (frame_record& record : m_frames) {
+        record.scopes.reserve(max_scopes);
+        record.segment_scopes.reserve(max_segments);
+    }
+    m_scope_stack.reserve(max_scopes);
+    m_timestamp_results.resize(max_scopes * 2);
+    m_statistic_results.resize(max_segments * statistic_count);
+    m_resolved.reserve(max_scopes);
+    m_trace.reserve(max_trace_events);
+    m_is_aligned = calibrate();
+    m_is_enabled = true;
+}
+
+void gpu_profiler::destroy() {
+    if (!m_is_enabled) {
+        return;
+    }
+    g_device.destroy(m_timestamps);
+    if (m_statistics) {
+        g_device.destroy(m_statistics);
+    }
+    m_is_enabled = false;
+}
+
+auto gpu_profiler::calibrate() -> bool {
+#ifdef __linux__
+    if (!g_has_calibrated_timestamps) {
+        return false;
+    }
+    std::uint32_t domain_count = 0;
+    vulk.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(
+        g_physical_device.physical_device, &domain_count, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domain_count);
+    vulk.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(
+        g_physical_device.physical_device, &domain_count, domains.data());
+    if (!std::ranges::contains(domains, VK_TIME_DOMAIN_DEVICE_EXT) ||
+        !std::ranges::contains(domains, VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT)) {
+        return false;
+    }
+
+    // `steady_clock` is `CLOCK_MONOTONIC` on Linux.
+    std::array<VkCalibratedTimestampInfoEXT, 2> infos{};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+    std::array<std::uint64_t, 2> timestamps;
+    std::uint64_t max_deviation;
+    if (vulk.vkGetCalibratedTimestampsEXT(
+            g_device, static_cast<std::uint32_t>(infos.size()), infos.data(),
+            timestamps.data(), &max_deviation) != VK_SUCCESS) {
+        return false;
+    }
+    m_cpu_offset_nanoseconds =
+        static_cast<std::int64_t>(timestamps[1]) -
+        static_cast<std::int64_t>(static_cast<double>(timestamps[0]) *
+                                  m_nanoseconds_per_tick);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void gpu_profiler::begin_frame(vk::CommandBuffer cmd, std::size_t frame) {
+    if (!m_is_enabled) {
+        return;
+    }
+    assert(m_scope_stack.empty());
+
+    read_back(frame);
+    m_frames[frame].begin_nanoseconds = get_profiler_time();
+    m_frames[frame].scopes.clear();
+    m_frames[frame].segment_scopes.clear();
+    m_frame = static_cast<std::uint32_t>(frame);
+
+    cmd.resetQueryPool(m_timestamps, m_frame * max_scopes * 2, max_scopes * 2);
+    if (m_statistics) {
+        cmd.resetQueryPool(m_statistics, m_frame * max_segments, max_segments);
+    }
+}
+
+void gpu_profiler::begin_scope(vk::CommandBuffer cmd, std::string_view name,
+                               std::uint32_t index) {
+    if (!m_is_enabled) {
+        return;
+    }
+    frame_record& record = m_frames[m_frame];
+    if (record.scopes.size() == max_scopes) {
+        m_scope_stack.push_back(dropped_scope);
+        return;
+    }
+
+    auto const scope = static_cast<std::uint32_t>(record.scopes.size());
+    record.scopes.push_back(
+        {.name = name,
+         .index = index,
+         .parent = m_scope_stack.empty() ? no_parent : m_scope_stack.back()});
+
+    if (m_statistics) {
+        if (!m_scope_stack.empty()) {
+            cmd.endQuery(m_statistics, get_last_segment_query());
+        }
+        begin_segment(cmd, scope);
+    }
+    m_scope_stack.push_back(scope);
+
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_timestamps,
+                       (m_frame * max_scopes * 2) + (scope * 2));
+}
+
+void gpu_profiler::end_scope(vk::CommandBuffer cmd) {
+    if (!m_is_enabled) {
+        return;
+    }
+    std::uint32_t const scope = m_scope_stack.back();
+    m_scope_stack.pop_back();
+    if (scope == dropped_scope) {
+        return;
+    }
+
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_timestamps,
+                       (m_frame * max_scopes * 2) + (scope * 2) + 1);
+
+    if (m_statistics) {
+        cmd.endQuery(m_statistics, get_last_segment_query());
+        if (!m_scope_stack.empty()) {
+            begin_segment(cmd, m_scope_stack.back());
+        }
+    }
+}
+
+void gpu_profiler::begin_segment(vk::CommandBuffer cmd, std::uint32_t scope) {
+    frame_record& record = m_frames[m_frame];
+    assert(record.segment_scopes.size() < max_segments);
+    record.segment_scopes.push_back(scope);
+    cmd.beginQuery(m_statistics, get_last_segment_query(), {});
+}
+
+void gpu_profiler::read_back(std::size_t frame) {
+    frame_record const& record = m_frames[frame];
+    if (record.scopes.empty()) {
+        return;
+    }
+    auto const index = static_cast<std::uint32_t>(frame);
+    auto const scope_count = static_cast<std::uint32_t>(record.scopes.size());
+    auto const segment_count =
+        static_cast<std::uint32_t>(record.segment_scopes.size());
+
+    // Results which are not ready are dropped rather than waited for.
+    vk::Result result = g_device.getQueryPoolResults(
+        m_timestamps, index * max_scopes * 2, scope_count * 2,
+        scope_count * 2 * sizeof(std::uint64_t), m_timestamp_results.data(),
+        sizeof(std::uint64_t), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess) {
+        return;
+    }
+    if (m_statistics) {
+        result = g_device.getQueryPoolResults(
+            m_statistics, index * max_segments, segment_count,
+            segment_count * statistic_count * sizeof(std::uint64_t),
+            m_statistic_results.data(),
+            statistic_count * sizeof(std::uint64_t),
+            vk::QueryResultFlagBits::e64);
+        if (result != vk::Result::eSuccess) {
+            return;
+        }
+    }
+
+    m_resolved.assign(scope_count, {});
+    for (std::uint32_t i = 0; i < scope_count; ++i) {
+        std::uint64_t const ticks = (m_timestamp_results[(i * 2) + 1] -
+                                     m_timestamp_results[i * 2]) &
+                                    m_timestamp_mask;
+        m_resolved[i].milliseconds =
+            static_cast<double>(ticks) * m_nanoseconds_per_tick / 1e6;
+    }
+
+    // A scope's own queries only counted while none of its children ran, so
+    // children are added into their parents, which come before them.
+    for (std::uint32_t i = 0; i < segment_count; ++i) {
+        std::uint64_t const* p_values =
+            &m_statistic_results[i * statistic_count];
+        add_statistics(m_resolved[record.segment_scopes[i]],
+                       {.vertex_invocations = static_cast<double>(p_values[0]),
+                        .clipping_invocations =
+                            static_cast<double>(p_values[1]),
+                        .clipping_primitives = static_cast<double>(p_values[2]),
+                        .fragment_invocations =
+                            static_cast<double>(p_values[3])});
+    }
+    for (std::uint32_t i = scope_count; i-- > 0;) {
+        if (record.scopes[i].parent != no_parent) {
+            add_statistics(m_resolved[record.scopes[i].parent], m_resolved[i]);
+        }
+    }
+
+    if (!m_is_aligned) {
+        m_cpu_offset_nanoseconds =
+            static_cast<std::int64_t>(record.begin_nanoseconds) -
+            static_cast<std::int64_t>(
+                static_cast<double>(m_timestamp_results[0]) *
+                m_nanoseconds_per_tick);
+        m_is_aligned = true;
+    }
+    m_last_frame_milliseconds = m_resolved[0].milliseconds;
+    ++m_read_back_count;
+    for (std::uint32_t i = 0; i < scope_count; ++i) {
+        scope_record const& scope = record.scopes[i];
+
+        auto history = std::ranges::find_if(m_history, [&](auto const& entry) {
+            return entry.name == scope.name && entry.index == scope.index;
+        });
+        if (history == m_history.end()) {
+            history = m_history.insert(
+                m_history.end(),
+                {.name = scope.name, .index = scope.index, .sample_count = 0});
+        }
+        history->samples[history->sample_count % rolling_frame_count] =
+            m_resolved[i];
+        ++history->sample_count;
+
+        gpu_trace_event const event = {
+            .name = scope.name,
+            .index = scope.index,
+            .begin_nanoseconds = get_cpu_time(m_timestamp_results[i * 2]),
+            .duration_nanoseconds =
+                static_cast<std::uint64_t>(m_resolved[i].milliseconds * 1e6),
+            .stats = m_resolved[i],
+        };
+        if (m_trace.size() < max_trace_events) {
+            m_trace.push_back(event);
+        } else {
+            m_trace[m_trace_next] = event;
+        }
+        m_trace_next = (m_trace_next + 1) % max_trace_events;
+    }
+}
+
+auto gpu_profiler::get_averages() const -> std::vector<gpu_scope_average> {
+    std::vector<gpu_scope_average> averages;
+    averages.reserve(m_history.size());
+    for (scope_history const& history : m_history) {
+        std::size_t const count =
+            std::min(history.sample_count, rolling_frame_count);
+        gpu_scope_stats sum{};
+        for (std::size_t i = 0; i < count; ++i) {
+            sum.milliseconds += history.samples[i].milliseconds;
+            add_statistics(sum, history.samples[i]);
+        }
+        auto const n = static_cast<double>(count);
+        averages.push_back(
+            {.name = history.name,
+             .index = history.index,
+             .stats = {.milliseconds = sum.milliseconds / n,
+                       .vertex_invocations = sum.vertex_invocations / n,
+                       .clipping_invocations = sum.clipping_invocations / n,
+                       .clipping_primitives = sum.clipping_primitives / n,
+                       .fragment_invocations = sum.fragment_invocations / n}});
+    }
+    return averages;
+}
+
+auto gpu_profiler::get_trace() const -> std::vector<gpu_trace_event> {
+    std::vector<gpu_trace_event> trace;
+    trace.reserve(m_trace.size());
+    std::size_t const first =
+        (m_trace.size() < max_trace_events) ? 0 : m_trace_next;
+    for (std::size_t i = 0; i < m_trace.size(); ++i) {
+        trace.push_back(m_trace[(first + i) % m_trace.size()]);
+    }
+    return trace;
+}
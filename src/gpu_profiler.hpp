@@ -0,0 +1,196 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "defer.hpp"
+#include "globals.hpp"
+
+// What a scope of GPU commands took, which statistics are only counted for
+// when `g_has_pipeline_statistics` is set.
+struct gpu_scope_stats {
+    double milliseconds;
+    double vertex_invocations;
+    double clipping_invocations;
+    double clipping_primitives;
+    double fragment_invocations;
+};
+
+// Scopes which share a name, such as one per light, are told apart by this.
+inline constexpr std::uint32_t no_scope_index = 0xFFFFFFFFu;
+
+struct gpu_scope_average {
+    std::string_view name;
+    std::uint32_t index;
+    gpu_scope_stats stats;
+};
+
+// A scope of a frame which was read back. Its times are on the same clock as
+// `get_profiler_time()`.
+struct gpu_trace_event {
+    std::string_view name;
+    std::uint32_t index;
+    std::uint64_t begin_nanoseconds;
+    std::uint64_t duration_nanoseconds;
+    gpu_scope_stats stats;
+};
+
+// Times named scopes of command buffers with timestamp queries, and counts
+// their pipeline statistics. Each frame in flight has its own queries, which
+// are read back without waiting when that frame is recorded again, so results
+// trail by `g_frames_in_flight` frames, and frames whose results are not ready
+// yet are skipped.
+class gpu_profiler {
+  public:
+    // This does nothing if the graphics queue cannot write timestamps.
+    void create();
+
+    void destroy();
+
+    // Read back what frame `frame`'s command buffer last recorded, then reset
+    // its queries with `cmd`. This must be recorded before any scope.
+    void begin_frame(vk::CommandBuffer cmd, std::size_t frame);
+
+    // Scopes nest, and must not straddle a render pass instance. `name` must
+    // outlive the profiler. A frame's scopes past `max_scopes` are not
+    // profiled, and their commands count towards their parent scope.
+    void begin_scope(vk::CommandBuffer cmd, std::string_view name,
+                     std::uint32_t index = no_scope_index);
+    void end_scope(vk::CommandBuffer cmd);
+
+    // The mean of every scope over the last `rolling_frame_count` frames which
+    // were read back.
+    [[nodiscard]]
+    auto get_averages() const -> std::vector<gpu_scope_average>;
+
+    // Forget every scope's samples, so that averages only cover frames read
+    // back from here on.
+    void clear_averages() {
+        m_history.clear();
+    }
+
+    // How long the GPU took for the outermost scope of the newest frame which
+    // was read back.
+    [[nodiscard]]
+    auto get_last_frame_milliseconds() const -> double {
+        return m_last_frame_milliseconds;
+    }
+
+    // How many frames were read back, which tells callers whether
+    // `.get_last_frame_milliseconds()` changed since they last looked.
+    [[nodiscard]]
+    auto get_read_back_count() const -> std::size_t {
+        return m_read_back_count;
+    }
+
+    // The scopes of recent frames, from oldest to newest.
+    [[nodiscard]]
+    auto get_trace() const -> std::vector<gpu_trace_event>;
+
+    static constexpr std::size_t rolling_frame_count = 64;
+
+    static constexpr std::uint32_t max_scopes = 64;
+
+  private:
+    // A scope pauses its parent's statistics query, and resumes it after.
+    static constexpr std::uint32_t max_segments = max_scopes * 2;
+    static constexpr std::uint32_t statistic_count = 4;
+    static constexpr std::size_t max_trace_events = 16'384;
+
+    struct scope_record {
+        std::string_view name;
+        std::uint32_t index;
+        std::uint32_t parent;
+    };
+
+    // What was recorded into one frame's command buffer.
+    struct frame_record {
+        // When recording began, on the CPU.
+        std::uint64_t begin_nanoseconds;
+        std::vector<scope_record> scopes;
+        // The scope which each statistics query counted.
+        std::vector<std::uint32_t> segment_scopes;
+    };
+
+    struct scope_history {
+        std::string_view name;
+        std::uint32_t index;
+        std::array<gpu_scope_stats, rolling_frame_count> samples;
+        std::size_t sample_count;
+    };
+
+    void read_back(std::size_t frame);
+
+    // Find the difference between GPU timestamps and `get_profiler_time()`
+    // with `VK_EXT_calibrated_timestamps`, if the device supports it on the
+    // monotonic clock.
+    [[nodiscard]]
+    auto calibrate() -> bool;
+
+    // A GPU timestamp on the CPU's clock.
+    [[nodiscard]]
+    auto get_cpu_time(std::uint64_t timestamp) const -> std::uint64_t {
+        return static_cast<std::uint64_t>(
+            static_cast<std::int64_t>(static_cast<double>(timestamp) *
+                                      m_nanoseconds_per_tick) +
+            m_cpu_offset_nanoseconds);
+    }
+
+    // Begin counting statistics for `scope` in a new query.
+    void begin_segment(vk::CommandBuffer cmd, std::uint32_t scope);
+
+    // The statistics query of the current frame's last segment.
+    [[nodiscard]]
+    auto get_last_segment_query() const -> std::uint32_t {
+        return (m_frame * max_segments) +
+               static_cast<std::uint32_t>(
+                   m_frames[m_frame].segment_scopes.size()) -
+               1;
+    }
+
+    bool m_is_enabled = false;
+    double m_nanoseconds_per_tick;
+    std::uint64_t m_timestamp_mask;
+
+    vk::QueryPool m_timestamps;
+    vk::QueryPool m_statistics;
+
+    std::array<frame_record, max_frames_in_flight> m_frames;
+    std::uint32_t m_frame = 0;
+    // Scopes which were not profiled are `dropped_scope` here.
+    std::vector<std::uint32_t> m_scope_stack;
+
+    // These are reused by each read back.
+    std::vector<std::uint64_t> m_timestamp_results;
+    std::vector<std::uint64_t> m_statistic_results;
+    std::vector<gpu_scope_stats> m_resolved;
+
+    std::vector<scope_history> m_history;
+    double m_last_frame_milliseconds = 0;
+    std::size_t m_read_back_count = 0;
+
+    // This is a ring of the most recent events.
+    std::vector<gpu_trace_event> m_trace;
+    std::size_t m_trace_next = 0;
+
+    // Added to GPU times to put them on the CPU's clock. Without calibration,
+    // this is estimated by aligning the first frame read back with the start
+    // of its recording.
+    std::int64_t m_cpu_offset_nanoseconds = 0;
+    bool m_is_aligned = false;
+};
+
+inline gpu_profiler g_gpu_profiler;
+
+// Profile the rest of the enclosing block of commands recorded into `cmd`.
+#define gpu_scope(cmd, ...)                       \
+    g_gpu_profiler.begin_scope(cmd, __VA_ARGS__); \
+    defer {                                       \
+        g_gpu_profiler.end_scope(cmd);            \
+    }
@@ -0,0 +1,127 @@
+#include "headless.hpp"
+
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <limits>
+
+#include "device_buffer.hpp"
+
+namespace {
+struct offscreen_image {
+    vk::UniqueImage image;
+    vk::UniqueDeviceMemory memory;
+    vk::UniqueImageView view;
+};
+
+std::array<offscreen_image, max_frames_in_flight> g_offscreen_images;
+
+constexpr std::size_t bytes_per_pixel = 4;
+}  // namespace
+
+void create_offscreen_images() {
+    g_swapchain.extent = VkExtent2D{game_width, game_height};
+    g_swapchain.image_format = static_cast<VkFormat>(offscreen_format);
+    g_swapchain.image_count = max_frames_in_flight;
+    g_swapchain_images.clear();
+    g_swapchain_views.clear();
+
+    for (offscreen_image& offscreen : g_offscreen_images) {
+        // Frames are upscaled into these, and copied out of them to be
+        // dumped.
+        vk::ImageCreateInfo image_info;
+        image_info.setImageType(vk::ImageType::e2D)
+            .setFormat(offscreen_format)
+            .setExtent({game_width, game_height, 1})
+            .setMipLevels(1)
+            .setArrayLayers(1)
+            .setUsage(vk::ImageUsageFlagBits::eColorAttachment |
+                      vk::ImageUsageFlagBits::eTransferSrc);
+        offscreen.image = g_device.createImageUnique(image_info);
+
+        vk::MemoryRequirements const requirements =
+            g_device.getImageMemoryRequirements(*offscreen.image);
+        vk::MemoryAllocateInfo allocate_info;
+        allocate_info.setAllocationSize(requirements.size)
+            .setMemoryTypeIndex(find_memory_type(
+                requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal));
+        offscreen.memory = g_device.allocateMemoryUnique(allocate_info);
+        g_device.bindImageMemory(*offscreen.image, *offscreen.memory, 0);
+
+        vk::ImageViewCreateInfo view_info;
+        view_info.setImage(*offscreen.image)
+            .setViewType(vk::ImageViewType::e2D)
+            .setFormat(offscreen_format)
+            .setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+        offscreen.view = g_device.createImageViewUnique(view_info);
+
+        g_swapchain_images.push_back(static_cast<VkImage>(*offscreen.image));
+        g_swapchain_views.push_back(static_cast<VkImageView>(*offscreen.view));
+    }
+}
+
+void destroy_offscreen_images() {
+    g_swapchain_images.clear();
+    g_swapchain_views.clear();
+    g_offscreen_images = {};
+}
+
+void render_offscreen(unsigned frame) {
+    constexpr auto timeout = std::numeric_limits<std::uint64_t>::max();
+    auto _ =
+        g_device.waitForFences(g_in_flight_fences[frame], vk::True, timeout);
+
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBuffers(g_command_buffers[frame]);
+    g_device.resetFences({g_in_flight_fences[frame]});
+    g_graphics_queue.submit(submit_info, g_in_flight_fences[frame]);
+}
+
+void dump_offscreen_image(unsigned frame, std::filesystem::path const& path) {
+    constexpr auto timeout = std::numeric_limits<std::uint64_t>::max();
+    auto _ =
+        g_device.waitForFences(g_in_flight_fences[frame], vk::True, timeout);
+
+    device_buffer const readback(vk::BufferUsageFlagBits::eTransferDst,
+                                 std::size_t{game_width} * game_height *
+                                     bytes_per_pixel,
+                                 vk::MemoryPropertyFlagBits::eHostVisible |
+                                     vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    // `record_compositing()` leaves headless images ready to be copied from.
+    vk::BufferImageCopy region;
+    region.setImageSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1})
+        .setImageExtent({game_width, game_height, 1});
+
+    vk::MemoryBarrier host_barrier;
+    host_barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eHostRead);
+
+    vk::CommandBuffer const cmd = g_upload_command_buffer;
+    cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    cmd.copyImageToBuffer(vk::Image(g_swapchain_images[frame]),
+                          vk::ImageLayout::eTransferSrcOptimal,
+                          readback.buffer(), region);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eHost, {}, host_barrier, {},
+                        {});
+    cmd.end();
+
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBuffers(cmd);
+    g_graphics_queue.submit(submit_info);
+    g_graphics_queue.waitIdle();
+
+    // PPM stores RGB, while images are BGRA.
+    auto const* const p_pixels = static_cast<std::byte const*>(readback.map());
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << game_width << ' ' << game_height << "\n255\n";
+    for (std::size_t i = 0; i < std::size_t{game_width} * game_height; ++i) {
+        std::byte const* const p_pixel = p_pixels + (i * bytes_per_pixel);
+        std::array const rgb = {static_cast<char>(p_pixel[2]),
+                                static_cast<char>(p_pixel[1]),
+                                static_cast<char>(p_pixel[0])};
+        file.write(rgb.data(), rgb.size());
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <filesystem>
+
+#include "globals.hpp"
+
+// Headless frames are composited into images of this format, which is what
+// `vkb::SwapchainBuilder` prefers for windows.
+inline constexpr auto offscreen_format = vk::Format::eB8G8R8A8Srgb;
+
+// Create an image for each frame in flight to stand in for the swapchain's,
+// and point `g_swapchain_images` and `g_swapchain_views` at them.
+void create_offscreen_images();
+void destroy_offscreen_images();
+
+// Submit frame `frame`'s command buffer like `submit_and_present()`, without
+// acquiring or presenting a swapchain image.
+void render_offscreen(unsigned frame);
+
+// Write frame `frame`'s image as a binary PPM, once its commands finish.
+void dump_offscreen_image(unsigned frame, std::filesystem::path const& path);
@@ -0,0 +1,36 @@
+// This is included by both `bindless.hpp` and `shaders.slang` to keep their
+// instance property layouts in sync. Constants are declared through
+// `LAYOUT_CONSTANT`, so that C++ sees `inline constexpr` variables rather than
+// macros, and Slang sees `static const` globals.
+#pragma once
+
+#ifdef __cplusplus
+#include <cstdint>
+#define LAYOUT_CONSTANT(type) inline constexpr type
+#define LAYOUT_UINT std::uint32_t
+#else
+#define LAYOUT_CONSTANT(type) static const type
+#define LAYOUT_UINT uint
+#endif
+
+// Byte offsets of each member of `buffer_storage::property`. When
+// `soa_instances` is defined, each member is instead an array beginning at its
+// offset multiplied by the instance count.
+LAYOUT_CONSTANT(LAYOUT_UINT) property_position_offset = 0;
+LAYOUT_CONSTANT(LAYOUT_UINT) property_rotation_offset = 12;
+LAYOUT_CONSTANT(LAYOUT_UINT) property_scaling_offset = 16;
+LAYOUT_CONSTANT(LAYOUT_UINT) property_color_blend_offset = 28;
+LAYOUT_CONSTANT(LAYOUT_UINT) property_id_offset = 32;
+LAYOUT_CONSTANT(LAYOUT_UINT) property_mesh_index_offset = 36;
+LAYOUT_CONSTANT(LAYOUT_UINT) property_texture_index_offset = 40;
+LAYOUT_CONSTANT(LAYOUT_UINT) property_size = 44;
+
+// Instances with this texture index are not textured.
+LAYOUT_CONSTANT(LAYOUT_UINT) no_texture_index = 0xFFFFFFFFu;
+
+// Color blends are stored as signed-normalized 8-bit components, divided by
+// this to fit blends from -2 to 2.
+LAYOUT_CONSTANT(float) color_blend_range = 2.0f;
+
+#undef LAYOUT_CONSTANT
+#undef LAYOUT_UINT
@@ -0,0 +1,164 @@
+#include "jobs.hpp"
+
+#include <cassert>
+
+#include "cpu_profiler.hpp"
+
+namespace {
+// Threads which are not workers, such as the main thread, share worker 0's
+// deque.
+thread_local constinit unsigned g_worker_index = 0;
+}  // namespace
+
+void job_system::start(unsigned thread_count) {
+    assert(m_queues.empty());
+    thread_count = std::max(thread_count, 1u);
+
+    for (unsigned i = 0; i < thread_count; ++i) {
+        m_queues.push_back(std::make_unique<worker_queue>());
+    }
+
+    m_is_running = true;
+    for (unsigned i = 1; i < thread_count; ++i) {
+        m_threads.emplace_back([this, i] {
+            work(i);
+        });
+    }
+}
+
+void job_system::stop() {
+    {
+        std::lock_guard const lock(m_sleep_mutex);
+        m_is_running = false;
+    }
+    m_wake.notify_all();
+
+    // `std::jthread` joins when it is destroyed.
+    m_threads.clear();
+    m_queues.clear();
+}
+
+void job_system::worker_queue::push_back(queued_job const& job) {
+    if (count == jobs.size()) {
+        // Unwrap the jobs into a larger buffer.
+        std::vector<queued_job> grown(std::max(jobs.size() * 2, 64uz));
+        for (std::size_t i = 0; i < count; ++i) {
+            grown[i] = jobs[(first + i) % jobs.size()];
+        }
+        jobs = std::move(grown);
+        first = 0;
+    }
+    jobs[(first + count) % jobs.size()] = job;
+    ++count;
+}
+
+void job_system::push(queued_job const& job) {
+    job.p_counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    // Without workers, there is nowhere to queue this.
+    if (m_queues.empty()) {
+        queued_job now = job;
+        run(now);
+        return;
+    }
+
+    worker_queue& queue = *m_queues[g_worker_index];
+    {
+        std::lock_guard const lock(queue.mutex);
+        queue.push_back(job);
+    }
+    m_queued_count.fetch_add(1, std::memory_order_release);
+
+    // Locking here prevents a worker from missing this wake-up between
+    // checking `m_queued_count` and sleeping.
+    {
+        std::lock_guard const lock(m_sleep_mutex);
+    }
+    m_wake.notify_one();
+}
+
+void job_system::wait(job_counter const& counter) {
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        queued_job job;
+        if (try_take(g_worker_index, job)) {
+            run(job);
+            continue;
+        }
+
+        // The counter's last jobs run on other workers, so sleep until they
+        // finish, or until there is another job to help with.
+        std::unique_lock lock(m_sleep_mutex);
+        m_wake.wait(lock, [&] {
+            return counter.pending.load(std::memory_order_acquire) == 0 ||
+                   m_queued_count.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
+
+auto job_system::try_take(unsigned worker, queued_job& job) -> bool {
+    if (m_queued_count.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+
+    // The newest job in this worker's deque is the most likely to be in cache.
+    {
+        worker_queue& queue = *m_queues[worker];
+        std::lock_guard const lock(queue.mutex);
+        if (queue.count > 0) {
+            job = queue.pop_back();
+            m_queued_count.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Steal the oldest job from the next worker that has one.
+    auto const worker_count = static_cast<unsigned>(m_queues.size());
+    for (unsigned i = 1; i < worker_count; ++i) {
+        worker_queue& victim = *m_queues[(worker + i) % worker_count];
+        std::lock_guard const lock(victim.mutex);
+        if (victim.count > 0) {
+            job = victim.pop_front();
+            m_queued_count.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void job_system::run(queued_job& job) {
+    cpu_zone("job");
+    job.p_run(job.p_job, job.begin, job.end);
+    if (job.p_counter->pending.fetch_sub(1, std::memory_order_acq_rel) > 1) {
+        return;
+    }
+
+    // Wake the thread waiting on this counter. The counter may already be
+    // gone, so only the sleep mutex is touched from here. Locking prevents
+    // the waiter from missing this between checking the counter and sleeping.
+    {
+        std::lock_guard const lock(m_sleep_mutex);
+    }
+    m_wake.notify_all();
+}
+
+void job_system::work(unsigned worker) {
+    g_worker_index = worker;
+
+    while (true) {
+        queued_job job;
+        if (try_take(worker, job)) {
+            run(job);
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_wake.wait(lock, [this] {
+            return !m_is_running ||
+                   m_queued_count.load(std::memory_order_acquire) > 0;
+        });
+        if (!m_is_running &&
+            m_queued_count.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the jobs submitted against it which have not finished yet.
+struct job_counter {
+    std::atomic<unsigned> pending = 0;
+};
+
+// A work-stealing scheduler. Every worker thread owns a deque, which it pushes
+// and pops jobs at the back of, and idle workers steal the oldest jobs from the
+// front of other workers' deques. The thread which calls `.start()` is worker
+// 0, and it runs jobs while it waits on them.
+class job_system {
+  public:
+    // `thread_count` includes the calling thread.
+    void start(unsigned thread_count);
+
+    // Finish every queued job, then join the worker threads.
+    void stop();
+
+    // Queue `job(begin, end)` to run on any worker. `job` is not copied, so it
+    // must outlive waiting on `counter`. This does not allocate.
+    template <typename F>
+    void submit(F& job, std::size_t begin, std::size_t end,
+                job_counter& counter) {
+        push({
+            .p_run =
+                [](void* p_job, std::size_t begin, std::size_t end) {
+                    (*static_cast<F*>(p_job))(begin, end);
+                },
+            .p_job = const_cast<void*>(static_cast<void const*>(&job)),
+            .begin = begin,
+            .end = end,
+            .p_counter = &counter,
+        });
+    }
+
+    // Run queued jobs until every job counted by `counter` has finished, and
+    // sleep while the rest run on other workers.
+    void wait(job_counter const& counter);
+
+    [[nodiscard]]
+    auto get_worker_count() const -> unsigned {
+        return static_cast<unsigned>(std::max(m_queues.size(), 1uz));
+    }
+
+    // The number of chunks that `.parallel_for()` splits a loop into.
+    [[nodiscard]]
+    static constexpr auto get_chunk_count(std::size_t count, std::size_t grain)
+        -> std::size_t {
+        return (count + grain - 1) / grain;
+    }
+
+    // Call `body(begin, end)` for each chunk of `grain` indices up to `count`,
+    // in parallel, and wait for them all. The chunk's index is `begin /
+    // grain`. Loops of one chunk run on the calling thread.
+    template <typename F>
+    void parallel_for(std::size_t count, std::size_t grain, F&& body) {
+        if (count <= grain || get_worker_count() == 1) {
+            if (count > 0) {
+                body(0uz, count);
+            }
+            return;
+        }
+
+        job_counter counter;
+        for (std::size_t begin = grain; begin < count; begin += grain) {
+            submit(body, begin, std::min(begin + grain, count), counter);
+        }
+
+        // The calling thread takes the first chunk.
+        body(0uz, grain);
+        wait(counter);
+    }
+
+  private:
+    struct queued_job {
+        void (*p_run)(void* p_job, std::size_t begin, std::size_t end);
+        void* p_job;
+        std::size_t begin;
+        std::size_t end;
+        job_counter* p_counter;
+    };
+
+    // A ring buffer, which only allocates when it grows past its largest size
+    // so far.
+    struct worker_queue {
+        std::mutex mutex;
+        std::vector<queued_job> jobs;
+        std::size_t first = 0;
+        std::size_t count = 0;
+
+        void push_back(queued_job const& job);
+
+        [[nodiscard]]
+        auto pop_back() -> queued_job {
+            --count;
+            return jobs[(first + count) % jobs.size()];
+        }
+
+        [[nodiscard]]
+        auto pop_front() -> queued_job {
+            queued_job const job = jobs[first];
+            first = (first + 1) % jobs.size();
+            --count;
+            return job;
+        }
+    };
+
+    void push(queued_job const& job);
+
+    // Pop from `worker`'s own deque, or else steal from another.
+    [[nodiscard]]
+    auto try_take(unsigned worker, queued_job& job) -> bool;
+
+    void run(queued_job& job);
+
+    void work(unsigned worker);
+
+    // `worker_queue` cannot be moved, because of its mutex.
+    std::vector<std::unique_ptr<worker_queue>> m_queues;
+    std::vector<std::jthread> m_threads;
+
+    // Idle workers sleep until a job is queued, and threads waiting on a
+    // counter also until its last job finishes.
+    std::atomic<unsigned> m_queued_count = 0;
+    std::atomic<bool> m_is_running = false;
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+};
+
+inline job_system g_jobs;
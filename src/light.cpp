@@ -1 +1,124 @@
 #include "light.hpp"
+
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+#include "cpu_profiler.hpp"
+#include "vulkan_flow.hpp"
+
+namespace {
+using frustum_corners = std::array<glm::vec3, 8>;
+
+// The corners of the frustum which `view_proj` projects into clip space.
+auto get_frustum_corners(glm::mat4x4 const& view_proj) -> frustum_corners {
+    glm::mat4x4 const inverse = glm::inverse(view_proj);
+    frustum_corners corners;
+    for (std::size_t i = 0; i < corners.size(); ++i) {
+        glm::vec4 const corner =
+            inverse * glm::vec4((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f,
+                                (i & 4) ? 1.f : 0.f, 1.f);
+        corners[i] = glm::vec3(corner) / corner.w;
+    }
+    return corners;
+}
+
+// Whether every corner is outside of the same clip plane of `view_proj`, which
+// means the volume that they bound cannot intersect its frustum.
+auto is_outside_frustum(frustum_corners const& corners,
+                        glm::mat4x4 const& view_proj) -> bool {
+    std::array<glm::vec4, 8> clip;
+    for (std::size_t i = 0; i < corners.size(); ++i) {
+        clip[i] = view_proj * glm::vec4(corners[i], 1.f);
+    }
+    auto const all_outside = [&](auto&& is_outside) {
+        return std::ranges::all_of(clip, is_outside);
+    };
+    return all_outside([](glm::vec4 c) { return c.x < -c.w; }) ||
+           all_outside([](glm::vec4 c) { return c.x > c.w; }) ||
+           all_outside([](glm::vec4 c) { return c.y < -c.w; }) ||
+           all_outside([](glm::vec4 c) { return c.y > c.w; }) ||
+           all_outside([](glm::vec4 c) { return c.z < 0.f; }) ||
+           all_outside([](glm::vec4 c) { return c.z > c.w; });
+}
+}  // namespace
+
+auto light_t::create(light const& value) -> light_handle {
+    std::uint32_t slot;
+    if (m_free_slots.empty()) {
+        assert(m_lights.size() < max_light_count);
+        slot = static_cast<std::uint32_t>(m_lights.size());
+        m_lights.push_back(value);
+        m_generations.push_back(0);
+        m_is_alive.push_back(true);
+        create_maps(slot);
+    } else {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+        m_lights[slot] = value;
+        m_is_alive[slot] = true;
+    }
+    return {.index = slot, .generation = m_generations[slot]};
+}
+
+void light_t::destroy(light_handle handle) {
+    assert(is_alive(handle));
+    m_is_alive[handle.index] = false;
+    ++m_generations[handle.index];
+    m_free_slots.push_back(handle.index);
+}
+
+void light_t::clear() {
+    for (std::uint32_t slot = 0; slot < m_lights.size(); ++slot) {
+        if (m_is_alive[slot]) {
+            destroy({.index = slot, .generation = m_generations[slot]});
+        }
+    }
+    m_visible.clear();
+}
+
+void light_t::cull(glm::mat4x4 const& view_proj) {
+    cpu_zone("cull lights");
+    frustum_corners const camera_corners = get_frustum_corners(view_proj);
+
+    // Either frustum being outside of one of the other's planes separates
+    // them. This keeps some lights which miss the view near its corners.
+    m_visible.clear();
+    for (std::uint32_t slot = 0;
+         slot < m_lights.size() && m_visible.size() < max_visible_light_count;
+         ++slot) {
+        if (!m_is_alive[slot]) {
+            continue;
+        }
+        light const& source = m_lights[slot];
+        glm::mat4x4 const light_view_proj =
+            source.projection * source.transform;
+        if (is_outside_frustum(get_frustum_corners(light_view_proj),
+                               view_proj) ||
+            is_outside_frustum(camera_corners, light_view_proj)) {
+            continue;
+        }
+        m_visible.push_back(source);
+        m_visible.back().map_index = slot;
+    }
+}
+
+void light_t::set_visible(std::span<light const> visible) {
+    m_visible.assign(visible.begin(), visible.end());
+    for (light const& source : visible) {
+        create_maps(source.map_index);
+    }
+}
+
+void light_t::create_maps(std::uint32_t slot) {
+    while (m_maps.size() <= slot) {
+        // Like the G-buffer, maps are rendered within the render extent.
+        m_maps.emplace_back(g_device, g_physical_device.memory_properties,
+                            max_render_width, max_render_height, depth_format);
+        // The binding is partially bound, so only created maps are written,
+        // and each frame slot receives them before its next frame.
+        update_light_map_descriptor(static_cast<unsigned>(m_maps.size() - 1));
+    }
+}
@@ -2,44 +2,103 @@
 
 #include <glm/mat4x4.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <span>
 #include <vector>
 
+#include "bindless.hpp"
 #include "globals.hpp"
 
+// This matches the size of binding 2 of `g_descriptor_layout`, and is set by
+// `MAX_LIGHTS` in `../CMakeLists.txt`.
+inline constexpr std::uint32_t max_light_count = max_lights;
+
+// Culling keeps at most this many visible lights, which is set by
+// `MAX_VISIBLE_LIGHTS` in `../CMakeLists.txt`.
+inline constexpr std::uint32_t max_visible_light_count = max_visible_lights;
+
+// A stable reference to a light in `light_t`, like `instance_handle`.
+struct light_handle {
+    std::uint32_t index;
+    std::uint32_t generation;
+};
+
+// Light sources live in slots, which each own a light map that is kept when
+// the light is destroyed, so that creating lights again reuses maps, and maps
+// are never destroyed while frames in flight sample them. Every frame, only
+// the lights whose frusta intersect the camera's are pushed into the bindless
+// data and get a shadow pass.
 struct light_t {
-    light_t(unsigned capacity) : m_capacity(capacity) {
-        lights.reserve(capacity);
-        light_maps.reserve(capacity);
+    using light = light_record;
+
+    // This writes the descriptor of the light's map if it is new, so
+    // descriptors must already be created.
+    [[nodiscard]]
+    auto create(light const& value) -> light_handle;
+
+    void destroy(light_handle handle);
+
+    [[nodiscard]]
+    auto is_alive(light_handle handle) const -> bool {
+        return handle.index < m_generations.size() &&
+               m_generations[handle.index] == handle.generation &&
+               m_is_alive[handle.index];
     }
 
-    struct light {
-        alignas(16) glm::mat4x4 transform;
-        alignas(16) glm::mat4x4 projection;
-        alignas(16) glm::vec3 position;
-    };
+    void set(light_handle handle, light const& value) {
+        assert(is_alive(handle));
+        m_lights[handle.index] = value;
+    }
+
+    // Destroy every light, but keep their maps.
+    void clear();
+
+    // Find the lights whose frusta intersect the frustum of `view_proj`, up to
+    // `.get_visible_capacity()` of them in slot order.
+    void cull(glm::mat4x4 const& view_proj);
 
+    // Replace the visible lights with a replayed frame's, creating maps for
+    // any slot that they use.
+    void set_visible(std::span<light const> visible);
+
+    // What the last `.cull()` found, with `map_index` set.
     [[nodiscard]]
-    auto size() const -> unsigned {
-        return static_cast<unsigned>(lights.size());
+    auto get_visible() const -> std::span<light const> {
+        return m_visible;
     }
 
+    // How many light maps have been created.
     [[nodiscard]]
-    auto capacity() const -> unsigned {
-        return m_capacity;
+    auto get_slot_count() const -> std::uint32_t {
+        return static_cast<std::uint32_t>(m_maps.size());
     }
 
-    // Create a new light source.
-    void push_back(light const& transform) {
-        lights.push_back(transform);
-        light_maps.emplace_back(g_device, g_physical_device.memory_properties,
-                                game_width, game_height, depth_format);
+    // How many lights can be visible at once, which the bindless data
+    // reserves room for.
+    [[nodiscard]]
+    auto get_visible_capacity() const -> std::uint32_t {
+        return std::min(get_slot_count(), max_visible_light_count);
     }
 
-    std::vector<light> lights;
-    std::vector<vku::DepthStencilImage> light_maps;
+    [[nodiscard]]
+    auto get_map(std::uint32_t slot) -> vku::DepthStencilImage& {
+        return m_maps[slot];
+    }
 
   private:
-    unsigned m_capacity;
+    // Create light maps up to `slot`, and write their descriptors.
+    void create_maps(std::uint32_t slot);
+
+    // These are indexed by slot.
+    std::vector<light> m_lights;
+    std::vector<vku::DepthStencilImage> m_maps;
+    std::vector<std::uint32_t> m_generations;
+    std::vector<bool> m_is_alive;
+
+    std::vector<std::uint32_t> m_free_slots;
+    std::vector<light> m_visible;
 };
 
-inline light_t g_lights(10);
+inline light_t g_lights;
@@ -1,17 +1,43 @@
 #include <vulkan/vulkan.hpp>
 
 #include <VkBootstrap.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
 #include <iostream>
-#include <ktxvulkan.h>
-
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "allocation_counter.hpp"
+#include "arena.hpp"
+#include "benchmark.hpp"
 #include "bindless.hpp"
 #include "camera.hpp"
+#include "cpu_profiler.hpp"
 #include "defer.hpp"
+#include "frame_capture.hpp"
+#include "frame_pacing.hpp"
 #include "geometry.hpp"
 #include "globals.hpp"
+#include "gpu_profiler.hpp"
+#include "headless.hpp"
+#include "jobs.hpp"
 #include "light.hpp"
+#include "render_scale.hpp"
+#include "scene.hpp"
 #include "shader_objects.hpp"
+#include "simulation.hpp"
+#include "texture_loader.hpp"
+#include "texture_residency.hpp"
 #include "vulkan_flow.hpp"
 #include "window.hpp"
 
@@ -21,46 +47,205 @@ extern "C" auto __asan_default_options() -> char const* {  // NOLINT
 }
 
 inline void load_skybox() {
-    ktxTexture2* p_ktx_skybox_data;
-    ktx_error_code_e result;
-    ktxVulkanDeviceInfo vdi;
-
-    ktxVulkanDeviceInfo_Construct(&vdi, g_physical_device, g_device,
-                                  g_graphics_queue, g_command_pool, nullptr);
-
-    result = ktxTexture2_CreateFromNamedFile(
-        (getexepath().parent_path() / "skybox.ktx2").c_str(),
-        KTX_TEXTURE_CREATE_NO_FLAGS, &p_ktx_skybox_data);
-    assert(result == KTX_SUCCESS);
-
-    result = ktxTexture2_VkUploadEx(
-        p_ktx_skybox_data, &vdi, &g_ktx_skybox, VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    assert(result == KTX_SUCCESS);
-
-    ktxTexture2_Destroy(p_ktx_skybox_data);
-    ktxVulkanDeviceInfo_Destruct(&vdi);
-
-    vk::ImageViewCreateInfo skybox_view_info;
-    // Set the non-default values.
-    skybox_view_info.image = g_ktx_skybox.image;
-    skybox_view_info.format = static_cast<vk::Format>(g_ktx_skybox.imageFormat);
-    skybox_view_info.viewType =
-        static_cast<vk::ImageViewType>(g_ktx_skybox.viewType);
-    skybox_view_info.subresourceRange.aspectMask =
-        vk::ImageAspectFlagBits::eColor;
-    skybox_view_info.subresourceRange.layerCount = g_ktx_skybox.layerCount;
-    skybox_view_info.subresourceRange.levelCount = g_ktx_skybox.levelCount;
-    // vk::ImageView skybox_view(view_info);
-    g_skybox_view = g_device.createImageView(skybox_view_info);
-
-    // image_view = vkctx.device.createImageView(viewInfo);
-    // g_skybox = vku::TextureImageCube();
-    // g_physical_device.memory_properties, 0, 0);
-    // g_skybox.update()
+    g_skybox_texture = g_texture_loader.load(
+        getexepath().parent_path() / "skybox.ktx2", vk::ImageViewType::eCube);
+}
+
+struct options {
+    // Without a window, render this many frames and then exit.
+    std::size_t headless_frame_count = 0;
+    // If this is not empty, headless frames are written into it as PPMs.
+    std::filesystem::path dump_directory;
+    // If this is not empty, the benchmark runs headlessly and writes its
+    // results here as JSON.
+    std::filesystem::path benchmark_path;
+    // If this is not empty, every frame is captured into it.
+    std::filesystem::path capture_path;
+    // If this is not empty, its captured frames are replayed headlessly from
+    // `replay_first_frame`.
+    std::filesystem::path replay_path;
+    std::size_t replay_first_frame = 0;
+    // The render scale is adjusted to hold GPU frame times under this, which
+    // defaults to 60 Hz with a window. 0 keeps the scale at 1.
+    std::optional<double> gpu_target_milliseconds;
+    vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
+    // How many frames the CPU may record while the GPU renders earlier ones.
+    // With `--low-latency`, frames also wait for the one before them to be
+    // presented, so more than 2 only costs memory.
+    std::uint32_t frames_in_flight = 2;
+    // Delay each frame's input and simulation with `g_frame_pacer`.
+    bool is_low_latency = false;
+};
+
+[[noreturn]]
+void exit_with_usage() {
+    std::cout << "Usage: game [--headless <frames> [--dump <directory>]] "
+                 "[--benchmark <json>] [--capture <file>] [--replay <file>] "
+                 "[--replay-from <frame>] [--gpu-target <ms>] "
+                 "[--present-mode fifo|mailbox|immediate] "
+                 "[--frames-in-flight 1-"
+              << max_frames_in_flight << "] [--low-latency]\n";
+    std::quick_exit(1);
+}
+
+auto parse_present_mode(std::string_view name) -> vk::PresentModeKHR {
+    if (name == "fifo") {
+        return vk::PresentModeKHR::eFifo;
+    }
+    if (name == "mailbox") {
+        return vk::PresentModeKHR::eMailbox;
+    }
+    if (name == "immediate") {
+        return vk::PresentModeKHR::eImmediate;
+    }
+    exit_with_usage();
 }
 
-auto main() -> int {
+auto parse_options(std::span<char* const> arguments) -> options {
+    options result;
+    for (std::size_t i = 1; i < arguments.size(); ++i) {
+        std::string_view const argument = arguments[i];
+        bool const has_value = i + 1 < arguments.size();
+        if (argument == "--headless" && has_value) {
+            result.headless_frame_count = std::stoul(arguments[++i]);
+        } else if (argument == "--dump" && has_value) {
+            result.dump_directory = arguments[++i];
+        } else if (argument == "--benchmark" && has_value) {
+            result.benchmark_path = arguments[++i];
+        } else if (argument == "--capture" && has_value) {
+            result.capture_path = arguments[++i];
+        } else if (argument == "--replay" && has_value) {
+            result.replay_path = arguments[++i];
+        } else if (argument == "--replay-from" && has_value) {
+            result.replay_first_frame = std::stoul(arguments[++i]);
+        } else if (argument == "--gpu-target" && has_value) {
+            result.gpu_target_milliseconds = std::stod(arguments[++i]);
+        } else if (argument == "--present-mode" && has_value) {
+            result.present_mode = parse_present_mode(arguments[++i]);
+        } else if (argument == "--frames-in-flight" && has_value) {
+            result.frames_in_flight =
+                static_cast<std::uint32_t>(std::stoul(arguments[++i]));
+            if (result.frames_in_flight == 0 ||
+                result.frames_in_flight > max_frames_in_flight) {
+                exit_with_usage();
+            }
+        } else if (argument == "--low-latency") {
+            result.is_low_latency = true;
+        } else {
+            exit_with_usage();
+        }
+    }
+    // Only headless frames render into an offscreen image which can be
+    // dumped.
+    if (!result.dump_directory.empty() && result.headless_frame_count == 0) {
+        exit_with_usage();
+    }
+    return result;
+}
+
+// Windowed runs only keep statistics of this many of their latest frames.
+constexpr std::size_t windowed_sample_count = 10'000;
+
+// Frame statistics which keep their latest samples, replacing the oldest ones
+// once they are full, so that adding to them never allocates.
+struct sample_ring {
+    explicit sample_ring(std::size_t capacity) {
+        samples.reserve(std::max<std::size_t>(capacity, 1));
+    }
+
+    void push(double sample) {
+        if (samples.size() < samples.capacity()) {
+            samples.push_back(sample);
+            return;
+        }
+        samples[next] = sample;
+        next = (next + 1) % samples.size();
+    }
+
+    // These are in no particular order once they wrap around.
+    std::vector<double> samples;
+    std::size_t next = 0;
+};
+
+// The value below which `percentile` of `sorted` falls.
+auto get_percentile(std::span<double const> sorted, double percentile)
+    -> double {
+    auto const index = static_cast<std::size_t>(
+        percentile * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+// Print the distribution of how long each frame of the loop took, and how much
+// frame times vary.
+void print_frame_statistics(std::vector<double>& frame_milliseconds) {
+    if (frame_milliseconds.empty()) {
+        return;
+    }
+    std::ranges::sort(frame_milliseconds);
+    double const total = std::accumulate(frame_milliseconds.begin(),
+                                         frame_milliseconds.end(), 0.0);
+    auto const count = static_cast<double>(frame_milliseconds.size());
+    double const mean = total / count;
+    double squared_deviations = 0.0;
+    for (double const milliseconds : frame_milliseconds) {
+        squared_deviations += (milliseconds - mean) * (milliseconds - mean);
+    }
+    double const variance = squared_deviations / count;
+
+    std::cout << frame_milliseconds.size() << " frames in " << total
+              << " ms: " << mean << " ms mean, " << frame_milliseconds.front()
+              << " ms min, " << get_percentile(frame_milliseconds, 0.5)
+              << " ms median, " << get_percentile(frame_milliseconds, 0.99)
+              << " ms 99th percentile, " << frame_milliseconds.back()
+              << " ms max, " << variance << " ms^2 variance ("
+              << std::sqrt(variance) << " ms standard deviation).\n";
+}
+
+// Print the distribution of how long frames took from sampling input until
+// `event`.
+void print_latency_statistics(std::string_view event,
+                              std::vector<double>& latency_milliseconds) {
+    if (latency_milliseconds.empty()) {
+        return;
+    }
+    std::ranges::sort(latency_milliseconds);
+    double const mean = std::accumulate(latency_milliseconds.begin(),
+                                        latency_milliseconds.end(), 0.0) /
+                        static_cast<double>(latency_milliseconds.size());
+
+    std::cout << "Input to " << event << ": " << mean << " ms mean, "
+              << get_percentile(latency_milliseconds, 0.5) << " ms median, "
+              << get_percentile(latency_milliseconds, 0.99)
+              << " ms 99th percentile, " << latency_milliseconds.back()
+              << " ms max.\n";
+}
+
+// Print frame times and GPU scopes, and write the trace.
+void print_profile(std::vector<double>& frame_milliseconds) {
+    print_frame_statistics(frame_milliseconds);
+    for (gpu_scope_average const& average : g_gpu_profiler.get_averages()) {
+        std::cout << average.name;
+        if (average.index != no_scope_index) {
+            std::cout << ' ' << average.index;
+        }
+        std::cout << ": " << average.stats.milliseconds << " ms, "
+                  << average.stats.vertex_invocations << " vertices, "
+                  << average.stats.fragment_invocations << " fragments, "
+                  << average.stats.clipping_invocations
+                  << " primitives clipped into "
+                  << average.stats.clipping_primitives << ".\n";
+    }
+    write_chrome_trace(getexepath().parent_path() / "trace.json");
+}
+
+auto main(int argc, char** argv) -> int {
+    options const options = parse_options(std::span(argv, argc));
+    g_present_mode = options.present_mode;
+    g_frames_in_flight = options.frames_in_flight;
+    g_is_headless = options.headless_frame_count > 0 ||
+                    !options.benchmark_path.empty() ||
+                    !options.replay_path.empty();
+
     vk::DynamicLoader vkloader;
     vulk.init();
 
@@ -68,6 +253,7 @@ auto main() -> int {
     vkb::Result maybe_instance = instance_builder.request_validation_layers()
                                      .require_api_version(1, 3, 0)
                                      .use_default_debug_messenger()
+                                     .set_headless(g_is_headless)
                                      .build();
     if (!maybe_instance) {
         std::cout << maybe_instance.error().message() << '\n';
@@ -77,19 +263,31 @@ auto main() -> int {
 
     vulk.init(vk::Instance{instance.instance});
 
-    my_window window;
-    window.SetTitle("");
-    window.SetWinSize(game_width, game_height);
-    vk::SurfaceKHR surface =
-        static_cast<VkSurfaceKHR>(window.GetSurface(instance));
+    // Headless runs have no window, so no surface either.
+    std::optional<my_window> window;
+    vk::SurfaceKHR surface;
+    if (!g_is_headless) {
+        window.emplace();
+        window->SetTitle("");
+        window->SetWinSize(game_width, game_height);
+        surface = static_cast<VkSurfaceKHR>(window->GetSurface(instance));
+    }
 
     // Initialize global device.
     g_device = make_device(instance, surface);
     vulk.init(g_device);
 
-    create_first_swapchain();
+    if (g_is_headless) {
+        create_offscreen_images();
+    } else {
+        create_first_swapchain();
+    }
     defer {
-        vkb::destroy_swapchain(g_swapchain);
+        if (g_is_headless) {
+            destroy_offscreen_images();
+        } else {
+            vkb::destroy_swapchain(g_swapchain);
+        }
     };
 
     create_command_pool();
@@ -100,28 +298,63 @@ auto main() -> int {
     create_command_buffers();
 
     g_color_image = vku::ColorAttachmentImage(
-        g_device, g_physical_device.memory_properties, game_width, game_height,
+        g_device, g_physical_device.memory_properties, max_render_width,
+        max_render_height,
         vk::Format::eR32G32B32A32Sfloat);
 
     g_normal_image = vku::ColorAttachmentImage(
-        g_device, g_physical_device.memory_properties, game_width, game_height,
+        g_device, g_physical_device.memory_properties, max_render_width,
+        max_render_height,
         vk::Format::eR32G32B32A32Sfloat);
 
     g_xyz_image = vku::ColorAttachmentImage(
-        g_device, g_physical_device.memory_properties, game_width, game_height,
+        g_device, g_physical_device.memory_properties, max_render_width,
+        max_render_height,
         vk::Format::eR32G32B32A32Sfloat);
 
     g_id_image = vku::ColorAttachmentImage(
-        g_device, g_physical_device.memory_properties, game_width, game_height,
+        g_device, g_physical_device.memory_properties, max_render_width,
+        max_render_height,
         vk::Format::eR32Uint);
 
-    g_depth_image =
-        vku::DepthStencilImage(g_device, g_physical_device.memory_properties,
-                               game_width, game_height, depth_format);
+    g_depth_image = vku::DepthStencilImage(
+        g_device, g_physical_device.memory_properties, max_render_width,
+        max_render_height, depth_format);
+
+    create_composite_image();
+    defer {
+        destroy_composite_image();
+    };
 
     vku::SamplerMaker sampler_maker;
     g_nearest_neighbor_sampler = sampler_maker.create(g_device);
 
+    vk::SamplerCreateInfo texture_sampler_info;
+    texture_sampler_info.setMagFilter(vk::Filter::eLinear)
+        .setMinFilter(vk::Filter::eLinear)
+        .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+        .setMaxLod(vk::LodClampNone);
+    g_texture_sampler = g_device.createSampler(texture_sampler_info);
+    defer {
+        g_device.destroySampler(g_texture_sampler);
+    };
+
+    vk::SamplerCreateInfo linear_sampler_info;
+    linear_sampler_info.setMagFilter(vk::Filter::eLinear)
+        .setMinFilter(vk::Filter::eLinear)
+        .setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+        .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+        .setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+    g_linear_sampler = g_device.createSampler(linear_sampler_info);
+    defer {
+        g_device.destroySampler(g_linear_sampler);
+    };
+
+    g_gpu_profiler.create();
+    defer {
+        g_gpu_profiler.destroy();
+    };
+
     create_sync_objects();
     defer {
         for (auto&& semaphore : g_finished_semaphore) {
@@ -135,24 +368,71 @@ auto main() -> int {
         }
     };
 
-    vku::DescriptorSetLayoutMaker dslm;
-    g_descriptor_layout =
-        dslm
-            // Bindless world data.
-            .buffer(0, vk::DescriptorType::eStorageBuffer,
-                    vk::ShaderStageFlagBits::eAllGraphics, 1)
-            // Color/normal/xyz/ID/depth maps.
-            // TODO: Put mesh textures here.
-            .image(1, vk::DescriptorType::eCombinedImageSampler,
-                   vk::ShaderStageFlagBits::eFragment, 5)
-            // Light maps.
-            .image(2, vk::DescriptorType::eCombinedImageSampler,
-                   vk::ShaderStageFlagBits::eFragment, g_lights.capacity())
-            // Skybox texture map.
-            .image(3, vk::DescriptorType::eCombinedImageSampler,
-                   vk::ShaderStageFlagBits::eFragment, 1)
-            .createUnique(g_device)
-            .release();
+    // The bindless world data is also culled by compute or task shaders.
+    vk::ShaderStageFlags bindless_stages =
+        vk::ShaderStageFlagBits::eAllGraphics |
+        vk::ShaderStageFlagBits::eCompute;
+    if (g_has_mesh_shaders) {
+        bindless_stages |= vk::ShaderStageFlagBits::eTaskEXT |
+                           vk::ShaderStageFlagBits::eMeshEXT;
+    }
+
+    std::array const bindings = {
+        // Bindless world data.
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer,
+                                       1, bindless_stages),
+        // Color/normal/xyz/ID/depth maps.
+        vk::DescriptorSetLayoutBinding(
+            1, vk::DescriptorType::eCombinedImageSampler, 5,
+            vk::ShaderStageFlagBits::eFragment |
+                vk::ShaderStageFlagBits::eCompute),
+        // Light maps.
+        vk::DescriptorSetLayoutBinding(
+            2, vk::DescriptorType::eCombinedImageSampler, max_light_count,
+            vk::ShaderStageFlagBits::eFragment |
+                vk::ShaderStageFlagBits::eCompute),
+        // Skybox texture map.
+        vk::DescriptorSetLayoutBinding(
+            3, vk::DescriptorType::eCombinedImageSampler, 1,
+            vk::ShaderStageFlagBits::eFragment),
+        // Mesh textures.
+        vk::DescriptorSetLayoutBinding(
+            4, vk::DescriptorType::eCombinedImageSampler, max_mesh_textures,
+            vk::ShaderStageFlagBits::eFragment),
+        // Composited image, which compositing stores into.
+        vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eStorageImage,
+                                       1, vk::ShaderStageFlagBits::eCompute),
+        // Composited image, which is upscaled onto the swapchain.
+        vk::DescriptorSetLayoutBinding(
+            6, vk::DescriptorType::eCombinedImageSampler, 1,
+            vk::ShaderStageFlagBits::eFragment),
+    };
+    static_assert(bindings.size() == descriptor_buffer::binding_count);
+
+    // Light maps and mesh textures are written as they are created or
+    // streamed in, after other frames' sets were bound. Descriptor buffers
+    // are written directly instead.
+    std::array<vk::DescriptorBindingFlags, bindings.size()> binding_flags{};
+    for (std::size_t const binding : {2uz, 4uz}) {
+        binding_flags[binding] = vk::DescriptorBindingFlagBits::ePartiallyBound;
+        if (!g_has_descriptor_buffer) {
+            binding_flags[binding] |=
+                vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+        }
+    }
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info;
+    binding_flags_info.setBindingFlags(binding_flags);
+
+    vk::DescriptorSetLayoutCreateInfo layout_info;
+    layout_info.setBindings(bindings).setPNext(&binding_flags_info);
+    if (g_has_descriptor_buffer) {
+        layout_info.setFlags(
+            vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT);
+    } else {
+        layout_info.setFlags(
+            vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
+    }
+    g_descriptor_layout = g_device.createDescriptorSetLayout(layout_info);
 
     vk::PipelineLayoutCreateInfo pipeline_info;
     pipeline_info.setSetLayouts(g_descriptor_layout)
@@ -160,41 +440,52 @@ auto main() -> int {
         .setPushConstantRanges(g_push_constants);
     g_pipeline_layout = g_device.createPipelineLayout(pipeline_info);
 
-    std::vector<vk::DescriptorPoolSize> pool_sizes;
-    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 1);
-    pool_sizes.emplace_back(vk::DescriptorType::eCombinedImageSampler,
-                            // 5 compositing textures, plus light maps, plus
-                            // 1 skybox texture.
-                            5 + g_lights.capacity() + 1);
-
-    // Create an arbitrary number of descriptors in a pool.
-    // Allow the descriptors to be freed, possibly not optimal behaviour.
-    vk::DescriptorPoolCreateInfo descriptor_pool_info;
-    descriptor_pool_info
-        .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet)
-        .setPoolSizes(pool_sizes)
-        .setMaxSets(1);
-
-    vk::DescriptorPool descriptor_pool =
-        g_device.createDescriptorPool(descriptor_pool_info);
+    // This grows when the bindless data outgrows it.
+    create_device_local_buffer(g_bindless_data.capacity());
+
+    // Without a descriptor buffer, the descriptors are allocated from a pool.
+    vk::DescriptorPool descriptor_pool;
     defer {
         g_device.destroyDescriptorPool(descriptor_pool);
     };
 
-    // TODO: `g_buffer` is hard coded to 2 kibibytes, which might be a problem
-    // later.
-    g_device_local_buffer =
-        vku::GenericBuffer(g_device, g_physical_device.memory_properties,
-                           vk::BufferUsageFlagBits::eStorageBuffer |
-                               vk::BufferUsageFlagBits::eTransferDst |
-                               vk::BufferUsageFlagBits::eVertexBuffer |
-                               vk::BufferUsageFlagBits::eIndexBuffer |
-                               vk::BufferUsageFlagBits::eIndirectBuffer,
-                           g_bindless_data.capacity());
-
-    vku::DescriptorSetMaker dsm;
-    dsm.layout(g_descriptor_layout);
-    g_descriptor_set = dsm.create(g_device, descriptor_pool).front();
+    if (g_has_descriptor_buffer) {
+        for (descriptor_buffer& buffer : g_descriptor_buffers) {
+            buffer = descriptor_buffer(g_descriptor_layout, bindings);
+        }
+    } else {
+        // Each frame in flight has its own set.
+        std::vector<vk::DescriptorPoolSize> pool_sizes;
+        pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer,
+                                max_frames_in_flight);
+        pool_sizes.emplace_back(vk::DescriptorType::eStorageImage,
+                                max_frames_in_flight);
+        pool_sizes.emplace_back(vk::DescriptorType::eCombinedImageSampler,
+                                // 5 compositing textures, plus light maps,
+                                // plus 1 skybox texture, plus mesh textures,
+                                // plus 1 composited image.
+                                (5 + max_light_count + 1 + max_mesh_textures +
+                                 1) *
+                                    max_frames_in_flight);
+
+        // Create an arbitrary number of descriptors in a pool.
+        // Allow the descriptors to be freed, possibly not optimal behaviour.
+        vk::DescriptorPoolCreateInfo descriptor_pool_info;
+        descriptor_pool_info
+            .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet |
+                      vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+            .setPoolSizes(pool_sizes)
+            .setMaxSets(max_frames_in_flight);
+        descriptor_pool = g_device.createDescriptorPool(descriptor_pool_info);
+
+        vku::DescriptorSetMaker dsm;
+        for (std::size_t i = 0; i < max_frames_in_flight; ++i) {
+            dsm.layout(g_descriptor_layout);
+        }
+        std::vector<vk::DescriptorSet> const sets =
+            dsm.create(g_device, descriptor_pool);
+        std::ranges::copy(sets, g_descriptor_sets.begin());
+    }
 
     // Push a light into the scene.
     glm::mat4x4 light1_transform = glm::identity<glm::mat4x4>();
@@ -208,22 +499,35 @@ auto main() -> int {
     light2_transform =
         glm::lookAt(light2_position, {0.f, 0.f, 0.f}, {0.f, 1.f, 0.f});
 
-    g_lights.push_back({.transform = light1_transform,
-                        .projection = projection_matrix,
-                        .position = light1_position});
-    g_lights.push_back({.transform = light2_transform,
-                        .projection = projection_matrix,
-                        .position = light2_position});
+    (void)g_lights.create({.transform = light1_transform,
+                           .projection = projection_matrix,
+                           .position = light1_position});
+    (void)g_lights.create({.transform = light2_transform,
+                           .projection = projection_matrix,
+                           .position = light2_position});
 
-    load_skybox();
+    // Textures are transcoded by workers.
+    g_jobs.start(std::thread::hardware_concurrency());
+    defer {
+        g_jobs.stop();
+    };
+
+    g_texture_loader.start();
     defer {
-        g_device.destroy(g_skybox_view);
-        ktxVulkanTexture_Destruct(&g_ktx_skybox, g_device, nullptr);
+        g_texture_loader.stop();
     };
 
+    load_skybox();
+
     // Initialize the descriptors.
     update_descriptors();
 
+    // Mesh textures can be added from here on.
+    g_mesh_textures.create();
+    defer {
+        g_mesh_textures.destroy();
+    };
+
     // Compile and link shaders.
     shader_objects.add_compute_shader(getexepath().parent_path() /
                                       "../culling.spv");
@@ -234,122 +538,286 @@ auto main() -> int {
     shader_objects.add_fragment_shader(getexepath().parent_path() /
                                        "../fragment.spv");
 
-    shader_objects.add_vertex_shader(getexepath().parent_path() /
-                                     "../composite_vertex.spv");
-    shader_objects.add_fragment_shader(getexepath().parent_path() /
-                                       "../composite_fragment.spv");
+    shader_objects.add_compute_shader(getexepath().parent_path() /
+                                      "../composite.spv");
 
     shader_objects.add_vertex_shader(getexepath().parent_path() /
                                      "../skybox_vertex.spv");
     shader_objects.add_fragment_shader(getexepath().parent_path() /
                                        "../skybox_fragment.spv");
 
+    shader_objects.add_compute_shader(getexepath().parent_path() /
+                                      "../light_culling.spv");
+
+    shader_objects.add_vertex_shader(getexepath().parent_path() /
+                                     "../upscale_vertex.spv");
+    shader_objects.add_fragment_shader(getexepath().parent_path() /
+                                       "../upscale_fragment.spv");
+
+    if (g_has_mesh_shaders) {
+        shader_objects.add_task_shader(getexepath().parent_path() /
+                                       "../meshlet_task.spv");
+        shader_objects.add_mesh_shader(getexepath().parent_path() /
+                                       "../meshlet_mesh.spv");
+    }
+
     defer {
         shader_objects.destroy();
     };
 
-    glm::mat4x4 proj = projection_matrix;
-    proj[1][1] *= -1.f;  // Invert Y.
-    g_bindless_data.set_proj_matrix(proj);
-
     g_camera.position.z = 2.f;
 
-    static float rotation = 0.f;
+    // Push the geometry once, since meshes do not change.
+    g_bindless_data.reset();
+    set_camera_projection(get_render_extent());
+
+    // TODO: It is necessary for rendering skybox that the cube mesh is the
+    // 0-index mesh. This should be moved into a special constant region of
+    // the buffer.
+    g_bindless_data.push_mesh(g_cube_mesh);
+    g_bindless_data.push_mesh(g_plane_mesh);
+    g_bindless_data.push_indices();
+
+    if (!options.benchmark_path.empty()) {
+        run_benchmark(options.benchmark_path);
+        return 0;
+    }
 
-    // Game loop.
-    while (window.ProcessEvents()) {
-        g_next_instance_id = 0;
-        g_bindless_data.reset();
-        g_bindless_data.set_proj_matrix(proj);
+    if (!options.replay_path.empty()) {
+        std::vector<double> replay_milliseconds =
+            run_replay(options.replay_path, options.replay_first_frame);
+        print_profile(replay_milliseconds);
+        return 0;
+    }
+
+    // The first cube is textured if `cube.ktx2` was copied next to the
+    // executable.
+    std::filesystem::path const cube_texture_path =
+        getexepath().parent_path() / "cube.ktx2";
+    std::uint32_t const cube_texture_index =
+        std::filesystem::exists(cube_texture_path)
+            ? g_mesh_textures.add(cube_texture_path)
+            : no_texture_index;
+
+    // Add cubes and planes to be rendered.
+    instance_handle const cube1 = g_scene.create(
+        0, {.position = {-1, 0, 0}, .texture_index = cube_texture_index});
+    instance_handle const cube2 = g_scene.create(
+        0, {.position = {1, 0.15f, 0.5f}, .color_blend = {-1, -1, -1, 1}});
+
+    mesh_instance const grid_inst_even = {
+        .color_blend = {1, 2, 1, 1},
+    };
+    mesh_instance const grid_inst_odd = {
+        .color_blend = {-0.9, -0.9, -0.9, 1},
+    };
+
+    for (mesh_instance const& plane :
+         make_checkerboard_plane({0, -0.8f, -0.5f}, 1.25f, 0.75f, 5, 5,
+                                 grid_inst_even, grid_inst_odd,
+                                 &get_frame_arena())) {
+        (void)g_scene.create(1, plane);
+    }
+
+    // The cubes spin as fast as they did at 60 frames per second.
+    g_simulation.set_camera(g_camera);
+    g_simulation.add_spinning_instance(cube1, {1, 1, 1}, -3.f);
+    g_simulation.add_spinning_instance(cube2, {1, 1, 1}, 3.f);
+
+    if (!options.dump_directory.empty()) {
+        std::filesystem::create_directories(options.dump_directory);
+    }
+    std::size_t const sample_count = (options.headless_frame_count > 0)
+                                         ? options.headless_frame_count
+                                         : windowed_sample_count;
+    sample_ring frame_milliseconds(sample_count);
+    sample_ring latency_milliseconds(sample_count);
+    // Frames which wait for presents also measure when the frame before was
+    // presented. Submits return before the GPU starts, so this includes the
+    // frames queued ahead of it.
+    sample_ring present_latency_milliseconds(sample_count);
+    std::optional<std::chrono::steady_clock::time_point> last_input_time;
+
+    if (!options.capture_path.empty()) {
+        g_frame_capture.open(options.capture_path);
+    }
+    defer {
+        g_frame_capture.close();
+    };
+
+    // Benchmarks and replays set the render scale themselves, and headless
+    // runs keep it unless asked, so that their frames are reproducible.
+    double const gpu_target_milliseconds =
+        options.gpu_target_milliseconds.value_or(g_is_headless ? 0.0
+                                                               : 1000.0 / 60.0);
+    if (gpu_target_milliseconds > 0.0) {
+        g_render_scale_controller.set_target(gpu_target_milliseconds);
+    }
+
+    auto const is_running = [&] {
+        if (g_is_headless) {
+            return g_frame_number < options.headless_frame_count;
+        }
+        return window->ProcessEvents();
+    };
+
+    // Headless runs tick once per frame instead, so that their frames are
+    // reproducible.
+    if (!g_is_headless) {
+        g_simulation.start();
+    }
+
+    if (options.is_low_latency) {
+        if (g_has_present_wait && !g_is_headless) {
+            g_frame_pacer.set_enabled(true);
+        } else {
+            std::cout << "Frame pacing needs VK_KHR_present_wait.\n";
+        }
+    }
+
+    // Game loop. Each frame records into the next of `g_frames_in_flight`
+    // slots, once the frame which last used that slot has finished.
+    while (true) {
+        cpu_zone("frame");
+        auto const frame_start = std::chrono::steady_clock::now();
+        auto const frame =
+            static_cast<unsigned>((g_frame_number + 1) % g_frames_in_flight);
+        wait_for_frame(frame);
+
+        // Input is sampled as late as the frame can start and still make the
+        // next refresh.
+        std::optional<frame_pacer::clock::time_point> const last_present =
+            g_frame_pacer.wait(g_frame_number + 1);
+        auto const input_time = std::chrono::steady_clock::now();
+        if (last_present && last_input_time) {
+            present_latency_milliseconds.push(
+                std::chrono::duration<double, std::milli>(*last_present -
+                                                          *last_input_time)
+                    .count());
+        }
+        last_input_time = input_time;
+        if (!is_running()) {
+            break;
+        }
+        ++g_frame_number;
+        get_frame_arena().reset();
+#ifdef count_allocations
+        std::size_t const allocation_count =
+            g_allocation_count.load(std::memory_order_relaxed);
+#endif
+
+        // The render extent follows GPU frame times and the window's size.
+        g_render_scale_controller.update();
+        set_camera_projection(get_render_extent());
+
+        // Only the camera and cubes move, so only the cubes' properties are
+        // uploaded again.
+        if (g_is_headless) {
+            g_simulation.tick();
+            g_simulation.apply_latest();
+        } else {
+            g_simulation.apply_interpolated(input_time);
+        }
 
         // Update camera.
         glm::mat4x4 const view = g_camera.make_view_matrix();
         g_bindless_data.set_view_matrix(view);
         g_bindless_data.set_camera_position(g_camera.position);
-
-        // Add cubes and planes to be rendered.
-
-        // TODO: It is necessary for rendering skybox that the cube mesh is the
-        // 0-index mesh. This should be moved into a special constant region of
-        // the buffer.
-        g_bindless_data.push_mesh(g_cube_mesh);
-        g_bindless_data.push_mesh(g_plane_mesh);
-        g_bindless_data.push_indices();
-
-        rotation += 0.05f;
-
-        glm::mat4x4 a = glm::identity<glm::mat4x4>();
-        a = glm::translate(a, {-0.5f, 0.5f, -0.5f});
-
-        // The braced initializers get formatted incorrectly here.
-        // clang-format off
-        mesh_instance const cube_inst1 = {
-            .position = {-1, 0, 0},
-            .rotation = glm::toQuat(glm::rotate(a, -rotation, {1, 1, 1})),
-            .index_count =
-                static_cast<index_type>(g_cube_mesh.m_indices.size()),
-        };
-
-        mesh_instance const cube_inst2 = {
-            .position = {1, 0.15f, 0.5f},
-            .rotation = glm::toQuat(glm::rotate(a, rotation, {1, 1, 1})),
-            .color_blend = {-1, -1, -1, 1},
-            .index_count =
-                static_cast<index_type>(g_cube_mesh.m_indices.size()),
-        };
-        // clang-format on
-
-        mesh_instance const grid_inst_even = {
-            .color_blend = {1, 2, 1, 1},
-            .index_count =
-                static_cast<index_type>(g_plane_mesh.m_indices.size()),
-        };
-        mesh_instance const grid_inst_odd = {
-            .color_blend = {-0.9, -0.9, -0.9, 1},
-            .index_count =
-                static_cast<index_type>(g_plane_mesh.m_indices.size()),
-        };
-
-        std::vector plane_instances =
-            make_checkerboard_plane({0, -0.8f, -0.5f}, 1.25f, 0.75f, 5, 5,
-                                    grid_inst_even, grid_inst_odd);
-
-        g_bindless_data.push_instances_of(0, {cube_inst1, cube_inst2});
-        g_bindless_data.push_instances_of(1, std::move(plane_instances));
+        g_lights.cull(g_bindless_data.get_proj_matrix() * view);
 
         // Finalize data to be transferred.
-        g_bindless_data.push_properties();
-
-        // TODO: Make this part of the frame buffer recording.
-        g_device_local_buffer.upload(
-            g_device, g_physical_device.memory_properties, g_command_pool,
-            g_graphics_queue, g_bindless_data.data(),
-            g_bindless_data.capacity());
-
-        short width;
-        short height;
-        window.GetWinSize(width, height);
-        g_screen_width = static_cast<unsigned>(width);
-        g_screen_height = static_cast<unsigned>(height);
-
-        for (unsigned i = 0; i < max_frames_in_flight; ++i) {
-            // Attempt to render each frame in a loop.
-            record_frame(i);
+        g_bindless_data.push_scene(g_scene, get_renderer_inputs());
+
+        if (g_frame_capture.is_open()) {
+            g_frame_capture.write_frame();
+        }
+
+        // This slot's last frame finished, so its texture feedback can be
+        // read. Changed first mip levels are uploaded with this frame, which
+        // also records their streaming.
+        g_mesh_textures.update(frame);
+
+        // The changes are copied by this frame's command buffer.
+        upload_bindless_data(frame);
+
+        // Textures which finished loading replace their placeholders.
+        if (g_texture_loader.poll()) {
+            update_descriptors();
+
+            if (!g_texture_loader.is_loading()) {
+                std::cout << "Texture cache hits: "
+                          << g_texture_loader.get_cache_hit_count()
+                          << ", saving "
+                          << std::chrono::duration<float, std::milli>(
+                                 g_texture_loader.get_cache_saved_time())
+                                 .count()
+                          << " ms.\n";
+            }
+        }
+
+        if (window) {
+            short width;
+            short height;
+            window->GetWinSize(width, height);
+            g_screen_width = static_cast<unsigned>(width);
+            g_screen_height = static_cast<unsigned>(height);
+        }
+
+        if (g_is_headless) {
+            record_frame(frame, frame);
+            render_offscreen(frame);
+        } else {
             try {
-                render_and_present(i);
+                std::uint32_t const image_index =
+                    acquire_swapchain_image(frame);
+                record_frame(frame, image_index);
+                submit_and_present(frame, image_index, g_frame_number);
             } catch (vk::OutOfDateKHRError const&) {
+                // This frame is dropped, and the next one is presented to the
+                // new swapchain.
                 recreate_swapchain();
 
                 // TODO: Reset the command buffer rather than reallocating
                 // so much.
                 create_command_pool();
                 create_command_buffers();
-                // TODO: Only rerender the compositing layer, or simply blit the
-                // render to the new window's surface.
-                record_frame(i);
+                g_frame_pacer.reset(g_frame_number + 1);
             }
         }
+
+        auto const submit_time = std::chrono::steady_clock::now();
+        latency_milliseconds.push(
+            std::chrono::duration<double, std::milli>(submit_time - input_time)
+                .count());
+        g_frame_pacer.end_frame(submit_time - input_time);
+
+        if (!options.dump_directory.empty()) {
+            dump_offscreen_image(
+                frame, options.dump_directory /
+                           std::format("frame_{:05}.ppm", g_frame_number));
+        }
+
+        frame_milliseconds.push(
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - frame_start)
+                .count());
+
+#ifdef count_allocations
+        // The first frames lay out the scene and grow containers, but later
+        // frames should only reuse memory.
+        std::size_t const frame_allocations =
+            g_allocation_count.load(std::memory_order_relaxed) -
+            allocation_count;
+        if (g_frame_number > g_frames_in_flight && frame_allocations > 0) {
+            std::cout << "Frame " << g_frame_number << " made "
+                      << frame_allocations << " heap allocations.\n";
+        }
+#endif
     }
 
+    g_simulation.stop();
     g_device.waitIdle();
+    print_profile(frame_milliseconds.samples);
+    print_latency_statistics("submit", latency_milliseconds.samples);
+    print_latency_statistics("present", present_latency_milliseconds.samples);
 }
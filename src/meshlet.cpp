@@ -0,0 +1,146 @@
+#include "meshlet.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "bindless.hpp"
+
+namespace {
+
+// Fill in the bounding sphere and normal cone of `cluster`.
+void compute_bounds(meshlet& cluster, std::span<vertex const> vertices,
+                    std::span<unsigned const> indices,
+                    std::span<std::uint32_t const> cluster_vertices) {
+    glm::vec3 min = glm::vec3(vertices[cluster_vertices.front()].position);
+    glm::vec3 max = min;
+    for (std::uint32_t index : cluster_vertices) {
+        min = glm::min(min, glm::vec3(vertices[index].position));
+        max = glm::max(max, glm::vec3(vertices[index].position));
+    }
+
+    cluster.center = (min + max) * 0.5f;
+    cluster.radius = 0.f;
+    for (std::uint32_t index : cluster_vertices) {
+        cluster.radius = std::max(
+            cluster.radius, glm::distance(cluster.center,
+                                          glm::vec3(vertices[index].position)));
+    }
+
+    // Average the triangle normals to find the cone's axis.
+    std::vector<glm::vec3> normals;
+    normals.reserve(cluster.index_count / 3);
+    glm::vec3 axis = {0, 0, 0};
+    for (std::uint32_t i = cluster.first_index;
+         i < cluster.first_index + cluster.index_count; i += 3) {
+        glm::vec3 a = vertices[indices[i]].position;
+        glm::vec3 b = vertices[indices[i + 1]].position;
+        glm::vec3 c = vertices[indices[i + 2]].position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+
+        // Degenerate triangles cannot face away from anything.
+        if (glm::length(normal) == 0.f) {
+            continue;
+        }
+        normals.push_back(glm::normalize(normal));
+        axis += normals.back();
+    }
+
+    // A cone cutoff of 1 never culls.
+    cluster.cone_axis = {0, 0, 1};
+    cluster.cone_cutoff = 1.f;
+    if (glm::length(axis) == 0.f) {
+        return;
+    }
+    cluster.cone_axis = glm::normalize(axis);
+
+    float min_dot = 1.f;
+    for (glm::vec3 normal : normals) {
+        min_dot = std::min(min_dot, glm::dot(normal, cluster.cone_axis));
+    }
+
+    // If some triangle is perpendicular to the axis or further, then the cone
+    // is a hemisphere or wider and cannot cull.
+    if (min_dot > 0.f) {
+        cluster.cone_cutoff = std::sqrt(1.f - (min_dot * min_dot));
+    }
+}
+
+}  // namespace
+
+auto make_meshlets(std::span<vertex const> vertices,
+                   std::span<unsigned const> indices) -> meshlets_t {
+    assert((indices.size() % 3) == 0);
+    meshlets_t result;
+    result.triangles.reserve(indices.size() / 3);
+
+    // Map from a mesh vertex to its index in the current meshlet, or `-1`.
+    std::vector<int> local_indices(vertices.size(), -1);
+
+    meshlet current{};
+
+    auto finish_meshlet = [&] {
+        if (current.index_count == 0) {
+            return;
+        }
+        std::span<std::uint32_t const> const cluster_vertices = {
+            result.vertices.data() + current.first_vertex,
+            current.vertex_count};
+        compute_bounds(current, vertices, indices, cluster_vertices);
+        for (std::uint32_t index : cluster_vertices) {
+            local_indices[index] = -1;
+        }
+        result.meshlets.push_back(current);
+
+        current = {};
+        current.first_index =
+            static_cast<std::uint32_t>(result.triangles.size() * 3);
+        current.first_vertex =
+            static_cast<std::uint32_t>(result.vertices.size());
+    };
+
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        std::uint32_t new_vertices = 0;
+        for (std::size_t j = i; j < i + 3; ++j) {
+            new_vertices += (local_indices[indices[j]] == -1) ? 1 : 0;
+        }
+
+        if (current.vertex_count + new_vertices > meshlet_max_vertices ||
+            (current.index_count / 3) + 1 > meshlet_max_triangles) {
+            finish_meshlet();
+        }
+
+        std::uint32_t packed_triangle = 0;
+        for (std::size_t j = i; j < i + 3; ++j) {
+            int& local_index = local_indices[indices[j]];
+            if (local_index == -1) {
+                local_index = static_cast<int>(current.vertex_count);
+                result.vertices.push_back(indices[j]);
+                ++current.vertex_count;
+            }
+            packed_triangle |= static_cast<std::uint32_t>(local_index)
+                               << ((j - i) * 8);
+        }
+        result.triangles.push_back(packed_triangle);
+        current.index_count += 3;
+    }
+    finish_meshlet();
+
+    return result;
+}
+
+void append_meshlets(meshlets_t& to, meshlets_t const& from,
+                     std::uint32_t first_index) {
+    auto const first_vertex = static_cast<std::uint32_t>(to.vertices.size());
+    for (meshlet cluster : from.meshlets) {
+        cluster.first_index += first_index;
+        cluster.first_vertex += first_vertex;
+        to.meshlets.push_back(cluster);
+    }
+    to.vertices.insert(to.vertices.end(), from.vertices.begin(),
+                       from.vertices.end());
+    to.triangles.insert(to.triangles.end(), from.triangles.begin(),
+                        from.triangles.end());
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct vertex;
+
+// These limits match `meshlet_mesh_main` in `shaders.slang`.
+inline constexpr std::uint32_t meshlet_max_vertices = 64;
+inline constexpr std::uint32_t meshlet_max_triangles = 124;
+
+// This matches `meshlet` in `shaders.slang`:
+struct meshlet {
+    // Bounding sphere, in model space.
+    glm::vec3 center;
+    float radius;
+
+    // Every triangle faces away from a camera at `position` when:
+    // `dot(center - position, cone_axis) >=
+    //     cone_cutoff * length(center - position) + radius`
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+
+    // This meshlet's triangles are a contiguous range of indices.
+    std::uint32_t first_index;
+    std::uint32_t index_count;
+
+    // Range of unique vertex indices, for mesh shaders to transform once.
+    std::uint32_t first_vertex;
+    std::uint32_t vertex_count;
+};
+
+static_assert(sizeof(meshlet) == 48);
+
+struct meshlets_t {
+    std::vector<meshlet> meshlets;
+
+    // Vertex indices referenced by each meshlet, relative to the mesh.
+    std::vector<std::uint32_t> vertices;
+
+    // One entry per triangle, parallel to the mesh's indices. Each holds three
+    // 8-bit indices into its meshlet's `vertices`.
+    std::vector<std::uint32_t> triangles;
+};
+
+// Append `from` onto `to`, where `from` was made from indices beginning at
+// `first_index` in the same index list as `to`.
+void append_meshlets(meshlets_t& to, meshlets_t const& from,
+                     std::uint32_t first_index);
+
+// Greedily split a triangle list into clusters of at most
+// `meshlet_max_vertices` vertices and `meshlet_max_triangles` triangles,
+// without reordering its indices.
+auto make_meshlets(std::span<vertex const> vertices,
+                   std::span<unsigned const> indices) -> meshlets_t;
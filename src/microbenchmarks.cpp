@@ -0,0 +1,250 @@
+// Time the CPU paths which lay out `g_bindless_data`, with meshes and instance
+// counts of several sizes. Nothing here touches a Vulkan device.
+
+#include <glm/gtx/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "arena.hpp"
+#include "bindless.hpp"
+#include "defer.hpp"
+#include "geometry.hpp"
+#include "jobs.hpp"
+#include "scene.hpp"
+
+namespace {
+// Each benchmark repeats for at least this long, and at least `min_runs`
+// times, and the median run is reported.
+constexpr std::chrono::milliseconds min_duration{250};
+constexpr std::size_t min_runs = 5;
+
+// Call `setup()` then `body()` repeatedly, and return the median nanoseconds
+// that `body()` took. Only `body()` is timed.
+template <typename Setup, typename Body>
+auto measure(Setup&& setup, Body&& body) -> double {
+    std::vector<double> runs;
+    auto const start = std::chrono::steady_clock::now();
+    while (runs.size() < min_runs ||
+           std::chrono::steady_clock::now() - start < min_duration) {
+        setup();
+        auto const run_start = std::chrono::steady_clock::now();
+        body();
+        runs.push_back(std::chrono::duration<double, std::nano>(
+                           std::chrono::steady_clock::now() - run_start)
+                           .count());
+    }
+    std::ranges::nth_element(runs, runs.begin() + (runs.size() / 2));
+    return runs[runs.size() / 2];
+}
+
+// `item` names what `item_count` counts, and `bytes` is how much data the
+// benchmark produced or consumed, which may be 0.
+void report(std::string_view name, std::size_t parameter,
+            std::string_view item, std::size_t item_count, std::size_t bytes,
+            double nanoseconds) {
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::setw(9) << parameter << std::setw(12) << std::fixed
+              << std::setprecision(2)
+              << nanoseconds / static_cast<double>(item_count) << " ns/"
+              << std::left << std::setw(10) << item << std::right;
+    if (bytes > 0) {
+        std::cout << std::setw(10)
+                  << static_cast<double>(bytes) / nanoseconds * 1e9 / 1e6
+                  << " MB/s";
+    }
+    std::cout << '\n';
+}
+
+// A square heightfield of `size` by `size` quads, whose bumps give
+// simplification something to preserve.
+auto make_grid_mesh(unsigned size) -> mesh {
+    std::vector<vertex> vertices;
+    vertices.reserve(static_cast<std::size_t>(size + 1) * (size + 1));
+    for (unsigned z = 0; z <= size; ++z) {
+        for (unsigned x = 0; x <= size; ++x) {
+            float const u = static_cast<float>(x) / static_cast<float>(size);
+            float const v = static_cast<float>(z) / static_cast<float>(size);
+            vertices.emplace_back(u - 0.5f,
+                                  0.05f * std::sin(u * 12.f) *
+                                      std::cos(v * 9.f),
+                                  v - 0.5f);
+        }
+    }
+
+    std::vector<index_type> indices;
+    indices.reserve(static_cast<std::size_t>(size) * size * 6);
+    for (unsigned z = 0; z < size; ++z) {
+        for (unsigned x = 0; x < size; ++x) {
+            index_type const corner = (z * (size + 1)) + x;
+            index_type const below = corner + size + 1;
+            indices.insert(indices.end(), {corner, below, corner + 1,
+                                           corner + 1, below, below + 1});
+        }
+    }
+    return {std::move(vertices), std::move(indices)};
+}
+
+auto make_instances(std::size_t count) -> std::vector<mesh_instance> {
+    std::vector<mesh_instance> instances(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto const f = static_cast<float>(i);
+        instances[i] = {
+            .position = {std::fmod(f, 1'000.f), 0.f, f / 1'000.f},
+            .rotation = glm::angleAxis(f, glm::vec3{0.f, 1.f, 0.f}),
+            .index_offset = 0,
+            .index_count =
+                static_cast<index_type>(g_cube_mesh.m_indices.size()),
+        };
+    }
+    return instances;
+}
+
+// Lay out the geometry which instances are pushed after.
+void push_geometry() {
+    g_bindless_data.reset();
+    g_bindless_data.push_mesh(g_cube_mesh);
+    g_bindless_data.push_mesh(g_plane_mesh);
+    g_bindless_data.push_indices();
+}
+
+void benchmark_meshes() {
+    for (unsigned const size : {8u, 32u, 128u}) {
+        mesh const source = make_grid_mesh(size);
+        std::size_t const triangle_count = source.m_indices.size() / 3;
+        std::size_t const source_bytes =
+            (source.m_vertices.size() * sizeof(vertex)) +
+            (source.m_indices.size() * sizeof(index_type));
+
+        // The constructor generates normals, meshlets, and LODs.
+        double const construct_time = measure([] {}, [&] {
+            std::vector<vertex> vertices = source.m_vertices;
+            std::vector<index_type> indices = source.m_indices;
+            mesh const built(std::move(vertices), std::move(indices));
+        });
+        report("mesh constructor", size, "triangle", triangle_count,
+               source_bytes, construct_time);
+
+        std::size_t mesh_bytes = 0;
+        double const push_time = measure(
+            [] {
+                g_bindless_data.reset();
+            },
+            [&] {
+                std::size_t const size_before = g_bindless_data.size();
+                g_bindless_data.push_mesh(source);
+                mesh_bytes = g_bindless_data.size() - size_before;
+            });
+        report("push_mesh", size, "vertex", source.m_vertices.size(),
+               mesh_bytes, push_time);
+
+        std::size_t index_bytes = 0;
+        double const indices_time = measure(
+            [&] {
+                g_bindless_data.reset();
+                g_bindless_data.push_mesh(source);
+            },
+            [&] {
+                std::size_t const size_before = g_bindless_data.size();
+                g_bindless_data.push_indices();
+                index_bytes = g_bindless_data.size() - size_before;
+            });
+        report("push_indices", size, "index",
+               source.m_indices.size() + source.m_lod_indices.size(),
+               index_bytes, indices_time);
+    }
+}
+
+void benchmark_instances() {
+    for (std::size_t const count : {1'000uz, 10'000uz, 100'000uz,
+                                    1'000'000uz}) {
+        std::vector<mesh_instance> const instances = make_instances(count);
+
+        // Nothing is drawn, so the camera only matters for selecting LODs.
+        double const instances_time = measure(
+            [] {
+                get_frame_arena().reset();
+                push_geometry();
+            },
+            [&] {
+                g_bindless_data.push_instances_of(0, instances);
+            });
+        report("push_instances_of", count, "instance", count, 0,
+               instances_time);
+
+        std::size_t property_bytes = 0;
+        double const properties_time = measure(
+            [&] {
+                get_frame_arena().reset();
+                push_geometry();
+                g_bindless_data.push_instances_of(0, instances);
+            },
+            [&] {
+                std::size_t const size_before = g_bindless_data.size();
+                g_bindless_data.push_properties({});
+                property_bytes = g_bindless_data.size() - size_before;
+            });
+        report("push_properties", count, "instance", count, property_bytes,
+               properties_time);
+
+        // A scene is laid out from scratch when instances are created or
+        // destroyed, and otherwise only its changed instances are patched.
+        std::vector<instance_handle> handles;
+        handles.reserve(count);
+        std::size_t layout_bytes = 0;
+        double const layout_time = measure(
+            [&] {
+                push_geometry();
+                g_scene = scene{};
+                handles.clear();
+                for (mesh_instance const& instance : instances) {
+                    handles.push_back(g_scene.create(0, instance));
+                }
+            },
+            [&] {
+                std::size_t const size_before = g_bindless_data.size();
+                // These scenes have no lights or mesh textures.
+                g_bindless_data.push_scene(g_scene, {});
+                layout_bytes = g_bindless_data.size() - size_before;
+            });
+        report("push_scene (layout)", count, "instance", count, layout_bytes,
+               layout_time);
+
+        // Each frame moves 1% of the instances.
+        std::size_t const moved_count = std::max(count / 100, 1uz);
+        float offset = 0.f;
+        double const patch_time = measure(
+            [&] {
+                offset += 1.f;
+                for (std::size_t i = 0; i < count; i += count / moved_count) {
+                    g_scene.set_position(handles[i], {offset, 0.f, 0.f});
+                }
+            },
+            [&] {
+                g_bindless_data.push_scene(g_scene, {});
+            });
+        report("push_scene (1% moved)", count, "moved", moved_count, 0,
+               patch_time);
+    }
+}
+}  // namespace
+
+auto main() -> int {
+    g_jobs.start(std::thread::hardware_concurrency());
+    defer {
+        g_jobs.stop();
+    };
+
+    std::cout << "Benchmarks run on " << std::thread::hardware_concurrency()
+              << " threads.\n";
+    benchmark_meshes();
+    benchmark_instances();
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "render_scale.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "globals.hpp"
+#include "gpu_profiler.hpp"
+
+namespace {
+// How far each frame time moves the smoothed frame time towards it.
+constexpr double smoothing = 0.2;
+
+// The scale only rises once frames take less than this fraction of the
+// target, and every change aims halfway into this margin, so that the scale
+// does not oscillate around the target.
+constexpr double headroom = 0.15;
+
+// Each change is at most this fraction of the scale, because frame times are
+// not only spent on pixels.
+constexpr double max_step = 0.1;
+}  // namespace
+
+void render_scale_controller::update() {
+    if (!m_target_milliseconds) {
+        return;
+    }
+    std::size_t const read_back_count = g_gpu_profiler.get_read_back_count();
+    if (read_back_count == m_read_back_count) {
+        return;
+    }
+    m_read_back_count = read_back_count;
+    double const milliseconds = g_gpu_profiler.get_last_frame_milliseconds();
+    if (m_settling_frames > 0) {
+        --m_settling_frames;
+        return;
+    }
+
+    m_smoothed_milliseconds =
+        m_smoothed_milliseconds
+            ? std::lerp(*m_smoothed_milliseconds, milliseconds, smoothing)
+            : milliseconds;
+    double const smoothed = *m_smoothed_milliseconds;
+    double const target = *m_target_milliseconds;
+    if (smoothed <= target && smoothed >= target * (1.0 - headroom)) {
+        return;
+    }
+
+    // Scales past what the attachments fit at the swapchain's size would
+    // render at the same extent, so the scale is changed from the one which
+    // was rendered, and never raised past it.
+    float const upper_scale =
+        std::max(min_scale, std::min(max_scale, get_max_render_scale()));
+    float const rendered_scale = std::min(g_render_scale, upper_scale);
+
+    double const aim = target * (1.0 - (headroom / 2.0));
+    double const step =
+        std::clamp(std::sqrt(aim / smoothed), 1.0 - max_step, 1.0 + max_step);
+    float const scale = std::clamp(static_cast<float>(rendered_scale * step),
+                                   min_scale, upper_scale);
+    if (scale == g_render_scale) {
+        return;
+    }
+    g_render_scale = scale;
+
+    // Times at the old scale no longer predict the new one.
+    m_smoothed_milliseconds.reset();
+    m_settling_frames = g_frames_in_flight;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+// Lowers `g_render_scale` while GPU frames take longer than a target, and
+// raises it again once they have time to spare. GPU time is assumed to mostly
+// follow the number of rasterized pixels, which is the square of the scale, so
+// each change scales by the square root of how far the smoothed frame time is
+// from the target.
+class render_scale_controller {
+  public:
+    // Hold GPU frame times under `milliseconds`. Until this is set, the scale
+    // is left alone, so that benchmarks and replays can set it themselves.
+    void set_target(double milliseconds) {
+        m_target_milliseconds = milliseconds;
+    }
+
+    // Adjust the scale from the newest frame which `g_gpu_profiler` read back,
+    // if there is one. This must be called once per frame.
+    void update();
+
+    // The scale is also kept under `get_max_render_scale()`.
+    static constexpr float min_scale = 0.25f;
+    static constexpr float max_scale = 1.f;
+
+  private:
+    std::optional<double> m_target_milliseconds;
+    std::optional<double> m_smoothed_milliseconds;
+    // This is compared with `g_gpu_profiler.get_read_back_count()` to find
+    // new frames.
+    std::size_t m_read_back_count = 0;
+    // GPU times trail by the frames in flight, so after a change, this many
+    // frames which were rendered at the old scale are ignored.
+    std::size_t m_settling_frames = 0;
+};
+
+inline render_scale_controller g_render_scale_controller;
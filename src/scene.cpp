@@ -0,0 +1,100 @@
+#include "scene.hpp"
+
+auto scene::create(std::uint32_t mesh_index, mesh_instance const& instance)
+    -> instance_handle {
+    if (m_mesh_ends.size() <= mesh_index) {
+        m_mesh_ends.resize(mesh_index + 1uz,
+                           static_cast<std::uint32_t>(m_instances.size()));
+    }
+
+    // Open a slot at the end of this mesh's slots by moving the first
+    // instance of every following mesh to its end.
+    auto hole = static_cast<std::uint32_t>(m_instances.size());
+    m_instances.emplace_back();
+    m_slot_handles.emplace_back();
+    for (std::size_t i = m_mesh_ends.size() - 1; i > mesh_index; --i) {
+        std::uint32_t const first = get_mesh_begin(i);
+        if (first != hole) {
+            move_slot(first, hole);
+        }
+        hole = first;
+        ++m_mesh_ends[i];
+    }
+    ++m_mesh_ends[mesh_index];
+
+    instance_handle handle;
+    if (m_free_handles.empty()) {
+        handle = {static_cast<std::uint32_t>(m_handle_slots.size()), 0};
+        m_handle_slots.push_back(hole);
+        m_generations.push_back(0);
+    } else {
+        handle.index = m_free_handles.back();
+        handle.generation = m_generations[handle.index];
+        m_free_handles.pop_back();
+        m_handle_slots[handle.index] = hole;
+    }
+
+    m_instances[hole] = instance;
+    if (instance.id == 0) {
+        ++g_next_instance_id;
+        m_instances[hole].id = g_next_instance_id;
+    }
+    m_slot_handles[hole] = handle.index;
+
+    m_is_structure_dirty = true;
+    return handle;
+}
+
+void scene::destroy(instance_handle handle) {
+    std::uint32_t hole = get_slot(handle);
+    std::size_t const mesh_index = get_slot_mesh(hole);
+
+    // Fill the slot with the last instance of its mesh, then close the gap
+    // by moving the last instance of every following mesh backwards.
+    for (std::size_t i = mesh_index; i < m_mesh_ends.size(); ++i) {
+        std::uint32_t const last = m_mesh_ends[i] - 1;
+        if (last != hole) {
+            move_slot(last, hole);
+            hole = last;
+        }
+        --m_mesh_ends[i];
+    }
+    m_instances.pop_back();
+    m_slot_handles.pop_back();
+
+    // Invalidate every copy of this handle.
+    ++m_generations[handle.index];
+    m_free_handles.push_back(handle.index);
+
+    m_is_structure_dirty = true;
+}
+
+void scene::clear_dirty() {
+    for (std::uint32_t slot : m_dirty_slots) {
+        m_dirty_bits[slot / 64] = 0;
+    }
+    m_dirty_slots.clear();
+    m_is_structure_dirty = false;
+}
+
+void scene::mark_dirty(std::uint32_t slot) {
+    // Every slot is rewritten anyways when the structure changes.
+    if (m_is_structure_dirty) {
+        return;
+    }
+    if (m_dirty_bits.size() <= slot / 64) {
+        m_dirty_bits.resize((slot / 64) + 1uz);
+    }
+    std::uint64_t const bit = 1ull << (slot % 64);
+    if ((m_dirty_bits[slot / 64] & bit) == 0) {
+        m_dirty_bits[slot / 64] |= bit;
+        m_dirty_slots.push_back(slot);
+    }
+}
+
+void scene::move_slot(std::uint32_t from, std::uint32_t to) {
+    m_instances[to] = m_instances[from];
+    m_slot_handles[to] = m_slot_handles[from];
+    m_handle_slots[m_slot_handles[to]] = to;
+    mark_dirty(to);
+}
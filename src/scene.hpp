@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bindless.hpp"
+
+// A stable reference to an instance in a `scene`. It stays valid until that
+// instance is destroyed, even while other instances are created or destroyed.
+struct instance_handle {
+    std::uint32_t index;
+    std::uint32_t generation;
+};
+
+// Instances which persist between frames. Every instance lives in a slot,
+// which is its index in the bindless property region, and slots are grouped by
+// mesh so that each mesh is drawn with one instanced command. Changing an
+// instance marks its slot dirty, so that `buffer_storage::push_scene()` only
+// has to patch the properties which changed.
+class scene {
+  public:
+    // A new ID is generated for the instance if `instance.id` is zero.
+    [[nodiscard]]
+    auto create(std::uint32_t mesh_index, mesh_instance const& instance)
+        -> instance_handle;
+
+    void destroy(instance_handle handle);
+
+    [[nodiscard]]
+    auto is_alive(instance_handle handle) const -> bool {
+        return handle.index < m_generations.size() &&
+               m_generations[handle.index] == handle.generation;
+    }
+
+    [[nodiscard]]
+    auto get(instance_handle handle) const -> mesh_instance const& {
+        return m_instances[get_slot(handle)];
+    }
+
+    void set_position(instance_handle handle, glm::vec3 position) {
+        std::uint32_t const slot = get_slot(handle);
+        m_instances[slot].position = position;
+        mark_dirty(slot);
+    }
+
+    void set_rotation(instance_handle handle, glm::fquat rotation) {
+        std::uint32_t const slot = get_slot(handle);
+        m_instances[slot].rotation = rotation;
+        mark_dirty(slot);
+    }
+
+    void set_scaling(instance_handle handle, glm::vec3 scaling) {
+        std::uint32_t const slot = get_slot(handle);
+        m_instances[slot].scaling = scaling;
+        mark_dirty(slot);
+    }
+
+    void set_color_blend(instance_handle handle, glm::vec4 color_blend) {
+        std::uint32_t const slot = get_slot(handle);
+        m_instances[slot].color_blend = color_blend;
+        mark_dirty(slot);
+    }
+
+    // `texture_index` is from `g_mesh_textures`, or `no_texture_index`.
+    void set_texture_index(instance_handle handle,
+                           std::uint32_t texture_index) {
+        std::uint32_t const slot = get_slot(handle);
+        m_instances[slot].texture_index = texture_index;
+        mark_dirty(slot);
+    }
+
+    // Instances in slot order.
+    [[nodiscard]]
+    auto get_instances() const -> std::span<mesh_instance const> {
+        return m_instances;
+    }
+
+    [[nodiscard]]
+    auto get_meshes_count() const -> std::size_t {
+        return m_mesh_ends.size();
+    }
+
+    // The first slot of each mesh is the end of the previous mesh's slots.
+    [[nodiscard]]
+    auto get_mesh_begin(std::size_t mesh_index) const -> std::uint32_t {
+        return (mesh_index == 0) ? 0 : m_mesh_ends[mesh_index - 1];
+    }
+
+    [[nodiscard]]
+    auto get_mesh_end(std::size_t mesh_index) const -> std::uint32_t {
+        return m_mesh_ends[mesh_index];
+    }
+
+    // The mesh whose slots contain `slot`.
+    [[nodiscard]]
+    auto get_slot_mesh(std::uint32_t slot) const -> std::size_t {
+        return static_cast<std::size_t>(
+            std::ranges::upper_bound(m_mesh_ends, slot) - m_mesh_ends.begin());
+    }
+
+    // Whether instances were created or destroyed, which moves the draw
+    // ranges of each mesh.
+    [[nodiscard]]
+    auto is_structure_dirty() const -> bool {
+        return m_is_structure_dirty;
+    }
+
+    // Slots whose properties changed, in no particular order.
+    [[nodiscard]]
+    auto get_dirty_slots() const -> std::span<std::uint32_t const> {
+        return m_dirty_slots;
+    }
+
+    void clear_dirty();
+
+  private:
+    [[nodiscard]]
+    auto get_slot(instance_handle handle) const -> std::uint32_t {
+        assert(is_alive(handle));
+        return m_handle_slots[handle.index];
+    }
+
+    void mark_dirty(std::uint32_t slot);
+
+    // Move the instance in slot `from` into slot `to`, which is unused.
+    void move_slot(std::uint32_t from, std::uint32_t to);
+
+    // These are indexed by slot.
+    std::vector<mesh_instance> m_instances;
+    std::vector<std::uint32_t> m_slot_handles;
+
+    // The end of each mesh's slots.
+    std::vector<std::uint32_t> m_mesh_ends;
+
+    // These are indexed by handle.
+    std::vector<std::uint32_t> m_handle_slots;
+    std::vector<std::uint32_t> m_generations;
+    std::vector<std::uint32_t> m_free_handles;
+
+    // One bit for each slot, so that slots are only listed once.
+    std::vector<std::uint64_t> m_dirty_bits;
+    std::vector<std::uint32_t> m_dirty_slots;
+    bool m_is_structure_dirty = true;
+};
+
+inline scene g_scene;
+
+// The ID of the last instance which was given one. IDs count up from 1, so
+// that 0 can mean none.
+inline constinit unsigned g_next_instance_id;
@@ -62,6 +62,16 @@ struct shader_objects_t {
         add_shader(shader_path, vk::ShaderStageFlagBits::eFragment);
     }
 
+    void add_task_shader(std::filesystem::path const& shader_path) {
+        add_shader(shader_path, vk::ShaderStageFlagBits::eTaskEXT,
+                   vk::ShaderStageFlagBits::eMeshEXT);
+    }
+
+    void add_mesh_shader(std::filesystem::path const& shader_path) {
+        add_shader(shader_path, vk::ShaderStageFlagBits::eMeshEXT,
+                   vk::ShaderStageFlagBits::eFragment);
+    }
+
     void bind_compute(vk::CommandBuffer cmd, std::uint32_t index) {
         assert(index < objects.size());
         auto compute_bit = vk::ShaderStageFlagBits::eCompute;
@@ -80,6 +90,31 @@ struct shader_objects_t {
         cmd.bindShadersEXT(1, &fragment_bit, &objects[index]);
     }
 
+    // Bind task and mesh shaders in place of a vertex shader.
+    void bind_task_mesh(vk::CommandBuffer cmd, std::uint32_t task_index,
+                        std::uint32_t mesh_index) {
+        assert(task_index < objects.size());
+        assert(mesh_index < objects.size());
+        std::array const stages = {vk::ShaderStageFlagBits::eVertex,
+                                   vk::ShaderStageFlagBits::eTaskEXT,
+                                   vk::ShaderStageFlagBits::eMeshEXT};
+        std::array<vk::ShaderEXT, 3> const shaders = {
+            nullptr, objects[task_index], objects[mesh_index]};
+        cmd.bindShadersEXT(stages, shaders);
+    }
+
+    // When mesh shaders are enabled, their stages must be explicitly unbound
+    // to draw with a vertex shader.
+    void unbind_task_mesh(vk::CommandBuffer cmd) {
+        if (!g_has_mesh_shaders) {
+            return;
+        }
+        std::array const stages = {vk::ShaderStageFlagBits::eTaskEXT,
+                                   vk::ShaderStageFlagBits::eMeshEXT};
+        std::array<vk::ShaderEXT, 2> const shaders = {nullptr, nullptr};
+        cmd.bindShadersEXT(stages, shaders);
+    }
+
     void destroy() {
         for (auto& shader : objects) {
             vulk.vkDestroyShaderEXT(g_device, shader, nullptr);
@@ -0,0 +1,338 @@
+#include "simplify.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <tuple>
+
+#include "bindless.hpp"
+
+namespace {
+
+// Symmetric 4x4 matrix, stored as its upper triangle, which sums the squared
+// distances to a set of planes.
+struct quadric {
+    std::array<double, 10> m{};
+
+    static auto from_plane(glm::dvec3 normal, double distance, double weight)
+        -> quadric {
+        double const a = normal.x;
+        double const b = normal.y;
+        double const c = normal.z;
+        double const d = distance;
+        quadric result;
+        result.m = {a * a, a * b, a * c, a * d, b * b,
+                    b * c, b * d, c * c, c * d, d * d};
+        for (double& element : result.m) {
+            element *= weight;
+        }
+        return result;
+    }
+
+    auto operator+=(quadric const& other) -> quadric& {
+        for (std::size_t i = 0; i < m.size(); ++i) {
+            m[i] += other.m[i];
+        }
+        return *this;
+    }
+
+    [[nodiscard]]
+    auto error(glm::dvec3 p) const -> double {
+        double const result =
+            (m[0] * p.x * p.x) + (2 * m[1] * p.x * p.y) +
+            (2 * m[2] * p.x * p.z) + (2 * m[3] * p.x) + (m[4] * p.y * p.y) +
+            (2 * m[5] * p.y * p.z) + (2 * m[6] * p.y) + (m[7] * p.z * p.z) +
+            (2 * m[8] * p.z) + m[9];
+        // Rounding can make this slightly negative.
+        return std::max(result, 0.0);
+    }
+};
+
+// Boundary edges are held in place by planes perpendicular to their triangle,
+// weighted heavily so that silhouettes of open meshes do not shrink.
+constexpr double boundary_weight = 10.0;
+
+struct edge {
+    unsigned from;
+    unsigned to;
+    double cost;
+};
+
+// Removed triangles are collapsed onto a single vertex.
+auto is_removed(std::array<unsigned, 3> const& triangle) -> bool {
+    return triangle[0] == triangle[1] && triangle[1] == triangle[2];
+}
+
+// Connectivity of welded vertices to the triangles that use them.
+struct adjacency {
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> triangles;
+
+    void build(std::size_t vertex_count,
+               std::span<std::array<unsigned, 3> const> welded_triangles) {
+        offsets.assign(vertex_count + 1, 0);
+        for (auto const& triangle : welded_triangles) {
+            if (is_removed(triangle)) {
+                continue;
+            }
+            for (unsigned corner : triangle) {
+                ++offsets[corner + 1];
+            }
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        triangles.resize(offsets.back());
+        std::vector<unsigned> cursors(offsets.begin(), offsets.end() - 1);
+        for (unsigned i = 0; i < welded_triangles.size(); ++i) {
+            if (is_removed(welded_triangles[i])) {
+                continue;
+            }
+            for (unsigned corner : welded_triangles[i]) {
+                triangles[cursors[corner]++] = i;
+            }
+        }
+    }
+
+    [[nodiscard]]
+    auto of(unsigned welded_vertex) const -> std::span<unsigned const> {
+        return {triangles.data() + offsets[welded_vertex],
+                triangles.data() + offsets[welded_vertex + 1]};
+    }
+};
+
+}  // namespace
+
+auto simplify(std::span<vertex const> vertices,
+              std::span<unsigned const> indices,
+              std::size_t target_index_count) -> simplified_indices {
+    assert((indices.size() % 3) == 0);
+
+    // Weld vertices with equal positions to the lowest such index.
+    std::vector<unsigned> weld(vertices.size());
+    {
+        std::vector<unsigned> order(vertices.size());
+        std::iota(order.begin(), order.end(), 0u);
+        auto const position_less = [&](unsigned a, unsigned b) {
+            glm::vec3 const pa = vertices[a].position;
+            glm::vec3 const pb = vertices[b].position;
+            return std::tie(pa.x, pa.y, pa.z, a) <
+                   std::tie(pb.x, pb.y, pb.z, b);
+        };
+        std::ranges::sort(order, position_less);
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            bool const is_duplicate =
+                i > 0 && glm::vec3(vertices[order[i]].position) ==
+                             glm::vec3(vertices[order[i - 1]].position);
+            weld[order[i]] = is_duplicate ? weld[order[i - 1]] : order[i];
+        }
+    }
+
+    // Each welded vertex points to the vertex it collapsed into, or itself.
+    std::vector<unsigned> parent(vertices.size());
+    std::iota(parent.begin(), parent.end(), 0u);
+    auto const find = [&](unsigned v) {
+        while (parent[v] != v) {
+            parent[v] = parent[parent[v]];
+            v = parent[v];
+        }
+        return v;
+    };
+    auto const position_of = [&](unsigned v) {
+        return glm::dvec3(glm::vec3(vertices[v].position));
+    };
+
+    // Triangles are kept as their original corners, so that corners which never
+    // collapse keep their own attributes.
+    std::vector<std::array<unsigned, 3>> corners(indices.size() / 3);
+    for (std::size_t i = 0; i < corners.size(); ++i) {
+        corners[i] = {indices[i * 3], indices[(i * 3) + 1],
+                      indices[(i * 3) + 2]};
+    }
+
+    auto const welded_corners = [&](std::array<unsigned, 3> const& triangle) {
+        return std::array{find(weld[triangle[0]]), find(weld[triangle[1]]),
+                          find(weld[triangle[2]])};
+    };
+
+    // Accumulate the planes of every triangle around each welded vertex.
+    std::vector<quadric> quadrics(vertices.size());
+    std::vector<edge> edges;
+    for (auto const& triangle : corners) {
+        auto const welded = welded_corners(triangle);
+        glm::dvec3 const a = position_of(welded[0]);
+        glm::dvec3 const b = position_of(welded[1]);
+        glm::dvec3 const c = position_of(welded[2]);
+        glm::dvec3 const normal = glm::cross(b - a, c - a);
+        if (glm::length(normal) == 0.0) {
+            continue;
+        }
+        glm::dvec3 const unit_normal = glm::normalize(normal);
+        quadric const plane =
+            quadric::from_plane(unit_normal, -glm::dot(unit_normal, a), 1.0);
+        for (unsigned corner : welded) {
+            quadrics[corner] += plane;
+        }
+
+        // Remember directed edges to find the boundary.
+        for (std::size_t i = 0; i < 3; ++i) {
+            edges.push_back({welded[i], welded[(i + 1) % 3], 0.0});
+        }
+    }
+
+    // An edge is on the boundary when its reverse does not exist.
+    auto const edge_less = [](edge const& a, edge const& b) {
+        return std::tie(a.from, a.to) < std::tie(b.from, b.to);
+    };
+    std::ranges::sort(edges, edge_less);
+    for (auto const& triangle : corners) {
+        auto const welded = welded_corners(triangle);
+        glm::dvec3 const a = position_of(welded[0]);
+        glm::dvec3 const b = position_of(welded[1]);
+        glm::dvec3 const c = position_of(welded[2]);
+        glm::dvec3 const triangle_normal = glm::cross(b - a, c - a);
+
+        for (std::size_t i = 0; i < 3; ++i) {
+            unsigned const from = welded[i];
+            unsigned const to = welded[(i + 1) % 3];
+            if (std::ranges::binary_search(edges, edge{to, from, 0.0},
+                                           edge_less)) {
+                continue;
+            }
+
+            glm::dvec3 const normal = glm::cross(
+                position_of(to) - position_of(from), triangle_normal);
+            if (glm::length(normal) == 0.0) {
+                continue;
+            }
+            glm::dvec3 const unit_normal = glm::normalize(normal);
+            quadric const plane = quadric::from_plane(
+                unit_normal, -glm::dot(unit_normal, position_of(from)),
+                boundary_weight);
+            quadrics[from] += plane;
+            quadrics[to] += plane;
+        }
+    }
+
+    double max_cost = 0.0;
+    std::size_t live_triangles = corners.size();
+    std::vector<bool> dead(corners.size(), false);
+    std::vector<bool> locked(vertices.size());
+    std::vector<std::array<unsigned, 3>> welded_triangles;
+    adjacency adjacent;
+
+    // Would moving `from` onto `to` turn any triangle around `from` over?
+    auto const flips = [&](unsigned from, unsigned to) {
+        for (unsigned t : adjacent.of(from)) {
+            if (dead[t]) {
+                continue;
+            }
+            auto const welded = welded_corners(corners[t]);
+            if (std::ranges::find(welded, to) != welded.end()) {
+                // This triangle degenerates instead.
+                continue;
+            }
+            std::array<glm::dvec3, 3> before;
+            std::array<glm::dvec3, 3> after;
+            for (std::size_t i = 0; i < 3; ++i) {
+                before[i] = position_of(welded[i]);
+                after[i] = (welded[i] == from) ? position_of(to) : before[i];
+            }
+            glm::dvec3 const normal_before =
+                glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::dvec3 const normal_after =
+                glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normal_before, normal_after) <= 0.0) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Each pass collapses the cheapest edges that do not touch each other.
+    while (live_triangles * 3 > target_index_count) {
+        welded_triangles.clear();
+        for (std::size_t t = 0; t < corners.size(); ++t) {
+            welded_triangles.push_back(dead[t] ? std::array{0u, 0u, 0u}
+                                               : welded_corners(corners[t]));
+        }
+        adjacent.build(vertices.size(), welded_triangles);
+
+        edges.clear();
+        for (std::size_t t = 0; t < corners.size(); ++t) {
+            if (dead[t]) {
+                continue;
+            }
+            auto const& welded = welded_triangles[t];
+            for (std::size_t i = 0; i < 3; ++i) {
+                unsigned const a = welded[i];
+                unsigned const b = welded[(i + 1) % 3];
+                quadric combined = quadrics[a];
+                combined += quadrics[b];
+                double const a_cost = combined.error(position_of(b));
+                double const b_cost = combined.error(position_of(a));
+                edges.push_back((a_cost <= b_cost) ? edge{a, b, a_cost}
+                                                   : edge{b, a, b_cost});
+            }
+        }
+        std::ranges::sort(edges, {}, &edge::cost);
+
+        std::ranges::fill(locked, false);
+        std::size_t collapses = 0;
+        for (edge const& e : edges) {
+            if (live_triangles * 3 <= target_index_count) {
+                break;
+            }
+            if (locked[e.from] || locked[e.to] || flips(e.from, e.to)) {
+                continue;
+            }
+
+            parent[e.from] = e.to;
+            quadrics[e.to] += quadrics[e.from];
+            max_cost = std::max(max_cost, e.cost);
+            ++collapses;
+
+            // Triangles around `from` changed shape, so none of their
+            // vertices may collapse again this pass.
+            for (unsigned t : adjacent.of(e.from)) {
+                if (dead[t]) {
+                    continue;
+                }
+                auto const welded = welded_corners(corners[t]);
+                for (unsigned corner : welded) {
+                    locked[corner] = true;
+                }
+                if (welded[0] == welded[1] || welded[1] == welded[2] ||
+                    welded[0] == welded[2]) {
+                    dead[t] = true;
+                    --live_triangles;
+                }
+            }
+            locked[e.from] = true;
+            locked[e.to] = true;
+        }
+
+        if (collapses == 0) {
+            break;
+        }
+    }
+
+    simplified_indices result;
+    result.indices.reserve(live_triangles * 3);
+    result.error = static_cast<float>(std::sqrt(max_cost));
+    for (std::size_t t = 0; t < corners.size(); ++t) {
+        if (dead[t]) {
+            continue;
+        }
+        for (unsigned corner : corners[t]) {
+            // Corners that collapsed take on the vertex they collapsed into.
+            unsigned const target = find(weld[corner]);
+            result.indices.push_back((target == weld[corner]) ? corner
+                                                              : target);
+        }
+    }
+    return result;
+}
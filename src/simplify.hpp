@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+struct vertex;
+
+struct simplified_indices {
+    std::vector<unsigned> indices;
+
+    // Roughly the furthest that simplification moved the surface, in model
+    // space.
+    float error;
+};
+
+// Reduce a triangle list towards `target_index_count` indices by collapsing
+// edges with the least quadric error. No vertices are created, so the result
+// indexes into the same `vertices`. Vertices that share a position are welded,
+// so seams between faces with different normals do not block collapses.
+auto simplify(std::span<vertex const> vertices,
+              std::span<unsigned const> indices,
+              std::size_t target_index_count) -> simplified_indices;
@@ -0,0 +1,129 @@
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cpu_profiler.hpp"
+
+namespace {
+// Held controls move the camera by this many units per second.
+constexpr float move_speed = 2.f;
+// Held controls turn the camera by this many radians per second.
+constexpr float turn_speed = 1.f;
+
+constexpr float tick_seconds = 1.f / simulation::ticks_per_second;
+
+// After a stall longer than this, such as a breakpoint, ticks resume from the
+// current time instead of catching up.
+constexpr auto max_lag = std::chrono::milliseconds(250);
+
+// -1 if only `negative` is held, 1 if only `positive` is, and 0 otherwise.
+auto get_axis(std::uint32_t held, std::uint32_t negative,
+              std::uint32_t positive) -> float {
+    return static_cast<float>((held & positive) != 0) -
+           static_cast<float>((held & negative) != 0);
+}
+}  // namespace
+
+void simulation::set_camera(camera_t const& camera) {
+    m_current.camera = camera;
+    m_previous.camera = camera;
+    m_snapshots.reset({m_previous, m_current, clock::now()});
+}
+
+void simulation::add_spinning_instance(instance_handle handle, glm::vec3 axis,
+                                       float radians_per_second) {
+    m_spinning_instances.push_back({
+        .handle = handle,
+        .step = glm::angleAxis(radians_per_second * tick_seconds,
+                               glm::normalize(axis)),
+    });
+    glm::quat const rotation = g_scene.get(handle).rotation;
+    m_current.rotations.push_back(rotation);
+    m_previous.rotations.push_back(rotation);
+    // Every slot holds as many rotations as ticks publish, so that they are
+    // copied without allocating.
+    m_snapshots.reset({m_previous, m_current, clock::now()});
+}
+
+void simulation::start() {
+    m_thread = std::jthread([this](std::stop_token const& stop) {
+        clock::time_point next_tick = clock::now();
+        while (!stop.stop_requested()) {
+            tick();
+            next_tick += tick_interval;
+            clock::time_point const now = clock::now();
+            if (now - next_tick > max_lag) {
+                next_tick = now;
+            }
+            std::this_thread::sleep_until(next_tick);
+        }
+    });
+}
+
+void simulation::stop() {
+    // `std::jthread` requests a stop and joins when it is replaced.
+    m_thread = {};
+}
+
+void simulation::tick() {
+    cpu_zone("simulation tick");
+    m_previous = m_current;
+
+    std::uint32_t const held =
+        m_held_controls.load(std::memory_order_relaxed);
+    camera_t& camera = m_current.camera;
+    camera.position +=
+        glm::vec3{
+            get_axis(held, get_bit(control::left), get_bit(control::right)),
+            get_axis(held, get_bit(control::down), get_bit(control::up)),
+            get_axis(held, get_bit(control::forward),
+                     get_bit(control::backward)),
+        } *
+        (move_speed * tick_seconds);
+    camera.yaw += get_axis(held, get_bit(control::turn_left),
+                           get_bit(control::turn_right)) *
+                  (turn_speed * tick_seconds);
+
+    for (std::size_t i = 0; i < m_spinning_instances.size(); ++i) {
+        m_current.rotations[i] = glm::normalize(
+            m_spinning_instances[i].step * m_current.rotations[i]);
+    }
+
+    snapshot& back = m_snapshots.get_back();
+    back.previous = m_previous;
+    back.current = m_current;
+    back.current_time = clock::now();
+    m_snapshots.publish();
+}
+
+void simulation::apply_interpolated(clock::time_point now) {
+    m_snapshots.update();
+    using seconds = std::chrono::duration<float>;
+    float const weight =
+        seconds(now - m_snapshots.get_front().current_time) /
+        seconds(tick_interval);
+    apply(std::clamp(weight, 0.f, 1.f));
+}
+
+void simulation::apply_latest() {
+    m_snapshots.update();
+    apply(1.f);
+}
+
+void simulation::apply(float weight) {
+    simulation_state const& previous = m_snapshots.get_front().previous;
+    simulation_state const& current = m_snapshots.get_front().current;
+
+    g_camera.position =
+        glm::mix(previous.camera.position, current.camera.position, weight);
+    g_camera.pitch = std::lerp(previous.camera.pitch, current.camera.pitch,
+                               weight);
+    g_camera.yaw = std::lerp(previous.camera.yaw, current.camera.yaw, weight);
+
+    for (std::size_t i = 0; i < m_spinning_instances.size(); ++i) {
+        g_scene.set_rotation(m_spinning_instances[i].handle,
+                             glm::slerp(previous.rotations[i],
+                                        current.rotations[i], weight));
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/vec3.hpp>
+
+#include "camera.hpp"
+#include "scene.hpp"
+#include "triple_buffer.hpp"
+
+// Inputs which the window holds down, and which the simulation reads once per
+// tick.
+enum class control : std::uint8_t {
+    forward,
+    backward,
+    left,
+    right,
+    up,
+    down,
+    turn_left,
+    turn_right,
+};
+
+// Everything which a tick of the simulation changes.
+struct simulation_state {
+    camera_t camera;
+    // The rotation of each spinning instance, in the order they were added.
+    std::vector<glm::quat> rotations;
+};
+
+// Advances the camera and animations at a fixed rate, independently of how
+// fast frames render. On its own thread, each tick is published through a
+// triple buffer together with the tick before it, and the render thread
+// interpolates between the two, so neither thread blocks the other. Headless
+// runs instead tick once per frame on the render thread, so that their frames
+// are reproducible.
+class simulation {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr unsigned ticks_per_second = 60;
+    static constexpr clock::duration tick_interval =
+        std::chrono::duration_cast<clock::duration>(std::chrono::seconds(1)) /
+        ticks_per_second;
+
+    // These must be called before `.start()`.
+    void set_camera(camera_t const& camera);
+    void add_spinning_instance(instance_handle handle, glm::vec3 axis,
+                               float radians_per_second);
+
+    // Tick on a new thread until `.stop()`.
+    void start();
+    void stop();
+
+    // Advance by one tick and publish it. This must not be called while the
+    // simulation's thread runs.
+    void tick();
+
+    // The window calls these from the render thread.
+    void press(control input) {
+        m_held_controls.fetch_or(get_bit(input), std::memory_order_relaxed);
+    }
+    void release(control input) {
+        m_held_controls.fetch_and(~get_bit(input), std::memory_order_relaxed);
+    }
+
+    // Set `g_camera` and the spinning instances in `g_scene` to where they
+    // were at `now`, between the newest two ticks.
+    void apply_interpolated(clock::time_point now);
+
+    // Set `g_camera` and the spinning instances in `g_scene` to the newest
+    // tick.
+    void apply_latest();
+
+  private:
+    struct spinning_instance {
+        instance_handle handle;
+        // The rotation of each tick.
+        glm::quat step;
+    };
+
+    // What the render thread takes from the triple buffer.
+    struct snapshot {
+        simulation_state previous;
+        simulation_state current;
+        // When `current` was simulated.
+        clock::time_point current_time;
+    };
+
+    [[nodiscard]]
+    static auto get_bit(control input) -> std::uint32_t {
+        return 1u << static_cast<unsigned>(input);
+    }
+
+    // Blend the newest two ticks by `weight` from the older one.
+    void apply(float weight);
+
+    std::vector<spinning_instance> m_spinning_instances;
+    // Only the simulation's thread uses these while it runs.
+    simulation_state m_previous;
+    simulation_state m_current;
+    std::atomic<std::uint32_t> m_held_controls = 0;
+    triple_buffer<snapshot> m_snapshots;
+    std::jthread m_thread;
+};
+
+inline simulation g_simulation;
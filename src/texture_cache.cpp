@@ -0,0 +1,227 @@
+#include "texture_cache.hpp"
+
+#include <array>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif _WIN32
+#include <windows.h>
+#endif
+
+#include "defer.hpp"
+#include "globals.hpp"
+
+namespace {
+// This is changed whenever the layout of cache files changes.
+constexpr std::uint64_t cache_magic = 0x31'58'54'43'41'45'44'47;
+
+// Staging memory is aligned like `texture_loader` stages levels.
+constexpr std::size_t data_alignment = 16;
+
+// 64-bit FNV-1a.
+constexpr std::uint64_t fnv_offset_basis = 14'695'981'039'346'656'037u;
+constexpr std::uint64_t fnv_prime = 1'099'511'628'211u;
+
+auto hash_bytes(std::span<std::byte const> bytes,
+                std::uint64_t hash = fnv_offset_basis) -> std::uint64_t {
+    for (std::byte const byte : bytes) {
+        hash = (hash ^ static_cast<std::uint64_t>(byte)) * fnv_prime;
+    }
+    return hash;
+}
+
+template <typename T>
+auto hash_value(T const& value, std::uint64_t hash) -> std::uint64_t {
+    return hash_bytes(std::as_bytes(std::span(&value, 1)), hash);
+}
+
+auto get_cache_path(std::uint64_t key) -> std::filesystem::path {
+    return getexepath().parent_path() / "texture_cache" /
+           std::format("{:016x}.bin", key);
+}
+}  // namespace
+
+#ifdef __linux__
+mapped_file::mapped_file(std::filesystem::path const& path) {
+    int const file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+    defer {
+        close(file);
+    };
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        return;
+    }
+    void* const p_data = mmap(nullptr, static_cast<std::size_t>(status.st_size),
+                              PROT_READ, MAP_PRIVATE, file, 0);
+    if (p_data == MAP_FAILED) {
+        return;
+    }
+    m_p_data = static_cast<std::byte const*>(p_data);
+    m_size = static_cast<std::size_t>(status.st_size);
+}
+
+void mapped_file::unmap() {
+    if (m_p_data != nullptr) {
+        munmap(const_cast<std::byte*>(m_p_data), m_size);
+    }
+}
+#elif _WIN32
+mapped_file::mapped_file(std::filesystem::path const& path) {
+    HANDLE const file =
+        CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    defer {
+        CloseHandle(file);
+    };
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        return;
+    }
+    // The view keeps the mapping alive after its handle is closed.
+    HANDLE const mapping =
+        CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        return;
+    }
+    defer {
+        CloseHandle(mapping);
+    };
+
+    void* const p_data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (p_data == nullptr) {
+        return;
+    }
+    m_p_data = static_cast<std::byte const*>(p_data);
+    m_size = static_cast<std::size_t>(size.QuadPart);
+}
+
+void mapped_file::unmap() {
+    if (m_p_data != nullptr) {
+        UnmapViewOfFile(m_p_data);
+    }
+}
+#endif
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : m_p_data(std::exchange(other.m_p_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {
+}
+
+auto mapped_file::operator=(mapped_file&& other) noexcept -> mapped_file& {
+    if (this != &other) {
+        unmap();
+        m_p_data = std::exchange(other.m_p_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file() {
+    unmap();
+}
+
+auto get_texture_cache_key(std::span<std::byte const> source,
+                           ktx_transcode_fmt_e format) -> std::uint64_t {
+    // A different driver could choose different image layouts, so that is
+    // part of the key as well as the device.
+    VkPhysicalDeviceProperties const& device = g_physical_device.properties;
+    std::uint64_t key = hash_bytes(source);
+    key = hash_value(format, key);
+    key = hash_value(device.vendorID, key);
+    key = hash_value(device.deviceID, key);
+    key = hash_value(device.driverVersion, key);
+    key = hash_bytes(std::as_bytes(std::span(device.pipelineCacheUUID)), key);
+    return key;
+}
+
+auto read_cached_texture(std::uint64_t key) -> std::optional<cached_texture> {
+    mapped_file file(get_cache_path(key));
+    std::span<std::byte const> const bytes = file.get_bytes();
+    if (bytes.size() < sizeof(cached_texture_header)) {
+        return std::nullopt;
+    }
+
+    cached_texture_header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    std::size_t const regions_size =
+        header.region_count * sizeof(vk::BufferImageCopy);
+    if (header.magic != cache_magic || header.key != key ||
+        sizeof(header) + regions_size > header.data_offset ||
+        header.data_offset + header.data_size != bytes.size()) {
+        return std::nullopt;
+    }
+
+    // Regions directly follow the header, which keeps them aligned.
+    static_assert(sizeof(cached_texture_header) %
+                      alignof(vk::BufferImageCopy) ==
+                  0);
+    std::span const regions(
+        reinterpret_cast<vk::BufferImageCopy const*>(bytes.data() +
+                                                     sizeof(header)),
+        header.region_count);
+    std::span const data = bytes.subspan(header.data_offset, header.data_size);
+    return cached_texture{.file = std::move(file),
+                          .header = header,
+                          .regions = regions,
+                          .data = data};
+}
+
+void write_cached_texture(cached_texture_header const& header,
+                          std::span<vk::BufferImageCopy const> regions,
+                          std::span<std::byte const> data) {
+    std::filesystem::path const path = get_cache_path(header.key);
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    cached_texture_header written = header;
+    written.magic = cache_magic;
+    written.region_count = static_cast<std::uint32_t>(regions.size());
+    std::size_t const regions_end = sizeof(written) + regions.size_bytes();
+    written.data_offset =
+        (regions_end + data_alignment - 1) & ~(data_alignment - 1);
+    written.data_size = data.size();
+
+    // Another worker could be writing the same entry, so this only becomes
+    // visible once it is complete.
+    std::filesystem::path temporary_path = path;
+    temporary_path += std::format(
+        ".{}", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream file(temporary_path, std::ios::binary);
+        std::array<char, data_alignment> const padding{};
+        file.write(reinterpret_cast<char const*>(&written), sizeof(written));
+        file.write(reinterpret_cast<char const*>(regions.data()),
+                   static_cast<std::streamsize>(regions.size_bytes()));
+        file.write(padding.data(), static_cast<std::streamsize>(
+                                       written.data_offset - regions_end));
+        file.write(reinterpret_cast<char const*>(data.data()),
+                   static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporary_path, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::filesystem::remove(temporary_path, error);
+    }
+}
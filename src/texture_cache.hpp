@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include <ktx.h>
+
+// A read-only mapping of a whole file into memory.
+class mapped_file {
+  public:
+    mapped_file() = default;
+
+    // This is empty if `path` cannot be opened.
+    explicit mapped_file(std::filesystem::path const& path);
+
+    mapped_file(mapped_file&& other) noexcept;
+    auto operator=(mapped_file&& other) noexcept -> mapped_file&;
+    ~mapped_file();
+
+    [[nodiscard]]
+    auto get_bytes() const -> std::span<std::byte const> {
+        return {m_p_data, m_size};
+    }
+
+  private:
+    void unmap();
+
+    std::byte const* m_p_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+// Textures which `texture_loader` transcoded are cached on disk, so that later
+// runs copy them into staging memory without transcoding again. Each cache
+// file starts with this, followed by its copy regions, then its staging memory
+// at `data_offset`.
+struct cached_texture_header {
+    std::uint64_t magic;
+    std::uint64_t key;
+    // How long the source texture took to read and transcode, which a cache
+    // hit saves.
+    std::uint64_t load_nanoseconds;
+    vk::Format format;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t level_count;
+    std::uint32_t face_count;
+    std::uint32_t region_count;
+    std::uint64_t data_offset;
+    std::uint64_t data_size;
+};
+
+struct cached_texture {
+    // This keeps the other members valid.
+    mapped_file file;
+    cached_texture_header header;
+    std::span<vk::BufferImageCopy const> regions;
+    std::span<std::byte const> data;
+};
+
+// A hash of a source texture's contents, the format that it is transcoded
+// into, and `g_physical_device`, so that a cache entry is only used for the
+// same texture on the same device and driver.
+[[nodiscard]]
+auto get_texture_cache_key(std::span<std::byte const> source,
+                           ktx_transcode_fmt_e format) -> std::uint64_t;
+
+// Map the cache entry for `key`. This is empty if there is none, or if it was
+// written by another version of this format.
+[[nodiscard]]
+auto read_cached_texture(std::uint64_t key) -> std::optional<cached_texture>;
+
+// Store a cache entry for `header.key`. This can be called from several
+// threads at once, since each entry is written to a temporary file and then
+// renamed.
+void write_cached_texture(cached_texture_header const& header,
+                          std::span<vk::BufferImageCopy const> regions,
+                          std::span<std::byte const> data);
@@ -0,0 +1,466 @@
+#include "texture_loader.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <optional>
+
+#include "cpu_profiler.hpp"
+#include "defer.hpp"
+#include "texture_cache.hpp"
+
+namespace {
+// Each level is staged at a multiple of this, which is a multiple of every
+// texel block size.
+constexpr std::size_t level_alignment = 16;
+
+auto align_level(std::size_t offset) -> std::size_t {
+    return (offset + level_alignment - 1) & ~(level_alignment - 1);
+}
+
+auto is_sampleable(vk::Format format) -> bool {
+    vk::FormatProperties const properties =
+        vk::PhysicalDevice(g_physical_device.physical_device)
+            .getFormatProperties(format);
+    return static_cast<bool>(properties.optimalTilingFeatures &
+                             vk::FormatFeatureFlagBits::eSampledImage);
+}
+}  // namespace
+
+auto get_transcode_format() -> ktx_transcode_fmt_e {
+    // These are in order of quality for their size.
+    if (is_sampleable(vk::Format::eBc7UnormBlock)) {
+        return KTX_TTF_BC7_RGBA;
+    }
+    if (is_sampleable(vk::Format::eAstc4x4UnormBlock)) {
+        return KTX_TTF_ASTC_4x4_RGBA;
+    }
+    if (is_sampleable(vk::Format::eEtc2R8G8B8A8UnormBlock)) {
+        return KTX_TTF_ETC2_RGBA;
+    }
+    return KTX_TTF_RGBA32;
+}
+
+void texture_loader::start() {
+    vk::CommandPoolCreateInfo pool_info;
+    pool_info.setQueueFamilyIndex(g_transfer_queues_index);
+    m_transfer_pool = g_device.createCommandPoolUnique(pool_info);
+
+    vk::SemaphoreTypeCreateInfo timeline_info(vk::SemaphoreType::eTimeline, 0);
+    vk::SemaphoreCreateInfo semaphore_info;
+    semaphore_info.setPNext(&timeline_info);
+    m_timeline = g_device.createSemaphoreUnique(semaphore_info);
+
+    m_placeholder_2d = make_placeholder(vk::ImageViewType::e2D);
+    m_placeholder_cube = make_placeholder(vk::ImageViewType::eCube);
+}
+
+void texture_loader::stop() {
+    for (auto& p_request : m_requests) {
+        g_jobs.wait(p_request->counter);
+    }
+    g_transfer_queue.waitIdle();
+
+    m_acquires.clear();
+    m_requests.clear();
+    m_placeholder_2d = {};
+    m_placeholder_cube = {};
+    m_timeline.reset();
+    m_transfer_pool.reset();
+}
+
+auto texture_loader::load(std::filesystem::path const& path,
+                          vk::ImageViewType view_type) -> texture_handle {
+    request& r = *m_requests.emplace_back(std::make_unique<request>());
+    r.path = path;
+    r.view_type = view_type;
+    g_jobs.submit(r, 0, 1, r.counter);
+    return {static_cast<std::uint32_t>(m_requests.size() - 1)};
+}
+
+auto texture_loader::stage(std::filesystem::path const& path)
+    -> texture_handle {
+    request& r = *m_requests.emplace_back(std::make_unique<request>());
+    r.path = path;
+    r.view_type = vk::ImageViewType::e2D;
+    r.is_staged_only = true;
+    g_jobs.submit(r, 0, 1, r.counter);
+    return {static_cast<std::uint32_t>(m_requests.size() - 1)};
+}
+
+auto texture_loader::get_staged(texture_handle handle) const
+    -> staged_levels {
+    request const& r = *m_requests[handle.index];
+    assert(r.state == load_state::staged);
+    return {
+        .format = r.format,
+        .buffer = r.staging.buffer(),
+        .size = r.staging.size(),
+        .regions = r.regions,
+    };
+}
+
+auto texture_loader::poll() -> bool {
+    cpu_zone("poll textures");
+    std::uint64_t const completed_value =
+        g_device.getSemaphoreCounterValue(*m_timeline);
+    bool is_any_loaded = false;
+
+    for (auto& p_request : m_requests) {
+        request& r = *p_request;
+        switch (r.state) {
+            case load_state::transcoding:
+                if (r.counter.pending.load(std::memory_order_acquire) != 0) {
+                    break;
+                }
+                if (r.is_staged_only) {
+                    r.state = load_state::staged;
+                    is_any_loaded = true;
+                } else {
+                    submit_transfer(r);
+                }
+                break;
+            case load_state::transferring:
+                if (completed_value >= r.transfer_value) {
+                    acquire(r);
+                    g_device.freeCommandBuffers(*m_transfer_pool,
+                                                r.transfer_cmd);
+                    r.staging = {};
+                    r.state = load_state::resident;
+                    is_any_loaded = true;
+                }
+                break;
+            case load_state::resident:
+            case load_state::staged:
+                break;
+        }
+    }
+    return is_any_loaded;
+}
+
+auto texture_loader::is_loading() const -> bool {
+    return std::ranges::any_of(m_requests, [](auto const& p_request) {
+        return !is_loaded(*p_request);
+    });
+}
+
+auto texture_loader::get_cache_hit_count() const -> std::size_t {
+    return static_cast<std::size_t>(
+        std::ranges::count_if(m_requests, [](auto const& p_request) {
+            return is_loaded(*p_request) && p_request->is_cached;
+        }));
+}
+
+auto texture_loader::get_cache_saved_time() const -> std::chrono::nanoseconds {
+    std::chrono::nanoseconds saved_time{};
+    for (auto const& p_request : m_requests) {
+        if (is_loaded(*p_request) && p_request->is_cached) {
+            saved_time += p_request->saved_time;
+        }
+    }
+    return saved_time;
+}
+
+auto texture_loader::get_view(texture_handle handle) const -> vk::ImageView {
+    request const& r = *m_requests[handle.index];
+    if (r.state == load_state::resident) {
+        return *r.view;
+    }
+    return (r.view_type == vk::ImageViewType::eCube) ? *m_placeholder_cube.view
+                                                     : *m_placeholder_2d.view;
+}
+
+void texture_loader::request::operator()(std::size_t, std::size_t) {
+    cpu_zone("load texture");
+    auto const start_time = std::chrono::steady_clock::now();
+
+    mapped_file const source(path);
+    assert(!source.get_bytes().empty());
+    ktx_transcode_fmt_e const transcode_format = get_transcode_format();
+    std::uint64_t const key =
+        get_texture_cache_key(source.get_bytes(), transcode_format);
+
+    if (std::optional<cached_texture> cached = read_cached_texture(key)) {
+        cached_texture_header const& header = cached->header;
+        format = header.format;
+        extent = vk::Extent2D(header.width, header.height);
+        level_count = header.level_count;
+        face_count = header.face_count;
+        regions.assign(cached->regions.begin(), cached->regions.end());
+
+        // The cache holds staging memory as it is laid out below.
+        staging = device_buffer(vk::BufferUsageFlagBits::eTransferSrc,
+                                cached->data.size(),
+                                vk::MemoryPropertyFlagBits::eHostVisible |
+                                    vk::MemoryPropertyFlagBits::eHostCoherent);
+        std::memcpy(staging.map(), cached->data.data(), cached->data.size());
+
+        is_cached = true;
+        saved_time = std::chrono::nanoseconds(header.load_nanoseconds) -
+                     (std::chrono::steady_clock::now() - start_time);
+        return;
+    }
+
+    ktxTexture2* p_ktx;
+    ktx_error_code_e result = ktxTexture2_CreateFromMemory(
+        reinterpret_cast<ktx_uint8_t const*>(source.get_bytes().data()),
+        source.get_bytes().size(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+        &p_ktx);
+    assert(result == KTX_SUCCESS);
+    defer {
+        ktxTexture2_Destroy(p_ktx);
+    };
+
+    if (ktxTexture2_NeedsTranscoding(p_ktx)) {
+        result = ktxTexture2_TranscodeBasis(p_ktx, transcode_format, 0);
+        assert(result == KTX_SUCCESS);
+    }
+    assert(p_ktx->numDimensions == 2 && p_ktx->numLayers == 1);
+    assert((view_type == vk::ImageViewType::eCube) == (p_ktx->numFaces == 6));
+
+    format = static_cast<vk::Format>(ktxTexture2_GetVkFormat(p_ktx));
+    extent = vk::Extent2D(p_ktx->baseWidth, p_ktx->baseHeight);
+    level_count = p_ktx->numLevels;
+    face_count = p_ktx->numFaces;
+
+    std::size_t staging_size = 0;
+    for (std::uint32_t level = 0; level < level_count; ++level) {
+        staging_size = align_level(
+            staging_size +
+            (ktxTexture_GetImageSize(ktxTexture(p_ktx), level) * face_count));
+    }
+    staging = device_buffer(vk::BufferUsageFlagBits::eTransferSrc,
+                            staging_size,
+                            vk::MemoryPropertyFlagBits::eHostVisible |
+                                vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    // Stage every face of every level, which are copied as one region each.
+    auto* const p_staging = static_cast<std::byte*>(staging.map());
+    std::size_t staging_offset = 0;
+    for (std::uint32_t level = 0; level < level_count; ++level) {
+        ktx_size_t const image_size =
+            ktxTexture_GetImageSize(ktxTexture(p_ktx), level);
+        for (std::uint32_t face = 0; face < face_count; ++face) {
+            ktx_size_t image_offset;
+            ktxTexture_GetImageOffset(ktxTexture(p_ktx), level, 0, face,
+                                      &image_offset);
+            std::memcpy(p_staging + staging_offset,
+                        ktxTexture_GetData(ktxTexture(p_ktx)) + image_offset,
+                        image_size);
+
+            vk::BufferImageCopy region;
+            region.setBufferOffset(staging_offset)
+                .setImageSubresource(
+                    {vk::ImageAspectFlagBits::eColor, level, face, 1})
+                .setImageExtent({std::max(extent.width >> level, 1u),
+                                 std::max(extent.height >> level, 1u), 1});
+            regions.push_back(region);
+            staging_offset = align_level(staging_offset + image_size);
+        }
+    }
+
+    // Staging memory is written straight into the cache, so that a later run
+    // can copy it back just as directly.
+    auto const load_time = std::chrono::steady_clock::now() - start_time;
+    write_cached_texture(
+        {.key = key,
+         .load_nanoseconds = static_cast<std::uint64_t>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(load_time)
+                 .count()),
+         .format = format,
+         .width = extent.width,
+         .height = extent.height,
+         .level_count = level_count,
+         .face_count = face_count},
+        regions, std::span(p_staging, staging_size));
+}
+
+void texture_loader::submit_transfer(request& r) {
+    bool const is_cube = r.view_type == vk::ImageViewType::eCube;
+
+    vk::ImageCreateInfo image_info;
+    image_info
+        .setFlags(is_cube ? vk::ImageCreateFlagBits::eCubeCompatible
+                          : vk::ImageCreateFlags{})
+        .setImageType(vk::ImageType::e2D)
+        .setFormat(r.format)
+        .setExtent({r.extent.width, r.extent.height, 1})
+        .setMipLevels(r.level_count)
+        .setArrayLayers(r.face_count)
+        .setUsage(vk::ImageUsageFlagBits::eSampled |
+                  vk::ImageUsageFlagBits::eTransferDst);
+    r.image = g_device.createImageUnique(image_info);
+
+    vk::MemoryRequirements const requirements =
+        g_device.getImageMemoryRequirements(*r.image);
+    vk::MemoryAllocateInfo allocate_info;
+    allocate_info.setAllocationSize(requirements.size)
+        .setMemoryTypeIndex(find_memory_type(
+            requirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal));
+    r.memory = g_device.allocateMemoryUnique(allocate_info);
+    g_device.bindImageMemory(*r.image, *r.memory, 0);
+
+    vk::ImageSubresourceRange const range(vk::ImageAspectFlagBits::eColor, 0,
+                                          r.level_count, 0, r.face_count);
+    vk::ImageViewCreateInfo view_info;
+    view_info.setImage(*r.image)
+        .setViewType(r.view_type)
+        .setFormat(image_info.format)
+        .setSubresourceRange(range);
+    r.view = g_device.createImageViewUnique(view_info);
+
+    vk::ImageMemoryBarrier to_transfer;
+    to_transfer.setImage(*r.image)
+        .setSubresourceRange(range)
+        .setOldLayout(vk::ImageLayout::eUndefined)
+        .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+
+    // With separate queue families, this releases the image to the graphics
+    // queue, which acquires it in `acquire()`.
+    vk::ImageMemoryBarrier release = to_transfer;
+    release.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask({});
+    if (g_transfer_queues_index != g_graphics_queues_index) {
+        release.setSrcQueueFamilyIndex(g_transfer_queues_index)
+            .setDstQueueFamilyIndex(g_graphics_queues_index);
+    }
+
+    vk::CommandBufferAllocateInfo cmd_info(*m_transfer_pool,
+                                           vk::CommandBufferLevel::ePrimary, 1);
+    r.transfer_cmd = g_device.allocateCommandBuffers(cmd_info).front();
+    vk::CommandBuffer const cmd = r.transfer_cmd;
+    cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                        vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
+                        to_transfer);
+    cmd.copyBufferToImage(r.staging.buffer(), *r.image,
+                          vk::ImageLayout::eTransferDstOptimal, r.regions);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {},
+                        release);
+    cmd.end();
+
+    ++m_submitted_value;
+    r.transfer_value = m_submitted_value;
+    vk::TimelineSemaphoreSubmitInfo timeline_info;
+    timeline_info.setSignalSemaphoreValues(r.transfer_value);
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBuffers(cmd)
+        .setSignalSemaphores(*m_timeline)
+        .setPNext(&timeline_info);
+    g_transfer_queue.submit(submit_info);
+
+    // Only the staging memory is needed until the copy finishes.
+    r.regions = {};
+    r.state = load_state::transferring;
+}
+
+void texture_loader::acquire(request& r) {
+    if (g_transfer_queues_index == g_graphics_queues_index) {
+        return;
+    }
+
+    vk::ImageMemoryBarrier barrier;
+    barrier.setImage(*r.image)
+        .setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0,
+                              vk::RemainingMipLevels, 0,
+                              vk::RemainingArrayLayers})
+        .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setSrcQueueFamilyIndex(g_transfer_queues_index)
+        .setDstQueueFamilyIndex(g_graphics_queues_index)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+    m_acquires.push_back(barrier);
+}
+
+void texture_loader::record_acquires(vk::CommandBuffer cmd) {
+    if (m_acquires.empty()) {
+        return;
+    }
+    // The copies already finished, so this does not wait on the timeline.
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                        vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {},
+                        m_acquires);
+    m_acquires.clear();
+}
+
+auto texture_loader::make_placeholder(vk::ImageViewType view_type)
+    -> placeholder {
+    bool const is_cube = view_type == vk::ImageViewType::eCube;
+    std::uint32_t const layer_count = is_cube ? 6 : 1;
+
+    vk::ImageCreateInfo image_info;
+    image_info
+        .setFlags(is_cube ? vk::ImageCreateFlagBits::eCubeCompatible
+                          : vk::ImageCreateFlags{})
+        .setImageType(vk::ImageType::e2D)
+        .setFormat(vk::Format::eR8G8B8A8Unorm)
+        .setExtent({1, 1, 1})
+        .setMipLevels(1)
+        .setArrayLayers(layer_count)
+        .setUsage(vk::ImageUsageFlagBits::eSampled |
+                  vk::ImageUsageFlagBits::eTransferDst);
+
+    placeholder result;
+    result.image = g_device.createImageUnique(image_info);
+    vk::MemoryRequirements const requirements =
+        g_device.getImageMemoryRequirements(*result.image);
+    vk::MemoryAllocateInfo allocate_info;
+    allocate_info.setAllocationSize(requirements.size)
+        .setMemoryTypeIndex(find_memory_type(
+            requirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal));
+    result.memory = g_device.allocateMemoryUnique(allocate_info);
+    g_device.bindImageMemory(*result.image, *result.memory, 0);
+
+    vk::ImageSubresourceRange const range(vk::ImageAspectFlagBits::eColor, 0,
+                                          1, 0, layer_count);
+    vk::ImageViewCreateInfo view_info;
+    view_info.setImage(*result.image)
+        .setViewType(view_type)
+        .setFormat(image_info.format)
+        .setSubresourceRange(range);
+    result.view = g_device.createImageViewUnique(view_info);
+
+    vk::ImageMemoryBarrier to_transfer;
+    to_transfer.setImage(*result.image)
+        .setSubresourceRange(range)
+        .setOldLayout(vk::ImageLayout::eUndefined)
+        .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+    vk::ImageMemoryBarrier to_shader = to_transfer;
+    to_shader.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+    // A 2D placeholder does not tint what it is multiplied with, and a
+    // skybox which is not loaded yet is dark.
+    vk::ClearColorValue const color =
+        is_cube ? vk::ClearColorValue(0.f, 0.f, 0.f, 1.f)
+                : vk::ClearColorValue(1.f, 1.f, 1.f, 1.f);
+
+    vk::CommandBuffer const cmd = g_upload_command_buffer;
+    cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                        vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
+                        to_transfer);
+    cmd.clearColorImage(*result.image, vk::ImageLayout::eTransferDstOptimal,
+                        color, range);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {},
+                        to_shader);
+    cmd.end();
+
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBuffers(cmd);
+    g_graphics_queue.submit(submit_info);
+    g_graphics_queue.waitIdle();
+    return result;
+}
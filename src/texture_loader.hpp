@@ -0,0 +1,186 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <ktx.h>
+
+#include "device_buffer.hpp"
+#include "globals.hpp"
+#include "jobs.hpp"
+
+// The block-compressed format which supercompressed KTX2 textures are
+// transcoded into, which is the best one that `g_physical_device` samples.
+[[nodiscard]]
+auto get_transcode_format() -> ktx_transcode_fmt_e;
+
+// Refers to a texture requested from a `texture_loader`.
+struct texture_handle {
+    std::uint32_t index;
+};
+
+// Loads KTX2 textures without blocking the frame. Files are read and
+// transcoded into staging memory by `g_jobs`, then copied on the transfer
+// queue, whose completion is tracked by a timeline semaphore. Transcoded
+// textures are cached on disk by `texture_cache.hpp`. Until a texture
+// is resident, a placeholder of the same view type is bound in its place.
+// Textures which are only staged keep their staging memory instead, for
+// `texture_residency` to stream their levels from.
+class texture_loader {
+  public:
+    void start();
+
+    // Wait for every pending load, then free every texture.
+    void stop();
+
+    // Begin loading a texture, which must be a cube map if `view_type` is
+    // `eCube`, and 2D otherwise.
+    [[nodiscard]]
+    auto load(std::filesystem::path const& path,
+              vk::ImageViewType view_type = vk::ImageViewType::e2D)
+        -> texture_handle;
+
+    // Begin reading and transcoding a 2D texture into staging memory, which
+    // is kept for the caller to copy levels from rather than copied into an
+    // image. Its view is always the placeholder.
+    [[nodiscard]]
+    auto stage(std::filesystem::path const& path) -> texture_handle;
+
+    // Where each level of a staged texture is in its staging memory.
+    struct staged_levels {
+        vk::Format format = vk::Format::eUndefined;
+        vk::Buffer buffer;
+        std::size_t size = 0;
+        // One region for each level, from the finest.
+        std::span<vk::BufferImageCopy const> regions;
+    };
+
+    // Submit the copies of textures which finished transcoding, and make the
+    // textures whose copies finished resident. This returns whether any
+    // texture finished loading, in which case descriptors must be updated.
+    [[nodiscard]]
+    auto poll() -> bool;
+
+    // Record the graphics queue's acquisitions of every texture which became
+    // resident since the last call, before any pass samples them. This must
+    // be called by each frame which might bind their new descriptors.
+    void record_acquires(vk::CommandBuffer cmd);
+
+    [[nodiscard]]
+    auto is_resident(texture_handle handle) const -> bool {
+        return m_requests[handle.index]->state == load_state::resident;
+    }
+
+    [[nodiscard]]
+    auto is_staged(texture_handle handle) const -> bool {
+        return m_requests[handle.index]->state == load_state::staged;
+    }
+
+    // This must only be called once `.is_staged(handle)`, and stays valid
+    // until `.stop()`.
+    [[nodiscard]]
+    auto get_staged(texture_handle handle) const -> staged_levels;
+
+    // Whether any texture is not resident or staged yet.
+    [[nodiscard]]
+    auto is_loading() const -> bool;
+
+    // How many resident textures were read from the disk cache, rather than
+    // transcoded.
+    [[nodiscard]]
+    auto get_cache_hit_count() const -> std::size_t;
+
+    // The transcoding time which the disk cache saved across every resident
+    // texture.
+    [[nodiscard]]
+    auto get_cache_saved_time() const -> std::chrono::nanoseconds;
+
+    // This is a placeholder until the texture is resident. Either way, its
+    // layout is `eShaderReadOnlyOptimal`.
+    [[nodiscard]]
+    auto get_view(texture_handle handle) const -> vk::ImageView;
+
+  private:
+    enum class load_state : std::uint8_t {
+        transcoding,
+        transferring,
+        resident,
+        // Textures from `.stage()` end here instead of transferring.
+        staged,
+    };
+
+    struct request {
+        // This runs on a worker, and only writes the members from `format`
+        // to `saved_time`.
+        void operator()(std::size_t, std::size_t);
+
+        std::filesystem::path path;
+        vk::ImageViewType view_type;
+        bool is_staged_only = false;
+        job_counter counter;
+
+        vk::Format format;
+        vk::Extent2D extent;
+        std::uint32_t level_count;
+        std::uint32_t face_count;
+        device_buffer staging;
+        std::vector<vk::BufferImageCopy> regions;
+        bool is_cached = false;
+        // How much sooner this was staged than it would have been without the
+        // cache.
+        std::chrono::nanoseconds saved_time{};
+
+        load_state state = load_state::transcoding;
+        std::uint64_t transfer_value = 0;
+        vk::CommandBuffer transfer_cmd;
+        vk::UniqueImage image;
+        vk::UniqueDeviceMemory memory;
+        vk::UniqueImageView view;
+    };
+
+    // Whether `r` finished loading, either way.
+    [[nodiscard]]
+    static auto is_loaded(request const& r) -> bool {
+        return r.state == load_state::resident ||
+               r.state == load_state::staged;
+    }
+
+    // Create `r`'s image and copy its staging memory into it.
+    void submit_transfer(request& r);
+
+    // Take ownership of `r`'s image on the graphics queue with the next
+    // `.record_acquires()`.
+    void acquire(request& r);
+
+    // A 1x1 image of `view_type`, which is either 2D or a cube.
+    struct placeholder {
+        vk::UniqueImage image;
+        vk::UniqueDeviceMemory memory;
+        vk::UniqueImageView view;
+    };
+
+    [[nodiscard]]
+    static auto make_placeholder(vk::ImageViewType view_type) -> placeholder;
+
+    // `request` cannot be moved while a job refers to it.
+    std::vector<std::unique_ptr<request>> m_requests;
+
+    vk::UniqueCommandPool m_transfer_pool;
+    vk::UniqueSemaphore m_timeline;
+    std::uint64_t m_submitted_value = 0;
+    // Ownership transfers which the next frame records.
+    std::vector<vk::ImageMemoryBarrier> m_acquires;
+
+    placeholder m_placeholder_2d;
+    placeholder m_placeholder_cube;
+};
+
+inline texture_loader g_texture_loader;
+inline texture_handle g_skybox_texture;
@@ -0,0 +1,287 @@
+#include "texture_residency.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <memory_resource>
+#include <utility>
+
+#include "arena.hpp"
+#include "bindless.hpp"
+#include "cpu_profiler.hpp"
+#include "gpu_profiler.hpp"
+#include "vulkan_flow.hpp"
+
+namespace {
+// Fragment shaders leave a texture's feedback at this if they never sampled
+// it.
+constexpr std::uint32_t unsampled = no_texture_index;
+}  // namespace
+
+void texture_residency::create() {
+    for (std::size_t i = 0; i < max_frames_in_flight; ++i) {
+        m_feedback[i] =
+            device_buffer(vk::BufferUsageFlagBits::eTransferDst,
+                          max_mesh_textures * sizeof(std::uint32_t),
+                          vk::MemoryPropertyFlagBits::eHostVisible |
+                              vk::MemoryPropertyFlagBits::eHostCoherent);
+        auto* const p_feedback =
+            static_cast<std::uint32_t*>(m_feedback[i].map());
+        std::fill_n(p_feedback, max_mesh_textures, unsampled);
+        m_p_feedback[i] = p_feedback;
+    }
+}
+
+void texture_residency::destroy() {
+    m_streams.clear();
+    m_unrecorded = {};
+    m_retired = {};
+    m_textures.clear();
+    m_first_mips.clear();
+    m_feedback = {};
+}
+
+auto texture_residency::add(std::filesystem::path const& path)
+    -> std::uint32_t {
+    assert(m_textures.size() < max_mesh_textures);
+
+    m_textures.push_back({.source = g_texture_loader.stage(path)});
+    // The placeholder has only one level.
+    m_first_mips.push_back(0);
+    auto const index = static_cast<std::uint32_t>(m_textures.size() - 1);
+    update_mesh_texture_descriptor(index);
+    return index;
+}
+
+void texture_residency::update(unsigned frame) {
+    cpu_zone("texture residency");
+    if (m_textures.empty()) {
+        return;
+    }
+
+    // Finer levels of newly staged textures are streamed in once they are
+    // seen.
+    for (std::uint32_t i = 0; i < m_textures.size(); ++i) {
+        texture& tex = m_textures[i];
+        if (!tex.levels.regions.empty() ||
+            !g_texture_loader.is_staged(tex.source)) {
+            continue;
+        }
+        tex.levels = g_texture_loader.get_staged(tex.source);
+        assert(!tex.levels.regions.empty());
+        make_resident(
+            i, static_cast<std::uint32_t>(tex.levels.regions.size() - 1));
+    }
+
+    read_feedback(frame);
+
+    // Textures keep their resident levels unless they need finer ones, so
+    // that levels are not streamed out and back in as the camera moves.
+    m_target_mips.resize(m_textures.size());
+    std::size_t total_size = 0;
+    for (std::size_t i = 0; i < m_textures.size(); ++i) {
+        m_target_mips[i] =
+            std::min(m_wanted_mips[i], m_first_mips[i]);
+        total_size += get_levels_size(m_textures[i], m_target_mips[i]);
+    }
+
+    auto const evict = [&](std::size_t index, std::uint32_t first_mip) {
+        total_size -= get_levels_size(m_textures[index], m_target_mips[index]);
+        m_target_mips[index] = first_mip;
+        total_size += get_levels_size(m_textures[index], first_mip);
+    };
+
+    // Over the budget, first evict the levels which were not sampled.
+    for (std::size_t i = 0;
+         i < m_textures.size() && total_size > texture_budget_size; ++i) {
+        if (m_target_mips[i] < m_wanted_mips[i]) {
+            evict(i, m_wanted_mips[i]);
+        }
+    }
+
+    // Then coarsen whichever texture takes the most memory.
+    while (total_size > texture_budget_size) {
+        std::size_t largest = m_textures.size();
+        std::size_t largest_size = 0;
+        for (std::size_t i = 0; i < m_textures.size(); ++i) {
+            std::size_t const size =
+                get_levels_size(m_textures[i], m_target_mips[i]);
+            if (m_target_mips[i] + 1 < m_textures[i].levels.regions.size() &&
+                size > largest_size) {
+                largest = i;
+                largest_size = size;
+            }
+        }
+        if (largest == m_textures.size()) {
+            // Only the coarsest levels are left.
+            break;
+        }
+        evict(largest, m_target_mips[largest] + 1);
+    }
+
+    unsigned streamed_count = 0;
+    for (std::uint32_t i = 0; i < m_textures.size(); ++i) {
+        if (m_target_mips[i] == m_first_mips[i]) {
+            continue;
+        }
+        if (streamed_count == max_streams_per_update) {
+            break;
+        }
+        make_resident(i, m_target_mips[i]);
+        ++streamed_count;
+    }
+}
+
+auto texture_residency::get_levels_size(texture const& tex,
+                                        std::uint32_t first_mip)
+    -> std::size_t {
+    // Levels are staged from the finest, so the ones from `first_mip` are
+    // together at the end.
+    if (first_mip >= tex.levels.regions.size()) {
+        return 0;
+    }
+    return tex.levels.size - tex.levels.regions[first_mip].bufferOffset;
+}
+
+void texture_residency::make_resident(std::uint32_t index,
+                                      std::uint32_t first_mip) {
+    texture& tex = m_textures[index];
+    std::span<vk::BufferImageCopy const> const staged_regions =
+        tex.levels.regions.subspan(first_mip);
+    auto const level_count =
+        static_cast<std::uint32_t>(staged_regions.size());
+
+    vk::ImageCreateInfo image_info;
+    image_info.setImageType(vk::ImageType::e2D)
+        .setFormat(tex.levels.format)
+        .setExtent(staged_regions.front().imageExtent)
+        .setMipLevels(level_count)
+        .setArrayLayers(1)
+        .setUsage(vk::ImageUsageFlagBits::eSampled |
+                  vk::ImageUsageFlagBits::eTransferDst);
+    vk::UniqueImage image = g_device.createImageUnique(image_info);
+
+    vk::MemoryRequirements const requirements =
+        g_device.getImageMemoryRequirements(*image);
+    vk::MemoryAllocateInfo allocate_info;
+    allocate_info.setAllocationSize(requirements.size)
+        .setMemoryTypeIndex(find_memory_type(
+            requirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal));
+    vk::UniqueDeviceMemory memory =
+        g_device.allocateMemoryUnique(allocate_info);
+    g_device.bindImageMemory(*image, *memory, 0);
+
+    // Every level which becomes resident is copied straight from the
+    // loader's staging memory, into the image's level counted from
+    // `first_mip`.
+    std::vector<vk::BufferImageCopy> regions(staged_regions.begin(),
+                                             staged_regions.end());
+    for (vk::BufferImageCopy& region : regions) {
+        region.imageSubresource.mipLevel -= first_mip;
+    }
+
+    vk::ImageSubresourceRange const all_levels(vk::ImageAspectFlagBits::eColor,
+                                               0, level_count, 0, 1);
+    vk::ImageViewCreateInfo view_info;
+    view_info.setImage(*image)
+        .setViewType(vk::ImageViewType::e2D)
+        .setFormat(image_info.format)
+        .setSubresourceRange(all_levels);
+
+    m_streams.push_back({
+        .image = *image,
+        .level_count = level_count,
+        .regions = std::move(regions),
+        .staging = tex.levels.buffer,
+    });
+
+    // Frames in flight might still sample the old image.
+    if (tex.image) {
+        m_unrecorded.images.push_back({
+            .memory = std::move(tex.memory),
+            .image = std::move(tex.image),
+            .view = std::move(tex.view),
+        });
+    }
+
+    m_resident_size -= tex.resident_size;
+    tex.view = g_device.createImageViewUnique(view_info);
+    tex.image = std::move(image);
+    tex.memory = std::move(memory);
+    m_first_mips[index] = first_mip;
+    tex.resident_size = requirements.size;
+    m_resident_size += tex.resident_size;
+
+    update_mesh_texture_descriptor(index);
+
+    // Textures which were added since the last layout are written by
+    // `buffer_storage::push_properties()` instead.
+    if (index < g_bindless_data.get_textures_count()) {
+        g_bindless_data.set_texture_first_mip(index, first_mip);
+    }
+}
+
+void texture_residency::record_streaming(vk::CommandBuffer cmd,
+                                         unsigned frame) {
+    m_retired[frame] = std::exchange(m_unrecorded, {});
+    if (m_streams.empty()) {
+        return;
+    }
+    gpu_scope(cmd, "texture streaming");
+
+    // Every image is transitioned by one barrier before and after the copies.
+    std::pmr::vector<vk::ImageMemoryBarrier> to_transfer(&get_frame_arena());
+    std::pmr::vector<vk::ImageMemoryBarrier> to_shader(&get_frame_arena());
+    to_transfer.reserve(m_streams.size());
+    to_shader.reserve(m_streams.size());
+    for (stream const& streamed : m_streams) {
+        vk::ImageMemoryBarrier barrier;
+        barrier.setImage(streamed.image)
+            .setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0,
+                                  streamed.level_count, 0, 1})
+            .setOldLayout(vk::ImageLayout::eUndefined)
+            .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+        to_transfer.push_back(barrier);
+
+        barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+        to_shader.push_back(barrier);
+    }
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                        vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
+                        to_transfer);
+    for (stream const& streamed : m_streams) {
+        cmd.copyBufferToImage(streamed.staging, streamed.image,
+                              vk::ImageLayout::eTransferDstOptimal,
+                              streamed.regions);
+    }
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {},
+                        to_shader);
+    m_streams.clear();
+}
+
+void texture_residency::read_feedback(unsigned frame) {
+    // Only textures which were laid out when that frame was recorded have
+    // feedback.
+    auto const reported_count = std::min<std::size_t>(
+        g_bindless_data.get_textures_count(), m_textures.size());
+
+    m_wanted_mips.resize(m_textures.size());
+    for (std::size_t i = 0; i < m_textures.size(); ++i) {
+        // Textures which are not staged yet have no levels to want.
+        if (i >= reported_count || m_textures[i].levels.regions.empty()) {
+            m_wanted_mips[i] = m_first_mips[i];
+            continue;
+        }
+
+        // Unsampled textures only need their coarsest level.
+        auto const level_count = static_cast<std::uint32_t>(
+            m_textures[i].levels.regions.size());
+        m_wanted_mips[i] = std::min(m_p_feedback[frame][i], level_count - 1);
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "device_buffer.hpp"
+#include "globals.hpp"
+#include "texture_loader.hpp"
+
+// This matches the size of binding 4 of `g_descriptor_layout`.
+inline constexpr std::uint32_t max_mesh_textures = 1'024;
+
+// GPU memory which resident mesh texture levels should fit in. This is set by
+// `TEXTURE_BUDGET` in `../CMakeLists.txt`.
+inline constexpr std::size_t texture_budget_size = texture_budget;
+
+// Mesh textures whose mip levels are streamed onto the GPU as they are needed.
+// Every frame, fragment shaders report the finest level that they sampled from
+// each texture, and `.update()` makes those levels resident as far as the
+// budget allows. Textures are staged by `g_texture_loader`, which shows its
+// placeholder until then, and afterwards their coarsest level is always
+// resident.
+class texture_residency {
+  public:
+    // Create the buffers which feedback is read back into.
+    void create();
+
+    void destroy();
+
+    // Begin loading a KTX2 texture with a full mip chain, and return its index
+    // for `mesh_instance::texture_index`. Every level stays in staging memory,
+    // so that evicted levels can be streamed in again without reading the
+    // file.
+    [[nodiscard]]
+    auto add(std::filesystem::path const& path) -> std::uint32_t;
+
+    // Stream levels in and out according to the feedback of frame slot
+    // `frame`'s last frame, which must have finished. Images are replaced at
+    // once, but their levels are only copied by `.record_streaming()`.
+    void update(unsigned frame);
+
+    // Record the copies of every image which was replaced since the last call
+    // into frame slot `frame`'s command buffer, before any pass samples them.
+    // The slot's last frame must have finished, so the images which it
+    // retired are released.
+    void record_streaming(vk::CommandBuffer cmd, unsigned frame);
+
+    [[nodiscard]]
+    auto size() const -> std::size_t {
+        return m_textures.size();
+    }
+
+    // The finest mip level of each texture which is resident, which is level
+    // 0 of its image.
+    [[nodiscard]]
+    auto get_first_mips() const -> std::span<std::uint32_t const> {
+        return m_first_mips;
+    }
+
+    [[nodiscard]]
+    auto get_view(std::size_t index) const -> vk::ImageView {
+        texture const& tex = m_textures[index];
+        return tex.view ? *tex.view : g_texture_loader.get_view(tex.source);
+    }
+
+    // Frame `frame`'s feedback is copied into this.
+    [[nodiscard]]
+    auto get_feedback_buffer(std::size_t frame) const -> vk::Buffer {
+        return m_feedback[frame].buffer();
+    }
+
+    // The bytes of every resident level.
+    [[nodiscard]]
+    auto get_resident_size() const -> std::size_t {
+        return m_resident_size;
+    }
+
+  private:
+    struct texture {
+        texture_handle source;
+        // This has no levels until the source is staged.
+        texture_loader::staged_levels levels;
+        std::size_t resident_size;
+        vk::UniqueImage image;
+        vk::UniqueDeviceMemory memory;
+        vk::UniqueImageView view;
+    };
+
+    // An image whose levels were staged, but not copied yet.
+    struct stream {
+        vk::Image image;
+        std::uint32_t level_count;
+        std::vector<vk::BufferImageCopy> regions;
+        vk::Buffer staging;
+    };
+
+    // What frames in flight might still use. Images are replaced while
+    // earlier frames sample them.
+    struct retired_resources {
+        struct retired_image {
+            vk::UniqueDeviceMemory memory;
+            vk::UniqueImage image;
+            vk::UniqueImageView view;
+        };
+        std::vector<retired_image> images;
+    };
+
+    // The staging size of `tex`'s levels from `first_mip` to its last.
+    [[nodiscard]]
+    static auto get_levels_size(texture const& tex, std::uint32_t first_mip)
+        -> std::size_t;
+
+    // Replace texture `index`'s image with one holding its levels from
+    // `first_mip`, which are staged for the next `.record_streaming()`. The
+    // old image is retired.
+    void make_resident(std::uint32_t index, std::uint32_t first_mip);
+
+    // Fill `m_wanted_mips` from frame slot `frame`'s feedback.
+    void read_feedback(unsigned frame);
+
+    // Only a few textures are streamed each update, to bound the copies of
+    // one frame.
+    static constexpr unsigned max_streams_per_update = 4;
+
+    std::vector<texture> m_textures;
+    // These are indexed like `m_textures`, and kept apart from them so that
+    // the bindless data copies them at once.
+    std::vector<std::uint32_t> m_first_mips;
+
+    // These are reused by each update.
+    std::vector<std::uint32_t> m_wanted_mips;
+    std::vector<std::uint32_t> m_target_mips;
+
+    std::vector<stream> m_streams;
+    // Resources retired since the last `.record_streaming()`, which are then
+    // handed to its frame slot.
+    retired_resources m_unrecorded;
+    // Each frame slot's are released when it records again, since every
+    // frame submitted before its last one has then finished too.
+    std::array<retired_resources, max_frames_in_flight> m_retired;
+
+    std::array<device_buffer, max_frames_in_flight> m_feedback;
+    std::array<std::uint32_t const*, max_frames_in_flight> m_p_feedback{};
+
+    std::size_t m_resident_size = 0;
+};
+
+inline texture_residency g_mesh_textures;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Hands the newest of a stream of values from one writing thread to one
+// reading thread without locking. The writer fills the back slot and swaps it
+// with the middle one, and the reader swaps the middle slot with the front one
+// when it holds a newer value, so neither thread ever waits on the other, and
+// values are never copied between slots.
+template <typename T>
+class triple_buffer {
+  public:
+    // Set every slot to `value`. Neither thread may be using the buffer.
+    void reset(T const& value) {
+        m_slots.fill(value);
+        m_back = 0;
+        m_middle.store(1, std::memory_order_relaxed);
+        m_front = 2;
+    }
+
+    // The slot which the writer fills before `.publish()`.
+    [[nodiscard]]
+    auto get_back() -> T& {
+        return m_slots[m_back];
+    }
+
+    // Make the back slot the newest value, replacing one which the reader has
+    // not taken yet.
+    void publish() {
+        m_back = m_middle.exchange(m_back | fresh_bit,
+                                   std::memory_order_acq_rel) &
+                 index_mask;
+    }
+
+    // Take the newest value, if one was published since the last call. This
+    // returns whether the front slot changed.
+    auto update() -> bool {
+        if ((m_middle.load(std::memory_order_relaxed) & fresh_bit) == 0) {
+            return false;
+        }
+        m_front =
+            m_middle.exchange(m_front, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    // The slot which the reader took last.
+    [[nodiscard]]
+    auto get_front() const -> T const& {
+        return m_slots[m_front];
+    }
+
+  private:
+    // The middle index holds a value which the reader has not taken yet.
+    static constexpr unsigned fresh_bit = 0b100;
+    static constexpr unsigned index_mask = 0b11;
+
+    std::array<T, 3> m_slots{};
+    // Only the writer uses this.
+    unsigned m_back = 0;
+    std::atomic<unsigned> m_middle = 1;
+    // Only the reader uses this.
+    unsigned m_front = 2;
+};
@@ -1,9 +1,91 @@
 #include "vulkan_flow.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <memory_resource>
+#include <optional>
+#include <span>
+
+#include "arena.hpp"
 #include "bindless.hpp"
+#include "cpu_profiler.hpp"
+#include "device_buffer.hpp"
 #include "globals.hpp"
+#include "gpu_profiler.hpp"
 #include "light.hpp"
 #include "shader_objects.hpp"
+#include "texture_loader.hpp"
+#include "texture_residency.hpp"
+
+// The bindless data writes draws without Vulkan's headers.
+static_assert(sizeof(draw_indexed_command) ==
+              sizeof(vk::DrawIndexedIndirectCommand));
+
+namespace {
+// Swapchain formats can rarely be stored to, so compositing writes into this
+// instead, at the render extent, and it is upscaled onto the swapchain image.
+// It stays in the general layout for both.
+struct composite_image_t {
+    vk::UniqueImage image;
+    vk::UniqueDeviceMemory memory;
+    vk::UniqueImageView view;
+};
+
+composite_image_t g_composite_image;
+
+constexpr auto composite_format = vk::Format::eR16G16B16A16Sfloat;
+
+// Descriptor changes which a frame slot's descriptors have not received yet.
+// Each slot's descriptors are only written when it records its next frame,
+// once the frames which read them have finished.
+struct pending_descriptors {
+    bool is_all_stale = true;
+    std::vector<unsigned> light_maps;
+    std::vector<std::uint32_t> mesh_textures;
+};
+
+std::array<pending_descriptors, max_frames_in_flight> g_pending_descriptors;
+
+// Buffers which frames in flight might still read, by the frame slot which
+// replaced them. A slot's are released once its fence signals again, since
+// every frame submitted before it has then finished too.
+std::array<std::vector<device_buffer>, max_frames_in_flight>
+    g_retired_buffers;
+
+// Whole uploads are copied through the frame slot's staging buffer, which
+// is reused, and only replaced when it is too small.
+struct staging_buffer {
+    device_buffer buffer;
+    std::byte* p_mapped = nullptr;
+};
+
+std::array<staging_buffer, max_frames_in_flight> g_staging_buffers;
+
+// The copies which `upload_bindless_data()` staged for a frame, which
+// `record_frame()` records before any pass reads the bindless buffer.
+struct pending_upload {
+    unsigned frame = 0;
+    // This is allocated from the frame's arena, and empty once recorded.
+    std::optional<std::pmr::vector<vk::BufferCopy>> regions;
+};
+
+pending_upload g_pending_upload;
+
+// Frame slot `frame`'s staging buffer, grown to hold at least `size` bytes.
+// The slot's last frame must have finished.
+auto get_staging_buffer(unsigned frame, std::size_t size) -> staging_buffer& {
+    staging_buffer& staging = g_staging_buffers[frame];
+    if (staging.buffer.size() < size) {
+        staging.buffer = device_buffer(
+            vk::BufferUsageFlagBits::eTransferSrc,
+            std::max(size, staging.buffer.size() * 2),
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent);
+        staging.p_mapped = static_cast<std::byte*>(staging.buffer.map());
+    }
+    return staging;
+}
+}  // namespace
 
 auto make_device(vkb::Instance instance, vk::SurfaceKHR surface) -> vk::Device {
     vk::PhysicalDeviceFeatures vulkan_1_0_features;
@@ -12,10 +94,21 @@ auto make_device(vkb::Instance instance, vk::SurfaceKHR surface) -> vk::Device {
     vulkan_1_0_features.setVertexPipelineStoresAndAtomics(vk::True);
     vulkan_1_0_features.setFragmentStoresAndAtomics(vk::True);
 
+    // Vertex shaders read the first instance of their draw.
+    vk::PhysicalDeviceVulkan11Features vulkan_1_1_features{};
+    vulkan_1_1_features.setShaderDrawParameters(vk::True);
+
     vk::PhysicalDeviceVulkan12Features vulkan_1_2_features{};
     vulkan_1_2_features.setDrawIndirectCount(vk::True);
     vulkan_1_2_features.setBufferDeviceAddress(vk::True);
     vulkan_1_2_features.setRuntimeDescriptorArray(vk::True);
+    // Mesh textures are indexed per instance, and only some are written.
+    vulkan_1_2_features.setShaderSampledImageArrayNonUniformIndexing(vk::True);
+    vulkan_1_2_features.setDescriptorBindingPartiallyBound(vk::True);
+    vulkan_1_2_features.setDescriptorBindingSampledImageUpdateAfterBind(
+        vk::True);
+    // Textures are copied on the transfer queue, which is polled for.
+    vulkan_1_2_features.setTimelineSemaphore(vk::True);
 
     vkb::PhysicalDeviceSelector physical_device_selector(instance);
     physical_device_selector.add_required_extension("VK_KHR_dynamic_rendering")
@@ -24,10 +117,14 @@ auto make_device(vkb::Instance instance, vk::SurfaceKHR surface) -> vk::Device {
         .add_required_extension("VK_KHR_buffer_device_address")
         .add_required_extension("VK_KHR_multiview")
         .set_required_features(vulkan_1_0_features)
+        .set_required_features_11(vulkan_1_1_features)
         .set_required_features_12(vulkan_1_2_features);
 
-    auto maybe_physical_device =
-        physical_device_selector.set_surface(surface).select();
+    // Headless instances do not need a surface.
+    if (surface) {
+        physical_device_selector.set_surface(surface);
+    }
+    auto maybe_physical_device = physical_device_selector.select();
     if (!maybe_physical_device) {
         std::cout << maybe_physical_device.error().message() << '\n';
         std::quick_exit(1);
@@ -35,8 +132,87 @@ auto make_device(vkb::Instance instance, vk::SurfaceKHR surface) -> vk::Device {
     g_physical_device = *maybe_physical_device;
     std::cout << g_physical_device.name << '\n';
 
+    VkPhysicalDeviceFeatures statistics_feature{};
+    statistics_feature.pipelineStatisticsQuery = vk::True;
+    g_has_pipeline_statistics =
+        g_physical_device.enable_features_if_present(statistics_feature);
+    g_has_calibrated_timestamps = g_physical_device.enable_extension_if_present(
+        VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+    // Only task and mesh shaders themselves are used from `VK_EXT_mesh_shader`.
+    vk::PhysicalDeviceMeshShaderFeaturesEXT mesh_shader_feature;
+    if (g_physical_device.enable_extension_if_present(
+            VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        vk::PhysicalDeviceFeatures2 features;
+        features.setPNext(&mesh_shader_feature);
+        vk::PhysicalDevice(g_physical_device.physical_device)
+            .getFeatures2(&features);
+        g_has_mesh_shaders =
+            mesh_shader_feature.taskShader && mesh_shader_feature.meshShader;
+
+        vk::PhysicalDeviceMeshShaderPropertiesEXT mesh_shader_properties;
+        vk::PhysicalDeviceProperties2 properties;
+        properties.setPNext(&mesh_shader_properties);
+        vk::PhysicalDevice(g_physical_device.physical_device)
+            .getProperties2(&properties);
+        g_max_task_work_group_total_count =
+            mesh_shader_properties.maxTaskWorkGroupTotalCount;
+    }
+    mesh_shader_feature = vk::PhysicalDeviceMeshShaderFeaturesEXT{};
+    mesh_shader_feature.setTaskShader(vk::True).setMeshShader(vk::True);
+
+    // Descriptors fall back onto a pool-allocated set without
+    // `VK_EXT_descriptor_buffer`.
+    vk::PhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_feature;
+    if (g_physical_device.enable_extension_if_present(
+            VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+        vk::PhysicalDeviceFeatures2 features;
+        features.setPNext(&descriptor_buffer_feature);
+        vk::PhysicalDevice(g_physical_device.physical_device)
+            .getFeatures2(&features);
+        g_has_descriptor_buffer = descriptor_buffer_feature.descriptorBuffer;
+    }
+    descriptor_buffer_feature = vk::PhysicalDeviceDescriptorBufferFeaturesEXT{};
+    descriptor_buffer_feature.setDescriptorBuffer(vk::True);
+
+    // Frames are paced by waiting for earlier frames' presents, which are
+    // identified with `VK_KHR_present_id`.
+    vk::PhysicalDevicePresentIdFeaturesKHR present_id_feature;
+    vk::PhysicalDevicePresentWaitFeaturesKHR present_wait_feature;
+    if (surface && g_physical_device.enable_extensions_if_present(
+                       {VK_KHR_PRESENT_ID_EXTENSION_NAME,
+                        VK_KHR_PRESENT_WAIT_EXTENSION_NAME})) {
+        present_id_feature.setPNext(&present_wait_feature);
+        vk::PhysicalDeviceFeatures2 features;
+        features.setPNext(&present_id_feature);
+        vk::PhysicalDevice(g_physical_device.physical_device)
+            .getFeatures2(&features);
+        g_has_present_wait =
+            present_id_feature.presentId && present_wait_feature.presentWait;
+    }
+    present_id_feature = vk::PhysicalDevicePresentIdFeaturesKHR{};
+    present_id_feature.setPresentId(vk::True);
+    present_wait_feature = vk::PhysicalDevicePresentWaitFeaturesKHR{};
+    present_wait_feature.setPresentWait(vk::True);
+
+    // Chain only the optional features which are supported.
+    void* p_optional_features = nullptr;
+    if (g_has_mesh_shaders) {
+        mesh_shader_feature.setPNext(p_optional_features);
+        p_optional_features = &mesh_shader_feature;
+    }
+    if (g_has_descriptor_buffer) {
+        descriptor_buffer_feature.setPNext(p_optional_features);
+        p_optional_features = &descriptor_buffer_feature;
+    }
+    if (g_has_present_wait) {
+        present_wait_feature.setPNext(p_optional_features);
+        present_id_feature.setPNext(&present_wait_feature);
+        p_optional_features = &present_id_feature;
+    }
+
     vk::PhysicalDeviceDynamicRenderingFeatures dynamic_rendering_feature(
-        vk::True);
+        vk::True, p_optional_features);
     vk::PhysicalDeviceDepthClipEnableFeaturesEXT depth_clipping(
         vk::True, &dynamic_rendering_feature);
     vk::PhysicalDeviceShaderObjectFeaturesEXT shader_object_feature(
@@ -55,11 +231,34 @@ auto make_device(vkb::Instance instance, vk::SurfaceKHR surface) -> vk::Device {
     g_graphics_queue = *device.get_queue(vkb::QueueType::graphics);
     g_graphics_queues_index = *device.get_queue_index(vkb::QueueType::graphics);
 
-    g_present_queue = *device.get_queue(vkb::QueueType::present);
-    g_present_queue_index = *device.get_queue_index(vkb::QueueType::present);
+    // Without a surface, nothing is presented.
+    if (surface) {
+        g_present_queue = *device.get_queue(vkb::QueueType::present);
+        g_present_queue_index =
+            *device.get_queue_index(vkb::QueueType::present);
+    }
+
+    // Without a separate transfer queue, textures are copied on the graphics
+    // queue.
+    auto maybe_transfer_queue = device.get_queue(vkb::QueueType::transfer);
+    if (maybe_transfer_queue) {
+        g_transfer_queue = *maybe_transfer_queue;
+        g_transfer_queues_index =
+            *device.get_queue_index(vkb::QueueType::transfer);
+    } else {
+        g_transfer_queue = g_graphics_queue;
+        g_transfer_queues_index = g_graphics_queues_index;
+    }
 
-    g_swapchain_builder = vkb::SwapchainBuilder{device};
-    g_swapchain_builder->set_required_min_image_count(max_frames_in_flight);
+    if (surface) {
+        // One more image than frames in flight lets a frame render while the
+        // others wait to be presented.
+        g_swapchain_builder = vkb::SwapchainBuilder{device};
+        g_swapchain_builder->set_required_min_image_count(g_frames_in_flight)
+            .set_desired_min_image_count(g_frames_in_flight + 1)
+            .set_desired_present_mode(
+                static_cast<VkPresentModeKHR>(g_present_mode));
+    }
 
     return device.device;
 }
@@ -79,6 +278,13 @@ void create_first_swapchain() {
     g_swapchain = *maybe_swapchain;
     g_swapchain_images = *g_swapchain.get_images();
     g_swapchain_views = *g_swapchain.get_image_views();
+    g_image_in_flight.assign(g_swapchain_images.size(), nullptr);
+
+    // Surfaces which do not support `g_present_mode` fall back onto FIFO.
+    std::cout << "Presenting " << g_swapchain_images.size()
+              << " images with "
+              << vk::to_string(vk::PresentModeKHR(g_swapchain.present_mode))
+              << ".\n";
 }
 
 void create_command_pool() {
@@ -93,6 +299,9 @@ void create_command_buffers() {
     vk::CommandBufferAllocateInfo info{
         g_command_pool, vk::CommandBufferLevel::ePrimary, max_frames_in_flight};
     g_command_buffers = g_device.allocateCommandBuffers(info);
+
+    info.setCommandBufferCount(1);
+    g_upload_command_buffer = g_device.allocateCommandBuffers(info).front();
 }
 
 void create_sync_objects() {
@@ -113,9 +322,194 @@ void create_sync_objects() {
     }
 }
 
-void update_descriptors() {
+void create_device_local_buffer(std::size_t size) {
+    g_device_local_buffer =
+        device_buffer(vk::BufferUsageFlagBits::eStorageBuffer |
+                          vk::BufferUsageFlagBits::eTransferDst |
+                          vk::BufferUsageFlagBits::eVertexBuffer |
+                          vk::BufferUsageFlagBits::eIndexBuffer |
+                          vk::BufferUsageFlagBits::eIndirectBuffer |
+                          vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                      size);
+}
+
+// Reallocate `g_device_local_buffer` so that it fits `size` bytes, while
+// frame slot `frame` records.
+void grow_device_local_buffer(unsigned frame, std::size_t size) {
+    // Frames in flight might still read the old buffer through their
+    // descriptors, so it is released once they finished.
+    g_retired_buffers[frame].push_back(std::move(g_device_local_buffer));
+
+    create_device_local_buffer(std::max(size + device_buffer_headroom,
+                                        g_device_local_buffer.size() * 2));
+    update_descriptors();
+
+    // The new buffer is empty.
+    g_bindless_data.mark_all_dirty();
+}
+
+auto upload_bindless_data(unsigned frame) -> std::size_t {
+    cpu_zone("upload_bindless_data");
+
+    // A frame which was staged but never recorded was dropped, so its ranges
+    // are lost, and everything is uploaded again.
+    if (g_pending_upload.regions) {
+        g_bindless_data.mark_all_dirty();
+    }
+
+    if (g_bindless_data.size() > g_device_local_buffer.size()) {
+        grow_device_local_buffer(frame, g_bindless_data.size());
+    }
+
+    buffer_storage::dirty_range const whole = {0, g_bindless_data.size()};
+    std::span<buffer_storage::dirty_range const> const ranges =
+        g_bindless_data.is_all_dirty() ? std::span(&whole, 1)
+                                       : g_bindless_data.get_dirty_ranges();
+
+    std::size_t uploaded_bytes = 0;
+    for (auto [offset, size] : ranges) {
+        uploaded_bytes += size;
+    }
+
+    // Ranges are packed into the frame slot's staging buffer, and copied by
+    // the frame's own command buffer.
+    staging_buffer const& staging = get_staging_buffer(frame, uploaded_bytes);
+    std::pmr::vector<vk::BufferCopy> regions(&get_frame_arena());
+    regions.reserve(ranges.size());
+    std::size_t staging_offset = 0;
+    for (auto [offset, size] : ranges) {
+        if (size == 0) {
+            continue;
+        }
+        std::memcpy(staging.p_mapped + staging_offset,
+                    g_bindless_data.data() + offset, size);
+        regions.emplace_back(staging_offset, offset, size);
+        staging_offset += size;
+    }
+
+    g_pending_upload.frame = frame;
+    g_pending_upload.regions.emplace(std::move(regions));
+    g_bindless_data.clear_dirty();
+    return uploaded_bytes;
+}
+
+auto get_renderer_inputs() -> renderer_inputs {
+    return {
+        .visible_lights = g_lights.get_visible(),
+        .lights_capacity = g_lights.get_visible_capacity(),
+        .texture_first_mips = g_mesh_textures.get_first_mips(),
+    };
+}
+
+void create_composite_image() {
+    vk::ImageCreateInfo image_info;
+    image_info.setImageType(vk::ImageType::e2D)
+        .setFormat(composite_format)
+        .setExtent({max_render_width, max_render_height, 1})
+        .setMipLevels(1)
+        .setArrayLayers(1)
+        .setUsage(vk::ImageUsageFlagBits::eStorage |
+                  vk::ImageUsageFlagBits::eSampled);
+    g_composite_image.image = g_device.createImageUnique(image_info);
+
+    vk::MemoryRequirements const requirements =
+        g_device.getImageMemoryRequirements(*g_composite_image.image);
+    vk::MemoryAllocateInfo allocate_info;
+    allocate_info.setAllocationSize(requirements.size)
+        .setMemoryTypeIndex(
+            find_memory_type(requirements.memoryTypeBits,
+                             vk::MemoryPropertyFlagBits::eDeviceLocal));
+    g_composite_image.memory = g_device.allocateMemoryUnique(allocate_info);
+    g_device.bindImageMemory(*g_composite_image.image,
+                             *g_composite_image.memory, 0);
+
+    vk::ImageViewCreateInfo view_info;
+    view_info.setImage(*g_composite_image.image)
+        .setViewType(vk::ImageViewType::e2D)
+        .setFormat(composite_format)
+        .setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+    g_composite_image.view = g_device.createImageViewUnique(view_info);
+}
+
+void destroy_composite_image() {
+    g_composite_image = {};
+}
+
+void write_light_map_descriptor(unsigned frame, unsigned index) {
+    vk::ImageView const view = g_lights.get_map(index).imageView();
+    constexpr auto layout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+
+    if (g_has_descriptor_buffer) {
+        g_descriptor_buffers[frame].write_image(
+            2, index, g_nearest_neighbor_sampler, view, layout);
+        return;
+    }
+
+    vk::DescriptorImageInfo const image_info(g_nearest_neighbor_sampler, view,
+                                             layout);
+    vk::WriteDescriptorSet write;
+    write.setDstSet(g_descriptor_sets[frame])
+        .setDstBinding(2)
+        .setDstArrayElement(index)
+        .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+        .setImageInfo(image_info);
+    g_device.updateDescriptorSets(write, {});
+}
+
+void write_mesh_texture_descriptor(unsigned frame, std::uint32_t index) {
+    vk::ImageView const view = g_mesh_textures.get_view(index);
+    constexpr auto layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+    if (g_has_descriptor_buffer) {
+        g_descriptor_buffers[frame].write_image(4, index, g_texture_sampler,
+                                                view, layout);
+        return;
+    }
+
+    vk::DescriptorImageInfo const image_info(g_texture_sampler, view, layout);
+    vk::WriteDescriptorSet write;
+    write.setDstSet(g_descriptor_sets[frame])
+        .setDstBinding(4)
+        .setDstArrayElement(index)
+        .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+        .setImageInfo(image_info);
+    g_device.updateDescriptorSets(write, {});
+}
+
+// Write every descriptor into frame slot `frame`'s descriptor buffer.
+void write_descriptor_buffer(unsigned frame) {
+    descriptor_buffer& buffer = g_descriptor_buffers[frame];
+    buffer.write_storage_buffer(0, g_device_local_buffer.get_device_address(),
+                                g_device_local_buffer.size());
+
+    // Color, normal, XYZ, instance ID, and rasterization depth maps.
+    std::array<std::pair<vk::ImageView, vk::ImageLayout>, 5> const maps = {{
+        {g_color_image.imageView(), vk::ImageLayout::eShaderReadOnlyOptimal},
+        {g_normal_image.imageView(), vk::ImageLayout::eShaderReadOnlyOptimal},
+        {g_xyz_image.imageView(), vk::ImageLayout::eShaderReadOnlyOptimal},
+        {g_id_image.imageView(), vk::ImageLayout::eShaderReadOnlyOptimal},
+        {g_depth_image.imageView(),
+         vk::ImageLayout::eDepthStencilReadOnlyOptimal},
+    }};
+    for (std::uint32_t i = 0; i < maps.size(); ++i) {
+        buffer.write_image(1, i, g_nearest_neighbor_sampler, maps[i].first,
+                           maps[i].second);
+    }
+
+    buffer.write_image(3, 0, g_nearest_neighbor_sampler,
+                       g_texture_loader.get_view(g_skybox_texture),
+                       vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    buffer.write_storage_image(5, *g_composite_image.view);
+    buffer.write_image(6, 0, g_linear_sampler, *g_composite_image.view,
+                       vk::ImageLayout::eGeneral);
+}
+
+// Write every descriptor except light maps and mesh textures into frame slot
+// `frame`'s descriptor set.
+void write_descriptor_set(unsigned frame) {
     vku::DescriptorSetUpdater dsu_camera;
-    dsu_camera.beginDescriptorSet(g_descriptor_set);
+    dsu_camera.beginDescriptorSet(g_descriptor_sets[frame]);
 
     dsu_camera.beginBuffers(0, 0, vk::DescriptorType::eStorageBuffer)
         .buffer(g_device_local_buffer.buffer(), 0, vk::WholeSize)
@@ -137,46 +531,105 @@ void update_descriptors() {
         .image(g_nearest_neighbor_sampler, g_depth_image.imageView(),
                vk::ImageLayout::eDepthStencilReadOnlyOptimal);
 
-    // Light depth textures.
-    assert(!g_lights.light_maps.empty());
-    dsu_camera.beginImages(2, 0, vk::DescriptorType::eCombinedImageSampler);
-
-    // Add every light-source to the light map bindings.
-    for (auto&& image : g_lights.light_maps) {
-        dsu_camera.image(g_nearest_neighbor_sampler, image.imageView(),
-                         vk::ImageLayout::eDepthStencilReadOnlyOptimal);
-    }
-
     // Add skybox texture.
     dsu_camera.beginImages(3, 0, vk::DescriptorType::eCombinedImageSampler)
-        .image(g_nearest_neighbor_sampler, g_skybox_view,
-               vk::ImageLayout(g_ktx_skybox.imageLayout));
+        .image(g_nearest_neighbor_sampler,
+               g_texture_loader.get_view(g_skybox_texture),
+               vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    // Add the composited image.
+    dsu_camera.beginImages(5, 0, vk::DescriptorType::eStorageImage)
+        .image({}, *g_composite_image.view, vk::ImageLayout::eGeneral);
+
+    // Add the composited image again, to be upscaled.
+    dsu_camera.beginImages(6, 0, vk::DescriptorType::eCombinedImageSampler)
+        .image(g_linear_sampler, *g_composite_image.view,
+               vk::ImageLayout::eGeneral);
 
     dsu_camera.update(g_device);
     assert(dsu_camera.ok());
 }
 
-void render_and_present(unsigned frame) {
-    constexpr auto timeout = std::numeric_limits<uint64_t>::max();
+// Apply the descriptor changes which frame slot `frame` has not received yet.
+// Its last frame must have finished.
+void write_pending_descriptors(unsigned frame) {
+    pending_descriptors& pending = g_pending_descriptors[frame];
+    if (pending.is_all_stale) {
+        if (g_has_descriptor_buffer) {
+            write_descriptor_buffer(frame);
+        } else {
+            write_descriptor_set(frame);
+        }
+        // Light maps are partially bound, so only created ones are written.
+        for (unsigned i = 0; i < g_lights.get_slot_count(); ++i) {
+            write_light_map_descriptor(frame, i);
+        }
+        pending.light_maps.clear();
+        pending.is_all_stale = false;
+    }
+
+    for (unsigned const index : pending.light_maps) {
+        write_light_map_descriptor(frame, index);
+    }
+    pending.light_maps.clear();
+
+    for (std::uint32_t const index : pending.mesh_textures) {
+        write_mesh_texture_descriptor(frame, index);
+    }
+    pending.mesh_textures.clear();
+}
+
+void update_descriptors() {
+    for (pending_descriptors& pending : g_pending_descriptors) {
+        pending.is_all_stale = true;
+    }
+}
+
+void update_light_map_descriptor(unsigned index) {
+    for (pending_descriptors& pending : g_pending_descriptors) {
+        pending.light_maps.push_back(index);
+    }
+}
+
+void update_mesh_texture_descriptor(std::uint32_t index) {
+    for (pending_descriptors& pending : g_pending_descriptors) {
+        pending.mesh_textures.push_back(index);
+    }
+}
 
-    // Wait for host to signal the fence for this swapchain frame.
+void wait_for_frame(unsigned frame) {
+    cpu_zone("wait for fence");
+    constexpr auto timeout = std::numeric_limits<std::uint64_t>::max();
     auto _ =
         g_device.waitForFences(g_in_flight_fences[frame], vk::True, timeout);
+    g_retired_buffers[frame].clear();
+}
+
+auto acquire_swapchain_image(unsigned frame) -> std::uint32_t {
+    cpu_zone("acquire");
+    constexpr auto timeout = std::numeric_limits<std::uint64_t>::max();
 
-    // Get a swapchain index that is currently presentable.
-    // Throw an exception here.
-    unsigned image_index =
+    // This throws `vk::OutOfDateKHRError` when the swapchain must be
+    // recreated.
+    std::uint32_t const image_index =
         g_device
             .acquireNextImageKHR(g_swapchain.swapchain, timeout,
                                  g_available_semaphores[frame], nullptr)
             .value;
 
+    // Swapchains can have more images than frames in flight, so a frame of
+    // another slot might still render into this image.
     if (g_image_in_flight[image_index] != nullptr) {
         auto _ = g_device.waitForFences(g_image_in_flight[image_index],
                                         vk::True, timeout);
     }
-
     g_image_in_flight[image_index] = g_in_flight_fences[frame];
+    return image_index;
+}
+
+void submit_and_present(unsigned frame, std::uint32_t image_index,
+                        std::uint64_t present_id) {
+    cpu_zone("submit_and_present");
 
     std::array<vk::Semaphore, 1> wait_semaphores = {
         g_available_semaphores[frame],
@@ -192,7 +645,7 @@ void render_and_present(unsigned frame) {
     vk::SubmitInfo submit_info;
     submit_info.setWaitSemaphores(wait_semaphores)
         .setWaitDstStageMask(wait_stages)
-        .setCommandBuffers(g_command_buffers[image_index])
+        .setCommandBuffers(g_command_buffers[frame])
         .setSignalSemaphores(signal_semaphores);
 
     g_device.resetFences({g_in_flight_fences[frame]});
@@ -207,7 +660,14 @@ void render_and_present(unsigned frame) {
         .setWaitSemaphores(signal_semaphores)
         .setSwapchains(swapchains);
 
-    // Throw an exception here.
+    // Presents are identified so that later frames can wait for them.
+    vk::PresentIdKHR present_id_info(1, &present_id);
+    if (g_has_present_wait) {
+        present_info.setPNext(&present_id_info);
+    }
+
+    // This throws `vk::OutOfDateKHRError` when the swapchain must be
+    // recreated.
     auto _ = g_graphics_queue.presentKHR(present_info);
 }
 
@@ -227,72 +687,104 @@ void set_all_render_state(vk::CommandBuffer cmd) {
     cmd.setSampleMaskEXT(vk::SampleCountFlagBits::e1, sample_mask);
     cmd.setAlphaToCoverageEnableEXT(vk::True);
 
+    shader_objects.unbind_task_mesh(cmd);
+
     cmd.setPrimitiveTopology(vk::PrimitiveTopology::eTriangleList);
     cmd.setPrimitiveRestartEnable(vk::False);
 
+#ifdef vertex_pulling
+    // Vertex shaders load their vertices and instances from the bindless
+    // buffer's address, so there are no vertex attributes.
+    cmd.setVertexInputEXT({}, {});
+#else
     // Per-vertex bindings and attributes:
     vk::VertexInputBindingDescription2EXT per_vertex_binding{};
     per_vertex_binding.setBinding(0)
         .setInputRate(vk::VertexInputRate::eVertex)
-        .setStride(sizeof(vertex))
+        .setStride(sizeof(gpu_vertex))
         .setDivisor(1);
 
     vk::VertexInputAttributeDescription2EXT per_vertex_position_attribute{};
     per_vertex_position_attribute.setBinding(0)
         .setLocation(0)
-        .setOffset(0)
+        .setOffset(offsetof(gpu_vertex, position))
+#ifdef compact_vertices
+        .setFormat(vk::Format::eR16G16B16A16Snorm);  // `glm::i16vec4`
+#else
         .setFormat(vk::Format::eR32G32B32A32Sfloat);  // `glm::vec4`
+#endif
 
     vk::VertexInputAttributeDescription2EXT per_vertex_normal_attribute{};
     per_vertex_normal_attribute.setBinding(0)
         .setLocation(1)
-        .setOffset(offsetof(vertex, normal))
+        .setOffset(offsetof(gpu_vertex, normal))
+#ifdef compact_vertices
+        .setFormat(vk::Format::eR16G16Snorm);  // `glm::i16vec2`
+#else
         .setFormat(vk::Format::eR32G32B32A32Sfloat);  // `glm::vec3`
-
-    // Per-instance bindings and attributes:
+#endif
+
+    // Per-instance bindings and attributes. With `soa_instances`, every
+    // member has its own binding following the per-vertex binding.
+#ifdef soa_instances
+    auto const instance_binding = [](std::uint32_t location,
+                                     std::uint32_t stride) {
+        vk::VertexInputBindingDescription2EXT binding{};
+        binding.setBinding(location - 1)
+            .setInputRate(vk::VertexInputRate::eInstance)
+            .setStride(stride)
+            .setDivisor(1);
+        return binding;
+    };
+    std::array const bindings = {
+        per_vertex_binding,
+        instance_binding(2, sizeof(buffer_storage::property::position)),
+        instance_binding(3, sizeof(buffer_storage::property::rotation)),
+        instance_binding(4, sizeof(buffer_storage::property::scaling)),
+        instance_binding(5, sizeof(buffer_storage::property::color_blend)),
+        instance_binding(6, sizeof(buffer_storage::property::id)),
+        instance_binding(7, sizeof(buffer_storage::property::texture_index)),
+    };
+#else
     vk::VertexInputBindingDescription2EXT per_instance_binding{};
     per_instance_binding.setBinding(1)
         .setInputRate(vk::VertexInputRate::eInstance)
         .setStride(sizeof(buffer_storage::property))
         .setDivisor(1);
-
-    vk::VertexInputAttributeDescription2EXT per_instance_position_attribute{};
-    per_instance_position_attribute.setBinding(1)
-        .setLocation(2)
-        .setOffset(offsetof(buffer_storage::property, position))
-        .setFormat(vk::Format::eR32G32B32Sfloat);  // `glm::vec3`
-
-    vk::VertexInputAttributeDescription2EXT per_instance_rotation_attribute{};
-    per_instance_rotation_attribute.setBinding(1)
-        .setLocation(3)
-        .setOffset(offsetof(buffer_storage::property, rotation))
-        .setFormat(vk::Format::eR32G32B32A32Sfloat);  // `glm::fquat`
-
-    vk::VertexInputAttributeDescription2EXT per_instance_scaling_attribute{};
-    per_instance_scaling_attribute.setBinding(1)
-        .setLocation(4)
-        .setOffset(offsetof(buffer_storage::property, scaling))
-        .setFormat(vk::Format::eR32G32B32Sfloat);  // `glm::vec3`
-
-    vk::VertexInputAttributeDescription2EXT
-        per_instance_color_blend_attribute{};
-    per_instance_color_blend_attribute.setBinding(1)
-        .setLocation(5)
-        .setOffset(offsetof(buffer_storage::property, color_blend))
-        .setFormat(vk::Format::eR32G32B32A32Sfloat);  // `glm::vec4`
-
-    vk::VertexInputAttributeDescription2EXT per_instance_id_attribute{};
-    per_instance_id_attribute.setBinding(1)
-        .setLocation(6)
-        .setOffset(offsetof(buffer_storage::property, id))
-        .setFormat(vk::Format::eR32Uint);  // `unsigned`
+    std::array const bindings = {per_vertex_binding, per_instance_binding};
+#endif
+
+    auto const instance_attribute = [](std::uint32_t location,
+                                       std::uint32_t offset,
+                                       vk::Format format) {
+        vk::VertexInputAttributeDescription2EXT attribute{};
+#ifdef soa_instances
+        attribute.setBinding(location - 1).setOffset(0);
+#else
+        attribute.setBinding(1).setOffset(offset);
+#endif
+        attribute.setLocation(location).setFormat(format);
+        return attribute;
+    };
 
     cmd.setVertexInputEXT(
-        {per_vertex_binding, per_instance_binding},
+        bindings,
         {per_vertex_position_attribute, per_vertex_normal_attribute,
-         per_instance_position_attribute, per_instance_rotation_attribute,
-         per_instance_scaling_attribute, per_instance_color_blend_attribute,
-         per_instance_id_attribute});
+         instance_attribute(2, offsetof(buffer_storage::property, position),
+                            vk::Format::eR32G32B32Sfloat),  // `glm::vec3`
+         instance_attribute(3, offsetof(buffer_storage::property, rotation),
+                            vk::Format::eR32Uint),  // `pack_rotation()`
+         instance_attribute(4, offsetof(buffer_storage::property, scaling),
+                            vk::Format::eR32G32B32Sfloat),  // `glm::vec3`
+         instance_attribute(5, offsetof(buffer_storage::property, color_blend),
+                            // `pack_color_blend()`
+                            vk::Format::eR8G8B8A8Snorm),
+         instance_attribute(6, offsetof(buffer_storage::property, id),
+                            vk::Format::eR32Uint),  // `unsigned`
+         instance_attribute(7,
+                            offsetof(buffer_storage::property, texture_index),
+                            vk::Format::eR32Uint)});  // `std::uint32_t`
+#endif
 
     cmd.setDepthClampEnableEXT(vk::False);
     cmd.setDepthClipEnableEXT(vk::False);
@@ -328,71 +820,152 @@ void set_all_render_state(vk::CommandBuffer cmd) {
     constexpr vk::Flags depth_write_mask = vk::ColorComponentFlagBits::eR;
     cmd.setColorWriteMaskEXT(4, 1, &depth_write_mask);
 
-    // Bind color attachments to descriptors so they can be read after being
-    // written.
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, g_pipeline_layout,
-                           0, g_descriptor_set, {});
+}
+
+auto get_index_type() -> vk::IndexType {
+    return (g_bindless_data.get_index_stride() == sizeof(std::uint16_t))
+               ? vk::IndexType::eUint16
+               : vk::IndexType::eUint32;
 }
 
 constexpr vk::ClearColorValue clear_color = {1.f, 0.f, 1.f, 0.f};
 constexpr vk::ClearColorValue black_clear_color = {0, 0, 0, 1};
 constexpr vk::ClearColorValue depth_clear_color = {1.f, 1.f, 1.f, 1.f};
 
-void draw_meshes(vk::CommandBuffer cmd) {
-    // TODO: Use the sized buffers so that debuggers have more info once
-    // RenderDoc supports this feature.
-    // cmd.bindVertexBuffers2(0, g_buffer.buffer(),
-    //                        g_bindless_data.vertices_offset,
-    //                        g_bindless_data.get_vertex_count(),
-    //                        sizeof(vertex));
+// Bind the vertices, every instance property stream, and the indices. When
+// vertices are pulled by shaders, this only binds indices, and only once for
+// each command buffer.
+void bind_geometry_buffers(vk::CommandBuffer cmd) {
+    vk::Buffer const buffer = g_device_local_buffer.buffer();
 
-    // cmd.bindIndexBuffer2KHR(
-    //     g_buffer.buffer(), g_bindless_data.get_index_offset(),
-    //     g_bindless_data.get_index_offset() +
-    //     g_bindless_data.get_index_count(), vk::IndexType::eUint32);
+    cmd.bindIndexBuffer(buffer, g_bindless_data.get_index_offset(),
+                        get_index_type());
 
+#if defined(vertex_pulling)
+    // Vertices and instances are loaded by shaders instead.
+#elif defined(soa_instances)
+    using property = buffer_storage::property;
     cmd.bindVertexBuffers(
-        0, {g_device_local_buffer.buffer(), g_device_local_buffer.buffer()},
+        0, {buffer, buffer, buffer, buffer, buffer, buffer, buffer},
         {g_bindless_data.vertices_offset,
-         g_bindless_data.get_properties_offset()});
+         g_bindless_data.get_property_member_offset(
+             offsetof(property, position)),
+         g_bindless_data.get_property_member_offset(
+             offsetof(property, rotation)),
+         g_bindless_data.get_property_member_offset(
+             offsetof(property, scaling)),
+         g_bindless_data.get_property_member_offset(
+             offsetof(property, color_blend)),
+         g_bindless_data.get_property_member_offset(offsetof(property, id)),
+         g_bindless_data.get_property_member_offset(
+             offsetof(property, texture_index))});
+#else
+    cmd.bindVertexBuffers(0, {buffer, buffer},
+                          {g_bindless_data.vertices_offset,
+                           g_bindless_data.get_properties_offset()});
+#endif
+}
 
-    cmd.bindIndexBuffer(g_device_local_buffer.buffer(),
-                        g_bindless_data.get_index_offset(),
-                        vk::IndexType::eUint32);
+// Draw the meshlets which survived `record_culling`.
+void draw_culled_meshlets(vk::CommandBuffer cmd) {
+#ifndef vertex_pulling
+    bind_geometry_buffers(cmd);
+#endif
+
+    cmd.drawIndexedIndirectCount(
+        g_device_local_buffer.buffer(),
+        g_bindless_data.get_culled_commands_offset(),
+        g_device_local_buffer.buffer(),
+        buffer_storage::culled_commands_count_offset,
+        g_bindless_data.get_culled_commands_capacity(),
+        sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+// Draw the meshlets which survived culling against the `light`th visible
+// light's frustum.
+void draw_light_meshlets(vk::CommandBuffer cmd, unsigned light) {
+#ifndef vertex_pulling
+    bind_geometry_buffers(cmd);
+#endif
+
+    cmd.drawIndexedIndirectCount(
+        g_device_local_buffer.buffer(),
+        g_bindless_data.get_commands_offset_of_light(light),
+        g_device_local_buffer.buffer(),
+        g_bindless_data.get_commands_count_offset_of_light(light),
+        g_bindless_data.get_culled_commands_capacity(),
+        sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+// These match `meshlets_per_task` and `task_instances_per_row` in
+// `shaders.slang`.
+constexpr unsigned meshlets_per_task = 32;
+constexpr unsigned task_instances_per_row = 65'535;
+
+// Cull and draw meshlets with task and mesh shaders.
+void draw_meshlet_tasks(vk::CommandBuffer cmd) {
+    unsigned const instances = g_bindless_data.get_instances_count();
+    unsigned const chunks =
+        (g_bindless_data.get_max_meshlet_count() + meshlets_per_task - 1) /
+        meshlets_per_task;
+    if (instances == 0 || chunks == 0) {
+        return;
+    }
 
-    // 16 is the byte offset of the instance count scalar into the bindless
-    // buffer's base address.
-    cmd.drawIndexedIndirectCount(g_device_local_buffer.buffer(),
-                                 g_bindless_data.get_instance_commands_offset(),
-                                 g_device_local_buffer.buffer(), 16,
-                                 g_bindless_data.get_instance_commands_count(),
-                                 sizeof(vk::DrawIndexedIndirectCommand));
+    // Each dispatch stays within the device's total work group count, which
+    // might only be 2^22. Dispatches of more than one row cover whole rows,
+    // so that only the last one launches groups past the instances.
+    unsigned max_dispatch_instances =
+        std::max(g_max_task_work_group_total_count / chunks, 1u);
+    if (max_dispatch_instances >= task_instances_per_row) {
+        max_dispatch_instances -=
+            max_dispatch_instances % task_instances_per_row;
+    }
+
+    shader_objects.bind_task_mesh(cmd, 10, 11);
+    for (unsigned first = 0; first < instances;
+         first += max_dispatch_instances) {
+        unsigned const count =
+            std::min(instances - first, max_dispatch_instances);
+        unsigned const rows =
+            (count + task_instances_per_row - 1) / task_instances_per_row;
+        cmd.pushConstants(g_pipeline_layout, g_push_constants.stageFlags,
+                          offsetof(push_constants, first_task_instance),
+                          sizeof(first), &first);
+        cmd.drawMeshTasksEXT(chunks, std::min(count, task_instances_per_row),
+                             rows);
+    }
 }
 
 void draw_skybox(vk::CommandBuffer cmd) {
+#ifndef vertex_pulling
     cmd.bindVertexBuffers(0, {g_device_local_buffer.buffer()},
                           {g_bindless_data.vertices_offset});
 
     cmd.bindIndexBuffer(g_device_local_buffer.buffer(),
                         g_bindless_data.get_index_offset(),
-                        vk::IndexType::eUint32);
+                        get_index_type());
+#endif
 
     // The skybox cube has 36 indices.
     cmd.drawIndexed(36, 1, 0, 0, 0);
 }
 
 void record_skybox(vk::CommandBuffer cmd) {
+    gpu_scope(cmd, "skybox");
+
+    vk::Extent2D const extent = get_render_extent();
     vk::Viewport viewport;
-    viewport.setWidth(game_width)
-        .setHeight(game_height)
+    viewport.setWidth(static_cast<float>(extent.width))
+        .setHeight(static_cast<float>(extent.height))
         .setX(0)
         .setY(0)
         .setMinDepth(0.f)
         .setMaxDepth(1.f);
     vk::Rect2D scissor;
-    scissor.setOffset({0, 0}).setExtent({game_width, game_height});
+    scissor.setOffset({0, 0}).setExtent(extent);
     vk::Rect2D render_area;
-    render_area.setOffset({0, 0}).setExtent({game_width, game_height});
+    render_area.setOffset({0, 0}).setExtent(extent);
 
     cmd.setCullMode(vk::CullModeFlagBits::eNone);
     cmd.setViewportWithCount(1, &viewport);
@@ -416,8 +989,8 @@ void record_skybox(vk::CommandBuffer cmd) {
 
     set_all_render_state(cmd);
 
-    shader_objects.bind_vertex(cmd, 6);
-    shader_objects.bind_fragment(cmd, 7);
+    shader_objects.bind_vertex(cmd, 5);
+    shader_objects.bind_fragment(cmd, 6);
 
     draw_skybox(cmd);
 
@@ -425,17 +998,20 @@ void record_skybox(vk::CommandBuffer cmd) {
 }
 
 void record_rendering(vk::CommandBuffer cmd) {
+    gpu_scope(cmd, "rendering");
+
+    vk::Extent2D const extent = get_render_extent();
     vk::Viewport viewport;
-    viewport.setWidth(game_width)
-        .setHeight(game_height)
+    viewport.setWidth(static_cast<float>(extent.width))
+        .setHeight(static_cast<float>(extent.height))
         .setX(0)
         .setY(0)
         .setMinDepth(0.f)
         .setMaxDepth(1.f);
     vk::Rect2D scissor;
-    scissor.setOffset({0, 0}).setExtent({game_width, game_height});
+    scissor.setOffset({0, 0}).setExtent(extent);
     vk::Rect2D render_area;
-    render_area.setOffset({0, 0}).setExtent({game_width, game_height});
+    render_area.setOffset({0, 0}).setExtent(extent);
 
     cmd.setCullMode(vk::CullModeFlagBits::eBack);
     cmd.setViewportWithCount(1, &viewport);
@@ -495,35 +1071,46 @@ void record_rendering(vk::CommandBuffer cmd) {
         cmd, vk::ImageLayout::eDepthStencilAttachmentOptimal,
         vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil);
 
-    // // Modify the bindless buffer with this culling shader.
-    // shader_objects.bind_compute(cmd, 0);
-    // cmd.dispatch(4, 0, 0);
-
     cmd.beginRendering(rendering_info);
 
     set_all_render_state(cmd);
 
     // Rasterizing color, normals, IDs, and depth for the world in view.
-    shader_objects.bind_vertex(cmd, 1);
     shader_objects.bind_fragment(cmd, 3);
 
-    draw_meshes(cmd);
+    if (g_has_mesh_shaders) {
+        draw_meshlet_tasks(cmd);
+    } else {
+        shader_objects.bind_vertex(cmd, 1);
+        draw_culled_meshlets(cmd);
+    }
 
     cmd.endRendering();
 }
 
 void record_lights(vk::CommandBuffer cmd) {
+    gpu_scope(cmd, "lights");
+
+    // Only this many lights are profiled in their own scopes, and the rest
+    // share one, so that any number of lights fit in the profiler's scopes
+    // along with the frame's other passes, which take fewer than 16.
+    constexpr unsigned max_light_scopes = 32;
+    static_assert(max_light_scopes + 16 <= gpu_profiler::max_scopes);
+
+    // Light maps are rendered at the same extent as the camera, and sampled
+    // within it.
+    vk::Extent2D const extent = get_render_extent();
     vk::Viewport viewport;
-    viewport.setWidth(game_width)
-        .setHeight(game_height)
+    viewport.setWidth(static_cast<float>(extent.width))
+        .setHeight(static_cast<float>(extent.height))
         .setX(0)
         .setY(0)
         .setMinDepth(0.f)
         .setMaxDepth(1.f);
     vk::Rect2D scissor;
-    scissor.setOffset({0, 0}).setExtent({game_width, game_height});
+    scissor.setOffset({0, 0}).setExtent(extent);
     vk::Rect2D render_area;
-    render_area.setOffset({0, 0}).setExtent({game_width, game_height});
+    render_area.setOffset({0, 0}).setExtent(extent);
 
     cmd.setDepthBiasEnable(vk::False);
     cmd.setDepthBias(depth_bias_constant, 0, depth_bias_slope);
@@ -531,11 +1118,33 @@ void record_lights(vk::CommandBuffer cmd) {
     cmd.setViewportWithCount(1, &viewport);
     cmd.setScissorWithCount(1, &scissor);
 
+    // Only lights in view of the camera get a shadow pass. Each indexes the
+    // visible lights in the bindless data, and renders into its slot's map.
     // `current_light_idx` should be 32-bit, as `current_light_invocation`
     // is in the shader.
-    for (unsigned current_light_idx = 0; current_light_idx < g_lights.size();
+    std::span<light_t::light const> const visible = g_lights.get_visible();
+    bool is_in_remaining_scope = false;
+    defer {
+        if (is_in_remaining_scope) {
+            g_gpu_profiler.end_scope(cmd);
+        }
+    };
+    for (unsigned current_light_idx = 0; current_light_idx < visible.size();
          ++current_light_idx) {
-        auto& image = g_lights.light_maps[current_light_idx];
+        if (current_light_idx == max_light_scopes) {
+            g_gpu_profiler.begin_scope(cmd, "remaining lights");
+            is_in_remaining_scope = true;
+        }
+        bool const is_scoped = current_light_idx < max_light_scopes;
+        if (is_scoped) {
+            g_gpu_profiler.begin_scope(cmd, "light", current_light_idx);
+        }
+        defer {
+            if (is_scoped) {
+                g_gpu_profiler.end_scope(cmd);
+            }
+        };
+        auto& image = g_lights.get_map(visible[current_light_idx].map_index);
 
         vk::RenderingAttachmentInfoKHR depth_attachment_info;
         depth_attachment_info.setClearValue(depth_clear_color)
@@ -557,128 +1166,384 @@ void record_lights(vk::CommandBuffer cmd) {
 
         set_all_render_state(cmd);
 
-        cmd.pushConstants(g_pipeline_layout, vk::ShaderStageFlagBits::eVertex,
-                          0, sizeof(current_light_idx), &current_light_idx);
+        cmd.pushConstants(g_pipeline_layout, g_push_constants.stageFlags,
+                          offsetof(push_constants, current_light_invocation),
+                          sizeof(current_light_idx), &current_light_idx);
 
         // Rasterizing depth for the world in view.
         shader_objects.bind_vertex(cmd, 2);
         shader_objects.bind_fragment(cmd, 3);
 
-        draw_meshes(cmd);
+        draw_light_meshlets(cmd, current_light_idx);
 
         cmd.endRendering();
     }
 }
 
-void record_compositing(vk::CommandBuffer cmd, std::size_t frame) {
-    // Post processing.
-    g_color_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
-    g_normal_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
-    g_xyz_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
-    g_id_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
-    g_depth_image.setLayout(
-        cmd, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
-        vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil);
-
-    for (auto&& image : g_lights.light_maps) {
-        image.setLayout(cmd, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
-                        vk::ImageAspectFlagBits::eDepth |
-                            vk::ImageAspectFlagBits::eStencil);
-    }
-
-    // The hard-coded compositing triangle does not require depth-testing.
-    cmd.setCullMode(vk::CullModeFlagBits::eBack);
-    cmd.setDepthTestEnable(vk::False);
-    cmd.setDepthWriteEnable(vk::False);
-
-    // Transition swapchain image layout to color write.
-    VkImageMemoryBarrier const render_memory_barrier{
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        .image = g_swapchain_images[frame],
-        .subresourceRange = {
-                             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                             .baseMipLevel = 0,
-                             .levelCount = 1,
-                             .baseArrayLayer = 0,
-                             .layerCount = 1,
-                             }
-    };
+// Filter the render extent of the composited image over the whole swapchain
+// image.
+void record_upscaling(vk::CommandBuffer cmd, std::uint32_t image_index) {
+    gpu_scope(cmd, "upscaling");
 
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,              // srcStageMask
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,  // dstStageMask
-        0, 0, nullptr, 0, nullptr,
-        1,                      // imageMemoryBarrierCount
-        &render_memory_barrier  // pImageMemoryBarriers
-    );
+    vk::Viewport viewport;
+    viewport.setWidth(static_cast<float>(g_swapchain.extent.width))
+        .setHeight(static_cast<float>(g_swapchain.extent.height))
+        .setX(0)
+        .setY(0)
+        .setMinDepth(0.f)
+        .setMaxDepth(1.f);
+    vk::Rect2D render_area;
+    render_area.setOffset({0, 0}).setExtent(g_swapchain.extent);
 
     vk::RenderingAttachmentInfoKHR swapchain_attachment_info;
     swapchain_attachment_info
         .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
-        .setImageView(g_swapchain_views[frame])
+        .setImageView(g_swapchain_views[image_index])
         .setLoadOp(vk::AttachmentLoadOp::eDontCare)
         .setStoreOp(vk::AttachmentStoreOp::eStore);
 
-    vk::Rect2D render_area;
-    render_area.setOffset({0, 0}).setExtent(g_swapchain.extent);
-
     vk::RenderingInfo rendering_info;
     rendering_info.setRenderArea(render_area)
         .setLayerCount(1)
-        .setColorAttachments(swapchain_attachment_info)
-        .setPDepthAttachment(nullptr);
+        .setColorAttachments(swapchain_attachment_info);
 
     cmd.beginRendering(rendering_info);
 
-    shader_objects.bind_vertex(cmd, 4);
-    shader_objects.bind_fragment(cmd, 5);
+    set_all_render_state(cmd);
 
-    // Draw a hard-coded triangle.
+    // The full-screen triangle does not require depth-testing.
+    cmd.setCullMode(vk::CullModeFlagBits::eNone);
+    cmd.setDepthTestEnable(vk::False);
+    cmd.setDepthWriteEnable(vk::False);
+    cmd.setViewportWithCount(1, &viewport);
+    cmd.setScissorWithCount(1, &render_area);
     cmd.setVertexInputEXT({}, {});
+
+    shader_objects.bind_vertex(cmd, 8);
+    shader_objects.bind_fragment(cmd, 9);
     cmd.draw(3, 1, 0, 0);
 
     cmd.endRendering();
+}
 
-    // Transition swapchain image layout to present.
-    VkImageMemoryBarrier const present_memory_barrier{
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        .image = g_swapchain_images[frame],
-        .subresourceRange = {
-                             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                             .baseMipLevel = 0,
-                             .levelCount = 1,
-                             .baseArrayLayer = 0,
-                             .layerCount = 1,
-                             }
-    };
-    vkCmdPipelineBarrier(
-        cmd,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,  // srcStageMask
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,           // dstStageMask
-        0, 0, nullptr, 0, nullptr,
-        1,                       // imageMemoryBarrierCount
-        &present_memory_barrier  // pImageMemoryBarriers
-    );
-}
-
-void record_frame(unsigned int i) {
-    vk::CommandBuffer const cmd = g_command_buffers[i];
+void record_compositing(vk::CommandBuffer cmd, std::uint32_t image_index) {
+    gpu_scope(cmd, "compositing");
+
+    // Post processing.
+    g_color_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+    g_normal_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+    g_xyz_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+    g_id_image.setLayout(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+    g_depth_image.setLayout(
+        cmd, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+        vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil);
+
+    // Only the visible lights' maps are sampled.
+    for (light_t::light const& source : g_lights.get_visible()) {
+        g_lights.get_map(source.map_index)
+            .setLayout(cmd, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                       vk::ImageAspectFlagBits::eDepth |
+                           vk::ImageAspectFlagBits::eStencil);
+    }
+
+    constexpr vk::ImageSubresourceRange color_range(
+        vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+    // The last frame's upscale must finish reading the composite image before
+    // it is overwritten.
+    vk::ImageMemoryBarrier composite_barrier;
+    composite_barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setOldLayout(vk::ImageLayout::eUndefined)
+        .setNewLayout(vk::ImageLayout::eGeneral)
+        .setImage(*g_composite_image.image)
+        .setSubresourceRange(color_range);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader,
+                        vk::PipelineStageFlagBits::eComputeShader, {}, {}, {},
+                        composite_barrier);
+
+    shader_objects.bind_compute(cmd, 4);
+
+    // This matches `composite_tile_size` in `shaders.slang`.
+    constexpr unsigned tile_size = 8;
+    vk::Extent2D const render_extent = get_render_extent();
+    cmd.dispatch((render_extent.width + tile_size - 1) / tile_size,
+                 (render_extent.height + tile_size - 1) / tile_size, 1);
+
+    // The composited image is sampled where it was stored, and the swapchain
+    // image is transitioned to color write.
+    std::array<vk::ImageMemoryBarrier, 2> upscale_barriers;
+    upscale_barriers[0]
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setOldLayout(vk::ImageLayout::eGeneral)
+        .setNewLayout(vk::ImageLayout::eGeneral)
+        .setImage(*g_composite_image.image)
+        .setSubresourceRange(color_range);
+    upscale_barriers[1]
+        .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+        .setOldLayout(vk::ImageLayout::eUndefined)
+        .setNewLayout(vk::ImageLayout::eColorAttachmentOptimal)
+        .setImage(g_swapchain_images[image_index])
+        .setSubresourceRange(color_range);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader |
+                            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                        vk::PipelineStageFlagBits::eFragmentShader |
+                            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                        {}, {}, {}, upscale_barriers);
+
+    record_upscaling(cmd, image_index);
+
+    // Transition swapchain image layout to present. Headless images are
+    // instead copied from, if they are dumped.
+    vk::ImageMemoryBarrier present_barrier;
+    present_barrier.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+        .setOldLayout(vk::ImageLayout::eColorAttachmentOptimal)
+        .setNewLayout(g_is_headless ? vk::ImageLayout::eTransferSrcOptimal
+                                    : vk::ImageLayout::ePresentSrcKHR)
+        .setImage(g_swapchain_images[image_index])
+        .setSubresourceRange(color_range);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                        vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {},
+                        present_barrier);
+}
+
+void record_culling(vk::CommandBuffer cmd) {
+    gpu_scope(cmd, "culling");
+
+    // The culled commands count is shared between frames, so it is cleared
+    // here rather than by the upload.
+    cmd.fillBuffer(g_device_local_buffer.buffer(),
+                   buffer_storage::culled_commands_count_offset,
+                   sizeof(buffer_storage::member_type), 0);
+
+    vk::MemoryBarrier clear_barrier;
+    clear_barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead |
+                          vk::AccessFlagBits::eShaderWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eComputeShader, {},
+                        clear_barrier, {}, {});
+
+    shader_objects.bind_compute(cmd, 0);
+
+    // This matches `culling_main`'s thread count.
+    constexpr unsigned threads_per_group = 64;
+    cmd.dispatch((g_bindless_data.get_instances_count() + threads_per_group -
+                  1) / threads_per_group,
+                 1, 1);
+
+    // The generated commands are read as indirect draws.
+    vk::MemoryBarrier culling_barrier;
+    culling_barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                        vk::PipelineStageFlagBits::eDrawIndirect, {},
+                        culling_barrier, {}, {});
+}
+
+#ifdef gpu_light_culling
+void record_light_culling(vk::CommandBuffer cmd) {
+    auto const light_count =
+        static_cast<unsigned>(g_lights.get_visible().size());
+    if (light_count == 0) {
+        return;
+    }
+    gpu_scope(cmd, "light culling");
+
+    // Like the culled commands count, these are cleared here rather than by
+    // the upload.
+    cmd.fillBuffer(g_device_local_buffer.buffer(),
+                   g_bindless_data.get_light_commands_counts_offset(),
+                   light_count * sizeof(buffer_storage::member_type), 0);
+
+    vk::MemoryBarrier clear_barrier;
+    clear_barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead |
+                          vk::AccessFlagBits::eShaderWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eComputeShader, {},
+                        clear_barrier, {}, {});
+
+    shader_objects.bind_compute(cmd, 7);
+
+    // This matches `light_culling_main`'s thread count. Each row of work
+    // groups culls for one visible light.
+    constexpr unsigned threads_per_group = 64;
+    cmd.dispatch((g_bindless_data.get_instances_count() + threads_per_group -
+                  1) / threads_per_group,
+                 light_count, 1);
+
+    // The generated commands are read as indirect draws.
+    vk::MemoryBarrier culling_barrier;
+    culling_barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                        vk::PipelineStageFlagBits::eDrawIndirect, {},
+                        culling_barrier, {}, {});
+}
+#endif
+
+// Copy the ranges which `upload_bindless_data()` staged for frame slot
+// `frame` into `g_device_local_buffer`, before any pass reads it.
+void record_bindless_upload(vk::CommandBuffer cmd, unsigned frame) {
+    gpu_scope(cmd, "upload");
+
+    // Earlier frames on this queue must finish reading and writing the
+    // buffer before it is overwritten. This frame's clears of culled
+    // commands and texture feedback are transfer writes too, so this is
+    // recorded even when nothing was uploaded.
+    vk::MemoryBarrier before_barrier;
+    before_barrier
+        .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite |
+                          vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                        vk::PipelineStageFlagBits::eTransfer, {},
+                        before_barrier, {}, {});
+
+    if (!g_pending_upload.regions) {
+        return;
+    }
+    assert(g_pending_upload.frame == frame);
+    if (g_pending_upload.regions->empty()) {
+        g_pending_upload.regions.reset();
+        return;
+    }
+
+    cmd.copyBuffer(g_staging_buffers[frame].buffer.buffer(),
+                   g_device_local_buffer.buffer(), *g_pending_upload.regions);
+    g_pending_upload.regions.reset();
+
+    // Every pass after this reads the bindless buffer, as draws, geometry,
+    // shader data, or copies.
+    vk::PipelineStageFlags read_stages =
+        vk::PipelineStageFlagBits::eDrawIndirect |
+        vk::PipelineStageFlagBits::eVertexInput |
+        vk::PipelineStageFlagBits::eVertexShader |
+        vk::PipelineStageFlagBits::eFragmentShader |
+        vk::PipelineStageFlagBits::eComputeShader |
+        vk::PipelineStageFlagBits::eTransfer;
+    if (g_has_mesh_shaders) {
+        read_stages |= vk::PipelineStageFlagBits::eTaskShaderEXT |
+                       vk::PipelineStageFlagBits::eMeshShaderEXT;
+    }
+    vk::MemoryBarrier after_barrier;
+    after_barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead |
+                          vk::AccessFlagBits::eIndexRead |
+                          vk::AccessFlagBits::eVertexAttributeRead |
+                          vk::AccessFlagBits::eShaderRead |
+                          vk::AccessFlagBits::eShaderWrite |
+                          vk::AccessFlagBits::eTransferRead |
+                          vk::AccessFlagBits::eTransferWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, read_stages, {},
+                        after_barrier, {}, {});
+}
+
+// Reset every mesh texture's feedback before fragment shaders report to it.
+void clear_texture_feedback(vk::CommandBuffer cmd) {
+    std::size_t const size = g_bindless_data.get_textures_count() *
+                             sizeof(buffer_storage::member_type);
+    if (size == 0) {
+        return;
+    }
+    cmd.fillBuffer(g_device_local_buffer.buffer(),
+                   g_bindless_data.get_texture_feedback_offset(), size,
+                   no_texture_index);
+
+    vk::MemoryBarrier barrier;
+    barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead |
+                          vk::AccessFlagBits::eShaderWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eFragmentShader, {},
+                        barrier, {}, {});
+}
+
+// Copy the mesh texture feedback of this frame to where the host can read it.
+void read_back_texture_feedback(vk::CommandBuffer cmd, std::size_t frame) {
+    std::size_t const size = g_bindless_data.get_textures_count() *
+                             sizeof(buffer_storage::member_type);
+    if (size == 0) {
+        return;
+    }
+
+    vk::MemoryBarrier shader_barrier;
+    shader_barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader,
+                        vk::PipelineStageFlagBits::eTransfer, {},
+                        shader_barrier, {}, {});
+
+    cmd.copyBuffer(
+        g_device_local_buffer.buffer(),
+        g_mesh_textures.get_feedback_buffer(frame),
+        vk::BufferCopy{g_bindless_data.get_texture_feedback_offset(), 0, size});
+
+    vk::MemoryBarrier host_barrier;
+    host_barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eHostRead);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eHost, {}, host_barrier, {},
+                        {});
+}
+
+void record_frame(unsigned frame, std::uint32_t image_index) {
+    cpu_zone("record_frame");
+    vk::CommandBuffer const cmd = g_command_buffers[frame];
     vk::CommandBufferBeginInfo begin_info;
     cmd.begin(begin_info);
+    g_gpu_profiler.begin_frame(cmd, frame);
+    g_gpu_profiler.begin_scope(cmd, "frame");
+
+    // Push constants are kept across every pass in this command buffer.
+    vk::Extent2D const render_extent = get_render_extent();
+    push_constants const constants = {
+        .render_width = render_extent.width,
+        .render_height = render_extent.height,
+        .bindless_address = g_device_local_buffer.get_device_address(),
+    };
+    cmd.pushConstants(g_pipeline_layout, g_push_constants.stageFlags, 0,
+                      sizeof(constants), &constants);
+
+    // The bindless descriptors are bound once for every pass.
+    write_pending_descriptors(frame);
+    if (g_has_descriptor_buffer) {
+        g_descriptor_buffers[frame].bind(cmd, g_pipeline_layout);
+    } else {
+        for (vk::PipelineBindPoint const bind_point :
+             {vk::PipelineBindPoint::eGraphics,
+              vk::PipelineBindPoint::eCompute}) {
+            cmd.bindDescriptorSets(bind_point, g_pipeline_layout, 0,
+                                   g_descriptor_sets[frame], {});
+        }
+    }
+
+    record_bindless_upload(cmd, frame);
+    g_mesh_textures.record_streaming(cmd, frame);
+    g_texture_loader.record_acquires(cmd);
+
+#ifdef vertex_pulling
+    bind_geometry_buffers(cmd);
+#endif
+
+    if (!g_has_mesh_shaders) {
+        record_culling(cmd);
+    }
+#ifdef gpu_light_culling
+    record_light_culling(cmd);
+#endif
+    clear_texture_feedback(cmd);
 
     // TODO: Skyboxes should be rendered asynchronously, prior to this function.
     record_skybox(cmd);
     record_rendering(cmd);
     record_lights(cmd);
-    record_compositing(cmd, i);
+    record_compositing(cmd, image_index);
+    read_back_texture_feedback(cmd, frame);
 
+    g_gpu_profiler.end_scope(cmd);
     cmd.end();
 }
 
@@ -701,4 +1566,5 @@ void recreate_swapchain() {
     g_swapchain = maybe_swapchain.value();
     g_swapchain_images = *g_swapchain.get_images();
     g_swapchain_views = *g_swapchain.get_image_views();
+    g_image_in_flight.assign(g_swapchain_images.size(), nullptr);
 }
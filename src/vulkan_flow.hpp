@@ -2,19 +2,55 @@
 
 #include <globals.hpp>
 
+#include "bindless.hpp"
+
 auto make_device(vkb::Instance instance, vk::SurfaceKHR surface) -> vk::Device;
 
 void create_first_swapchain();
 void create_command_pool();
 void create_command_buffers();
 void create_sync_objects();
+void create_device_local_buffer(std::size_t size);
+// Create the image which compositing writes into, which must be destroyed
+// before the device.
+void create_composite_image();
+void destroy_composite_image();
+// Stage the bytes of `g_bindless_data` which changed since the last upload,
+// which `record_frame()` then copies into `g_device_local_buffer` before its
+// passes. The buffer grows first if the data outgrew it. Frame slot `frame` is
+// the next to record, and its last frame must have finished. This returns how
+// many bytes are copied.
+auto upload_bindless_data(unsigned frame) -> std::size_t;
+// The visible lights and mesh textures which `g_bindless_data.push_scene()`
+// lays out with the scene.
+[[nodiscard]]
+auto get_renderer_inputs() -> renderer_inputs;
+// Rewrite every bindless descriptor. Like the updates below, this is deferred
+// until each frame slot records its next frame, so that descriptors which
+// pending frames read are never written.
 void update_descriptors();
+// Rewrite only the descriptor of light map `index`.
+void update_light_map_descriptor(unsigned index);
+// Rewrite the descriptor of mesh texture `index` in `g_mesh_textures`.
+void update_mesh_texture_descriptor(std::uint32_t index);
 void recreate_swapchain();
 void draw_skybox(vk::CommandBuffer cmd);
 void record_skybox(vk::CommandBuffer cmd);
-void render_and_present(unsigned);
+// Wait until frame slot `frame` finished its last commands, so that it can be
+// recorded again.
+void wait_for_frame(unsigned frame);
+// Acquire the swapchain image which frame slot `frame` renders into.
+auto acquire_swapchain_image(unsigned frame) -> std::uint32_t;
+// Submit frame slot `frame`'s command buffer, then present `image_index` with
+// `present_id`, which must increase with every present.
+void submit_and_present(unsigned frame, std::uint32_t image_index,
+                        std::uint64_t present_id);
 void record_rendering(vk::CommandBuffer cmd);
 void record_lights(vk::CommandBuffer cmd);
-void record_compositing(vk::CommandBuffer cmd, std::size_t frame);
-void record_frame(unsigned int i);
+void record_upscaling(vk::CommandBuffer cmd, std::uint32_t image_index);
+void record_compositing(vk::CommandBuffer cmd, std::uint32_t image_index);
+void record_culling(vk::CommandBuffer cmd);
+// Record frame slot `frame`'s command buffer, which composites into swapchain
+// image `image_index`.
+void record_frame(unsigned frame, std::uint32_t image_index);
 void set_all_render_state(vk::CommandBuffer cmd);
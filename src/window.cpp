@@ -1,43 +1,53 @@
 #include "window.hpp"
 
-#include "camera.hpp"
+#include <optional>
+
+#include "simulation.hpp"
 
 // NOLINTNEXTLINE I can't control this API.
 void my_window::OnResizeEvent(uint16_t width, uint16_t height) {
 }
 
-constexpr float speed = 0.5f;
+namespace {
+// Keys which the simulation reads while they are held.
+auto get_control(eKeycode keycode) -> std::optional<control> {
+    switch (keycode) {
+        case KEY_Up:
+            return control::forward;
+        case KEY_Down:
+            return control::backward;
+        case KEY_Left:
+            return control::left;
+        case KEY_Right:
+            return control::right;
+        case KEY_PageUp:
+            return control::up;
+        case KEY_PageDown:
+            return control::down;
+        case KEY_S:
+            return control::turn_left;
+        case KEY_D:
+            return control::turn_right;
+    }
+    return std::nullopt;
+}
+}  // namespace
 
 void my_window::OnKeyEvent(eAction action, eKeycode keycode) {
+    if (action == eDOWN && keycode == KEY_Escape) {
+        Close();
+        return;
+    }
+
+    // The simulation moves the camera, so that it moves as fast regardless
+    // of the frame rate.
+    std::optional<control> const input = get_control(keycode);
+    if (!input) {
+        return;
+    }
     if (action == eDOWN) {
-        switch (keycode) {
-            case KEY_Up:
-                g_camera.position.z -= speed;
-                break;
-            case KEY_Down:
-                g_camera.position.z += speed;
-                break;
-            case KEY_Left:
-                g_camera.position.x -= speed;
-                break;
-            case KEY_Right:
-                g_camera.position.x += speed;
-                break;
-            case KEY_PageUp:
-                g_camera.position.y += speed;
-                break;
-            case KEY_PageDown:
-                g_camera.position.y -= speed;
-                break;
-            case KEY_S:
-                g_camera.yaw -= speed / 4;
-                break;
-            case KEY_D:
-                g_camera.yaw += speed / 4;
-                break;
-            case KEY_Escape:
-                Close();
-                break;
-        }
+        g_simulation.press(*input);
+    } else if (action == eUP) {
+        g_simulation.release(*input);
     }
 }